@@ -0,0 +1,44 @@
+#include "AllocationCounter.h"
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+    thread_local unsigned long *currentCounter = nullptr;
+}
+
+void *operator new(std::size_t size)
+{
+    if (currentCounter != nullptr)
+        (*currentCounter)++;
+
+    auto memory = std::malloc(size > 0 ? size : 1);
+
+    if (memory == nullptr)
+        throw std::bad_alloc();
+
+    return memory;
+}
+
+void operator delete(void *memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void *memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+namespace Simulator_n
+{
+    AllocationCounter::AllocationCounter(unsigned long *counter) : previous(currentCounter)
+    {
+        currentCounter = counter;
+    }
+
+    AllocationCounter::~AllocationCounter()
+    {
+        currentCounter = previous;
+    }
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+namespace Simulator_n
+{
+    // counts heap allocations (operator new) of the calling thread into the given counter, for as long as it exists.
+    // Counters nest: nullptr counts nothing, which leaves out e.g. the simulated platform calls inside a counted device loop.
+    // Linking AllocationCounter.cpp replaces the global operator new. malloc() isn't seen, rapidjson's own allocators included
+    class AllocationCounter
+    {
+    private:
+        unsigned long *previous;
+
+    public:
+        explicit AllocationCounter(unsigned long *counter);
+        ~AllocationCounter();
+
+        AllocationCounter(const AllocationCounter&) = delete;
+        AllocationCounter &operator=(const AllocationCounter&) = delete;
+    };
+}
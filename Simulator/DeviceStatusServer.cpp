@@ -0,0 +1,929 @@
+#include "DeviceStatusServer.h"
+#include "DeviceParameter.h"
+#include "WebSocket.h"
+#include "rapidjson/document.h"
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
+#include <cstdlib>
+#include <cctype>
+
+namespace Simulator_n
+{
+    using namespace rapidjson;
+    using SmartHomeDevice_n::CborContainer;
+    using SmartHomeDevice_n::CborReader;
+    using SmartHomeDevice_n::CborWriter;
+    using SmartHomeDevice_n::DeviceParameter;
+    using SmartHomeDevice_n::WebSocket;
+    using SmartHomeDevice_n::WebSocketDecoder;
+    using SmartHomeDevice_n::WebSocketMessage;
+    namespace WebSocketOpcode = SmartHomeDevice_n::WebSocketOpcode;
+
+    struct ServerConnectionContext : public ConnectionContext
+    {
+        std::string      receiveBuffer;
+        std::mt19937     randomGenerator;
+
+        bool             webSocket;
+        unsigned long    deviceId;
+        WebSocketDecoder webSocketDecoder;
+        bool             closing;       // server has sent CLOSE
+        bool             closeReplied;  // and the device has answered it
+
+        explicit ServerConnectionContext(const unsigned long &seed) : randomGenerator(static_cast<std::mt19937::result_type>(seed)), webSocket(false), deviceId(0), closing(false), closeReplied(false) { }
+    };
+
+    // accepts both the legacy (embedded JSON string) and the nested parameter representation
+    static bool readParameter(const Value &value, std::string &name, std::string &paramJson)
+    {
+        if (value.IsString())
+        {
+            // legacy format: parameter is a JSON document embedded as a string
+            Document parameter;
+
+            parameter.Parse(value.GetString());
+
+            if (parameter.HasParseError() || !parameter.IsObject() || !parameter.HasMember("name") || !parameter["name"].IsString())
+                return false;
+
+            name      = parameter["name"].GetString();
+            paramJson = value.GetString();
+
+            return true;
+        }
+        else if (value.IsObject() && value.HasMember("name") && value["name"].IsString())
+        {
+            StringBuffer buffer;
+            Writer<StringBuffer> writer(buffer);
+
+            value.Accept(writer);
+
+            name      = value["name"].GetString();
+            paramJson = std::string(buffer.GetString(), buffer.GetSize());
+
+            return true;
+        }
+        else
+            return false;
+    }
+
+    // request body, as the device writes it in CBOR, rewritten as JSON with nested parameters
+    static bool cborBodyToJson(const std::string &cbor, std::string &json)
+    {
+        CborReader    reader(cbor.data(), cbor.size());
+        CborContainer members;
+
+        if (!reader.enterMap(members))
+            return false;
+
+        StringBuffer buffer;
+        Writer<StringBuffer> writer(buffer);
+
+        writer.StartObject();
+
+        while (reader.next(members))
+        {
+            const char *key;
+            size_t      keyLength;
+
+            if (!reader.readText(key, keyLength) || !reader.next(members))
+                return false;
+
+            std::string name(key, keyLength);
+
+            const char *str;
+            size_t      length;
+
+            if ( ( (name == "eventName") || (name == "supportedPayloadFormat") ) && reader.isText() && reader.readText(str, length) )
+            {
+                writer.Key(name.c_str(), static_cast<SizeType>(name.length()));
+                writer.String(str, static_cast<SizeType>(length));
+            }
+            else if (name == "parameter")
+            {
+                DeviceParameter param;
+
+                if (!DeviceParameter::readCbor(reader, param))
+                    return false;
+
+                writer.Key("parameter");
+                param.writeJson(writer);
+            }
+            else if (name == "parameters")
+            {
+                CborContainer parameters;
+
+                if (!reader.enterArray(parameters))
+                    return false;
+
+                writer.Key("parameters");
+                writer.StartArray();
+
+                while (reader.next(parameters))
+                {
+                    DeviceParameter param;
+
+                    if (!DeviceParameter::readCbor(reader, param))
+                        return false;
+
+                    param.writeJson(writer);
+                }
+
+                writer.EndArray();
+            }
+            else
+                reader.skip();
+
+            if (reader.hasError())
+                return false;
+        }
+
+        writer.EndObject();
+
+        json.assign(buffer.GetString(), buffer.GetSize());
+
+        return true;
+    }
+
+    DeviceStatusServer::DeviceStatusServer(const FaultInjection &faults, const bool &nestedPayloadsSupported, const bool &cborSupported)
+    : faults(faults),
+      nestedPayloadsSupported(nestedPayloadsSupported),
+      cborSupported(cborSupported),
+      nextDeviceId(1),
+      remainingServerErrors(0),
+      connectionsCounter(0),
+      connections(0),
+      requests(0),
+      devicesRegistered(0),
+      parameterUpdates(0),
+      statusRequests(0),
+      serverErrors(0),
+      droppedConnections(0),
+      badRequests(0),
+      webSocketUpgrades(0),
+      webSocketMessages(0),
+      webSocketCloses(0),
+      cborRequests(0),
+      cborResponses(0)
+    {
+    }
+
+    void DeviceStatusServer::onConnect(SimulatedConnection &connection)
+    {
+        connections++;
+
+        connection.setContext(new ServerConnectionContext(connectionsCounter++));
+    }
+
+    void DeviceStatusServer::onData(SimulatedConnection &connection, const std::string &data)
+    {
+        auto context = static_cast<ServerConnectionContext*>(connection.getContext());
+
+        if (context == nullptr)
+            return;
+
+        if (context->webSocket)
+            context->webSocketDecoder.feed(data);
+        else
+            context->receiveBuffer += data;
+
+        if (context->webSocket)
+            handleWebSocketData(connection);
+        else
+            handleHttpData(connection);
+    }
+
+    void DeviceStatusServer::onDisconnect(SimulatedConnection &connection)
+    {
+        auto context = static_cast<ServerConnectionContext*>(connection.getContext());
+
+        if ( (context != nullptr) && context->closeReplied )
+            webSocketCloses++;
+    }
+
+    void DeviceStatusServer::onTick(SimulatedConnection &connection)
+    {
+        auto context = static_cast<ServerConnectionContext*>(connection.getContext());
+
+        if ( (context == nullptr) || !context->webSocket || context->closing )
+            return;
+
+        std::vector<std::string> pushes;
+        bool close = false;
+
+        {
+            std::lock_guard<std::mutex> guard(pushesLock);
+
+            auto device = pendingPushes.find(context->deviceId);
+
+            if (device != pendingPushes.end())
+            {
+                pushes.swap(device->second);
+                pendingPushes.erase(device);
+            }
+
+            close = (pendingCloses.erase(context->deviceId) > 0);
+        }
+
+        for (const auto &push : pushes)
+            connection.deliver(WebSocket::encodeFrame(WebSocketOpcode::TEXT, push), sampleLatency(context->randomGenerator));
+
+        if (close)
+        {
+            context->closing = true;
+
+            connection.deliver(WebSocket::encodeFrame(WebSocketOpcode::CLOSE, std::string("\x03\xe9", 2)), sampleLatency(context->randomGenerator));
+        }
+    }
+
+    void DeviceStatusServer::handleHttpData(SimulatedConnection &connection)
+    {
+        auto context = static_cast<ServerConnectionContext*>(connection.getContext());
+
+        HttpRequest request;
+
+        while (connection.isOpen() && extractRequest(context->receiveBuffer, request))
+        {
+            requests++;
+
+            if (std::uniform_int_distribution<unsigned int>(0, 99)(context->randomGenerator) < faults.dropRate)
+            {
+                droppedConnections++;
+
+                connection.close();
+
+                return;
+            }
+
+            unsigned long deviceId = 0;
+
+            if (shouldFail())
+            {
+                serverErrors++;
+
+                respond(connection, makeResponse(503, "Service Unavailable"), context->randomGenerator);
+            }
+            else if (!request.webSocketKey.empty() && (request.method == "GET") && parseDeviceId(request.target, deviceId) && isDeviceRegistered(deviceId))
+            {
+                webSocketUpgrades++;
+
+                respond(connection,
+                        "HTTP/1.1 101 Switching Protocols\r\n"
+                        "Upgrade: websocket\r\n"
+                        "Connection: Upgrade\r\n"
+                        "Sec-WebSocket-Accept: " + WebSocket::makeAcceptKey(request.webSocketKey) + "\r\n\r\n",
+                        context->randomGenerator);
+
+                // whatever follows the upgrade request is already framed
+                context->webSocket = true;
+                context->deviceId  = deviceId;
+                context->webSocketDecoder.reset();
+                context->webSocketDecoder.feed(context->receiveBuffer);
+                context->receiveBuffer.clear();
+
+                handleWebSocketData(connection);
+
+                return;
+            }
+            else
+                respond(connection, answer(request), context->randomGenerator);
+        }
+    }
+
+    std::string DeviceStatusServer::answer(const HttpRequest &request)
+    {
+        if (!request.cborBody)
+        {
+            auto response = handleRequest(request);
+
+            if (cborSupported && request.acceptsCbor)
+            {
+                cborResponses++;
+
+                return toCborResponse(response);
+            }
+
+            return response;
+        }
+
+        if (!cborSupported)
+            return makeResponse(415, "Unsupported Media Type");
+
+        cborRequests++;
+
+        HttpRequest jsonRequest = request;
+
+        if (!cborBodyToJson(request.body, jsonRequest.body))
+        {
+            badRequests++;
+
+            return makeResponse(400, "Bad Request");
+        }
+
+        auto response = handleRequest(jsonRequest);
+
+        if (!request.acceptsCbor)
+            return response;
+
+        cborResponses++;
+
+        return toCborResponse(response);
+    }
+
+    void DeviceStatusServer::handleWebSocketData(SimulatedConnection &connection)
+    {
+        auto context = static_cast<ServerConnectionContext*>(connection.getContext());
+
+        WebSocketMessage message;
+
+        while (connection.isOpen() && context->webSocketDecoder.next(message))
+        {
+            switch (message.opcode)
+            {
+                case WebSocketOpcode::TEXT:
+                    requests++;
+                    webSocketMessages++;
+
+                    if (std::uniform_int_distribution<unsigned int>(0, 99)(context->randomGenerator) < faults.dropRate)
+                    {
+                        droppedConnections++;
+
+                        connection.close();
+
+                        return;
+                    }
+
+                    if (shouldFail())
+                    {
+                        // there is no status code in a frame, a failing backend just goes away
+                        serverErrors++;
+
+                        connection.deliver(WebSocket::encodeFrame(WebSocketOpcode::CLOSE, std::string("\x03\xf3", 2)), sampleLatency(context->randomGenerator));
+                        connection.close();
+
+                        return;
+                    }
+
+                    respond(connection, WebSocket::encodeFrame(WebSocketOpcode::TEXT, responseBody(handleDeviceEvent(context->deviceId, message.payload))), context->randomGenerator);
+                    break;
+
+                case WebSocketOpcode::BINARY:
+                {
+                    requests++;
+                    webSocketMessages++;
+
+                    std::string body;
+
+                    // 1003: unsupported data
+                    if (!cborSupported)
+                    {
+                        connection.deliver(WebSocket::encodeFrame(WebSocketOpcode::CLOSE, std::string("\x03\xeb", 2)), sampleLatency(context->randomGenerator));
+                        connection.close();
+
+                        return;
+                    }
+
+                    cborRequests++;
+
+                    if (!cborBodyToJson(message.payload, body))
+                    {
+                        badRequests++;
+                        break;
+                    }
+
+                    cborResponses++;
+
+                    respond(connection, WebSocket::encodeFrame(WebSocketOpcode::BINARY, responseBody(toCborResponse(handleDeviceEvent(context->deviceId, body)))), context->randomGenerator);
+                    break;
+                }
+
+                case WebSocketOpcode::PING:
+                    respond(connection, WebSocket::encodeFrame(WebSocketOpcode::PONG, message.payload), context->randomGenerator);
+                    break;
+
+                case WebSocketOpcode::CLOSE:
+                    // the device's answer to our CLOSE: the connection is its to close
+                    if (context->closing)
+                    {
+                        context->closeReplied = true;
+                        return;
+                    }
+
+                    connection.deliver(WebSocket::encodeFrame(WebSocketOpcode::CLOSE, message.payload), sampleLatency(context->randomGenerator));
+                    connection.close();
+                    return;
+
+                default:
+                    break;
+            }
+        }
+
+        if (context->webSocketDecoder.hasProtocolError())
+        {
+            badRequests++;
+
+            connection.close();
+        }
+    }
+
+    void DeviceStatusServer::startServerErrorBurst(const unsigned int &count)
+    {
+        remainingServerErrors = count;
+    }
+
+    void DeviceStatusServer::pushEvent(const unsigned long &deviceId, const std::string &eventJson)
+    {
+        std::lock_guard<std::mutex> guard(pushesLock);
+
+        pendingPushes[deviceId].push_back(eventJson);
+    }
+
+    void DeviceStatusServer::closeWebSocket(const unsigned long &deviceId)
+    {
+        std::lock_guard<std::mutex> guard(pushesLock);
+
+        pendingCloses.insert(deviceId);
+    }
+
+    DeviceStatusServerStatistics DeviceStatusServer::getStatistics() const
+    {
+        DeviceStatusServerStatistics statistics;
+
+        statistics.connections        = connections;
+        statistics.requests           = requests;
+        statistics.devicesRegistered  = devicesRegistered;
+        statistics.parameterUpdates   = parameterUpdates;
+        statistics.statusRequests     = statusRequests;
+        statistics.serverErrors       = serverErrors;
+        statistics.droppedConnections = droppedConnections;
+        statistics.badRequests        = badRequests;
+        statistics.webSocketUpgrades  = webSocketUpgrades;
+        statistics.webSocketMessages  = webSocketMessages;
+        statistics.webSocketCloses    = webSocketCloses;
+        statistics.cborRequests       = cborRequests;
+        statistics.cborResponses      = cborResponses;
+
+        return statistics;
+    }
+
+    bool DeviceStatusServer::isDeviceRegistered(const unsigned long &deviceId)
+    {
+        std::lock_guard<std::mutex> guard(devicesLock);
+
+        return devices.find(deviceId) != devices.end();
+    }
+
+    unsigned long DeviceStatusServer::getDevicesCount()
+    {
+        std::lock_guard<std::mutex> guard(devicesLock);
+
+        return devices.size();
+    }
+
+    std::string DeviceStatusServer::getParameter(const unsigned long &deviceId, const std::string &name)
+    {
+        std::lock_guard<std::mutex> guard(devicesLock);
+
+        auto device = devices.find(deviceId);
+
+        if (device != devices.end())
+        {
+            auto parameter = device->second.parameters.find(name);
+
+            if (parameter != device->second.parameters.end())
+                return parameter->second;
+        }
+
+        return std::string();
+    }
+
+    bool DeviceStatusServer::extractRequest(std::string &buffer, HttpRequest &request)
+    {
+        auto headersEnd = buffer.find("\r\n\r\n");
+
+        if (headersEnd == std::string::npos)
+            return false;
+
+        auto requestLineEnd = buffer.find("\r\n");
+        auto requestLine    = buffer.substr(0, requestLineEnd);
+
+        auto methodEnd = requestLine.find(' ');
+        auto targetEnd = requestLine.find(' ', methodEnd + 1);
+
+        if ( (methodEnd == std::string::npos) || (targetEnd == std::string::npos) )
+        {
+            // not HTTP at all - throw everything away
+            request = HttpRequest();
+            buffer.clear();
+
+            return true;
+        }
+
+        size_t contentLength = 0;
+        bool   upgrade       = false;
+        bool   acceptsCbor   = false;
+        bool   cborBody      = false;
+        std::string webSocketKey;
+
+        auto headers = buffer.substr(requestLineEnd + 2, headersEnd - requestLineEnd);
+
+        for (size_t lineStart = 0, lineEnd; (lineEnd = headers.find("\r\n", lineStart)) != std::string::npos; lineStart = lineEnd + 2)
+        {
+            auto line = headers.substr(lineStart, lineEnd - lineStart);
+            auto colon = line.find(':');
+
+            if (colon == std::string::npos)
+                continue;
+
+            auto name = line.substr(0, colon);
+
+            for (auto &c : name)
+                c = static_cast<char>(tolower(c));
+
+            auto valueStart = line.find_first_not_of(' ', colon + 1);
+            auto value      = (valueStart == std::string::npos) ? std::string() : line.substr(valueStart);
+
+            if (name == "content-length")
+                contentLength = std::strtoul(value.c_str(), nullptr, 10);
+            else if (name == "upgrade")
+            {
+                for (auto &c : value)
+                    c = static_cast<char>(tolower(c));
+
+                upgrade = (value == "websocket");
+            }
+            else if (name == "sec-websocket-key")
+                webSocketKey = value;
+            else if (name == "accept")
+                acceptsCbor = value.find("application/cbor") != std::string::npos;
+            else if (name == "content-type")
+                cborBody = value.compare(0, 16, "application/cbor") == 0;
+        }
+
+        auto bodyStart = headersEnd + 4;
+
+        if (buffer.size() < bodyStart + contentLength)
+            return false;
+
+        request.method = requestLine.substr(0, methodEnd);
+        request.target = requestLine.substr(methodEnd + 1, targetEnd - methodEnd - 1);
+        request.body   = buffer.substr(bodyStart, contentLength);
+        request.webSocketKey = upgrade ? webSocketKey : std::string();
+        request.acceptsCbor  = acceptsCbor;
+        request.cborBody     = cborBody;
+
+        if (!request.target.empty() && (request.target[0] == '/'))
+            request.target.erase(0, 1);
+
+        buffer.erase(0, bodyStart + contentLength);
+
+        return true;
+    }
+
+    bool DeviceStatusServer::parseDeviceId(const std::string &target, unsigned long &deviceId)
+    {
+        auto idParam = target.find("?id=");
+
+        if (idParam == std::string::npos)
+            return false;
+
+        char *end = nullptr;
+
+        deviceId = std::strtoul(target.c_str() + idParam + 4, &end, 10);
+
+        return (end != nullptr) && (end != target.c_str() + idParam + 4);
+    }
+
+    std::string DeviceStatusServer::makeResponse(const unsigned int &status, const std::string &reason, const std::string &body, const char *contentType)
+    {
+        std::string response = "HTTP/1.1 " + std::to_string(status) + ' ' + reason + "\r\n";
+
+        if (!body.empty())
+            response += std::string("Content-Type: ") + contentType + "\r\n";
+
+        response += "Content-Length: " + std::to_string(body.length()) + "\r\n\r\n" + body;
+
+        return response;
+    }
+
+    std::string DeviceStatusServer::responseBody(const std::string &response)
+    {
+        auto headersEnd = response.find("\r\n\r\n");
+
+        return headersEnd == std::string::npos ? std::string() : response.substr(headersEnd + 4);
+    }
+
+    // the same response as a CBOR host sends it: responseData is a map instead of an embedded JSON document
+    std::string DeviceStatusServer::toCborResponse(const std::string &response)
+    {
+        auto statusEnd = response.find("\r\n");
+        auto body      = responseBody(response);
+
+        Document doc;
+
+        doc.Parse(body.c_str());
+
+        if ( (statusEnd == std::string::npos) || (statusEnd < 13) || doc.HasParseError() || !doc.IsObject() )
+            return response;
+
+        CborWriter writer;
+
+        writer.StartObject();
+
+        for (auto member = doc.MemberBegin(); member != doc.MemberEnd(); ++member)
+        {
+            const Value &value = member->value;
+
+            if ( (std::string(member->name.GetString()) == "responseData") && value.IsString() )
+            {
+                Document responseData;
+
+                responseData.Parse(value.GetString());
+
+                // deviceStatusResponse carries an array of parameter documents, which the device doesn't read in CBOR
+                if (responseData.HasParseError() || !responseData.IsObject())
+                    continue;
+
+                writer.Key("responseData", 12);
+                writer.StartObject();
+
+                for (auto field = responseData.MemberBegin(); field != responseData.MemberEnd(); ++field)
+                {
+                    if (field->value.IsUint64())
+                    {
+                        writer.Key(field->name.GetString(), field->name.GetStringLength());
+                        writer.Uint64(field->value.GetUint64());
+                    }
+                    else if (field->value.IsString())
+                    {
+                        writer.Key(field->name.GetString(), field->name.GetStringLength());
+                        writer.String(field->value.GetString(), field->value.GetStringLength());
+                    }
+                }
+
+                writer.EndObject();
+            }
+            else if (value.IsString())
+            {
+                writer.Key(member->name.GetString(), member->name.GetStringLength());
+                writer.String(value.GetString(), value.GetStringLength());
+            }
+        }
+
+        writer.EndObject();
+
+        // "HTTP/1.1 200 OK"
+        auto status = static_cast<unsigned int>(std::strtoul(response.c_str() + 9, nullptr, 10));
+        auto reason = response.substr(13, statusEnd - 13);
+
+        return makeResponse(status, reason, writer.take(), "application/cbor");
+    }
+
+    std::string DeviceStatusServer::makeEventResponse(const unsigned int &status, const std::string &reason, const std::string &eventName, const std::string &responseData)
+    {
+        StringBuffer buffer;
+        Writer<StringBuffer> writer(buffer);
+
+        writer.StartObject();
+        writer.Key("eventName");
+        writer.String(eventName.c_str(), static_cast<SizeType>(eventName.length()));
+        writer.Key("responseData");
+        writer.String(responseData.c_str(), static_cast<SizeType>(responseData.length()));
+        writer.EndObject();
+
+        return makeResponse(status, reason, std::string(buffer.GetString(), buffer.GetSize()));
+    }
+
+    unsigned int DeviceStatusServer::sampleLatency(std::mt19937 &randomGenerator) const
+    {
+        const auto &latency = faults.latency;
+
+        double value = latency.mean;
+
+        switch (latency.distribution)
+        {
+            case LatencyDistribution::UNIFORM:
+                value = std::uniform_real_distribution<double>(double(latency.mean) - latency.spread, double(latency.mean) + latency.spread)(randomGenerator);
+                break;
+
+            case LatencyDistribution::EXPONENTIAL:
+                value = latency.spread + (latency.mean > 0 ? std::exponential_distribution<double>(1.0 / latency.mean)(randomGenerator) : 0);
+                break;
+
+            case LatencyDistribution::NORMAL:
+                value = std::normal_distribution<double>(latency.mean, latency.spread)(randomGenerator);
+                break;
+
+            default:
+                break;
+        }
+
+        return value > 0 ? static_cast<unsigned int>(value) : 0;
+    }
+
+    bool DeviceStatusServer::shouldFail()
+    {
+        // the burst is server-wide: all connected devices see the same outage
+        auto remaining = remainingServerErrors.load();
+
+        while (remaining > 0)
+        {
+            if (remainingServerErrors.compare_exchange_weak(remaining, remaining - 1))
+                return true;
+        }
+
+        if ( (faults.serverErrorRate > 0) && (faults.serverErrorBurstLength > 0) )
+        {
+            static thread_local std::mt19937 randomGenerator(std::random_device{}());
+
+            if (std::uniform_int_distribution<unsigned int>(0, 99)(randomGenerator) < faults.serverErrorRate)
+            {
+                remainingServerErrors = faults.serverErrorBurstLength - 1;
+
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    std::string DeviceStatusServer::handleRequest(const HttpRequest &request)
+    {
+        unsigned long deviceId = 0;
+
+        if (request.target.compare(0, 12, "deviceStatus") != 0)
+            return makeResponse(404, "Not Found");
+
+        if ( (request.method == "PUT") && (request.target == "deviceStatus") )
+            return handleDeviceOnline(request.body);
+
+        if ( (request.method == "POST") && parseDeviceId(request.target, deviceId) )
+            return handleDeviceEvent(deviceId, request.body);
+
+        if ( (request.method == "GET") && parseDeviceId(request.target, deviceId) )
+            return handleStatusRequest(deviceId);
+
+        badRequests++;
+
+        return makeResponse(400, "Bad Request");
+    }
+
+    std::string DeviceStatusServer::handleDeviceOnline(const std::string &body)
+    {
+        Document doc;
+
+        doc.Parse(body.c_str());
+
+        if (doc.HasParseError() || !doc.IsObject() || !doc.HasMember("parameters") || !doc["parameters"].IsArray())
+        {
+            badRequests++;
+
+            return makeEventResponse(400, "Bad Request", "deviceOnlineResponse", "");
+        }
+
+        DeviceRecord record;
+
+        const Value &parameters = doc["parameters"];
+
+        auto nestedPayloads = doc.HasMember("supportedPayloadFormat") && doc["supportedPayloadFormat"].IsString() && (std::string(doc["supportedPayloadFormat"].GetString()) == "nested");
+
+        for (SizeType i = 0; i < parameters.Size(); i++)
+        {
+            std::string name;
+            std::string paramJson;
+
+            if (parameters[i].IsObject())
+                nestedPayloads = true;
+
+            if (readParameter(parameters[i], name, paramJson))
+                record.parameters[name] = paramJson;
+        }
+
+        unsigned long deviceId;
+
+        {
+            std::lock_guard<std::mutex> guard(devicesLock);
+
+            deviceId = nextDeviceId++;
+
+            devices[deviceId] = record;
+        }
+
+        devicesRegistered++;
+
+        std::string responseData = "{\"deviceId\":" + std::to_string(deviceId);
+
+        if (nestedPayloadsSupported && nestedPayloads)
+            responseData += ",\"payloadFormat\":\"nested\"";
+
+        responseData += '}';
+
+        return makeEventResponse(200, "OK", "deviceOnlineResponse", responseData);
+    }
+
+    std::string DeviceStatusServer::handleDeviceEvent(const unsigned long &deviceId, const std::string &body)
+    {
+        Document doc;
+
+        doc.Parse(body.c_str());
+
+        if (doc.HasParseError() || !doc.IsObject() || !doc.HasMember("eventName") || !doc["eventName"].IsString())
+        {
+            badRequests++;
+
+            return makeResponse(400, "Bad Request");
+        }
+
+        std::string eventName = doc["eventName"].GetString();
+
+        // single parameter events carry "parameter", batched deviceParametersChanged carries "parameters"
+        std::map<std::string, std::string> updates;
+
+        std::string name;
+        std::string paramJson;
+
+        if (doc.HasMember("parameter") && readParameter(doc["parameter"], name, paramJson))
+            updates[name] = paramJson;
+        else if (doc.HasMember("parameters") && doc["parameters"].IsArray())
+        {
+            const Value &parameters = doc["parameters"];
+
+            for (SizeType i = 0; i < parameters.Size(); i++)
+            {
+                if (readParameter(parameters[i], name, paramJson))
+                    updates[name] = paramJson;
+            }
+        }
+
+        if (updates.empty())
+        {
+            badRequests++;
+
+            return makeEventResponse(400, "Bad Request", eventName + "Response", "");
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(devicesLock);
+
+            auto device = devices.find(deviceId);
+
+            if (device == devices.end())
+                return makeEventResponse(404, "Not Found", eventName + "Response", "");
+
+            for (const auto &update : updates)
+                device->second.parameters[update.first] = update.second;
+        }
+
+        parameterUpdates += updates.size();
+
+        return makeEventResponse(200, "OK", eventName + "Response", "");
+    }
+
+    std::string DeviceStatusServer::handleStatusRequest(const unsigned long &deviceId)
+    {
+        statusRequests++;
+
+        std::string parameters = "[";
+
+        {
+            std::lock_guard<std::mutex> guard(devicesLock);
+
+            auto device = devices.find(deviceId);
+
+            if (device == devices.end())
+                return makeEventResponse(404, "Not Found", "deviceStatusResponse", "");
+
+            for (const auto &parameter : device->second.parameters)
+            {
+                if (parameters.size() > 1)
+                    parameters += ',';
+
+                parameters += parameter.second;
+            }
+        }
+
+        parameters += ']';
+
+        return makeEventResponse(200, "OK", "deviceStatusResponse", parameters);
+    }
+
+    void DeviceStatusServer::respond(SimulatedConnection &connection, const std::string &response, std::mt19937 &randomGenerator)
+    {
+        auto latency = sampleLatency(randomGenerator);
+
+        if ( (faults.slowReadChunkSize == 0) || (response.size() <= faults.slowReadChunkSize) )
+        {
+            connection.deliver(response, latency);
+            return;
+        }
+
+        unsigned int delay = latency;
+
+        for (size_t offset = 0; offset < response.size(); offset += faults.slowReadChunkSize)
+        {
+            connection.deliver(response.substr(offset, faults.slowReadChunkSize), delay);
+
+            delay += faults.slowReadInterval;
+        }
+    }
+}
@@ -0,0 +1,157 @@
+#pragma once
+
+#include "SimulatedNetwork.h"
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <random>
+#include <set>
+#include <string>
+
+namespace Simulator_n
+{
+    namespace LatencyDistribution
+    {
+        enum Values : unsigned char
+        {
+            FIXED,          // always 'mean'
+            UNIFORM,        // between 'mean - spread' and 'mean + spread'
+            EXPONENTIAL,    // exponential with the given 'mean', shifted by 'spread'
+            NORMAL          // normal with the given 'mean' and 'spread' as standard deviation
+        };
+    };
+
+    struct LatencyModel
+    {
+        LatencyDistribution::Values distribution;
+        unsigned int                mean;      // virtual ms
+        unsigned int                spread;    // virtual ms
+    };
+
+    struct FaultInjection
+    {
+        LatencyModel latency;
+        unsigned int serverErrorRate;          // percent of requests, which start a burst of 5xx responses
+        unsigned int serverErrorBurstLength;   // requests answered with 5xx in every burst
+        unsigned int dropRate;                 // percent of requests, on which the connection is dropped instead of answering
+        unsigned int slowReadChunkSize;        // responses are delivered in chunks of this many bytes, 0 to deliver at once
+        unsigned int slowReadInterval;         // virtual ms between chunks
+    };
+
+    struct DeviceStatusServerStatistics
+    {
+        unsigned long connections;
+        unsigned long requests;
+        unsigned long devicesRegistered;
+        unsigned long parameterUpdates;
+        unsigned long statusRequests;
+        unsigned long serverErrors;
+        unsigned long droppedConnections;
+        unsigned long badRequests;
+        unsigned long webSocketUpgrades;
+        unsigned long webSocketMessages;
+        unsigned long webSocketCloses;      // closing handshakes started by the server, after which the device has closed the connection
+        unsigned long cborRequests;         // requests and WebSocket messages with a CBOR body
+        unsigned long cborResponses;
+    };
+
+    // stand-in for the backend, speaking the deviceStatus protocol:
+    //  PUT  deviceStatus       { "eventName": "deviceOnline", "parameters": [...] }                   -> deviceOnlineResponse with a new device ID
+    //  POST deviceStatus?id=N  { "eventName": "deviceParameterAdded" | "deviceParameterChanged", ... } -> <eventName>Response
+    //  POST deviceStatus?id=N  { "eventName": "deviceParametersChanged", "parameters": [...] }          -> <eventName>Response
+    //  GET  deviceStatus?id=N                                                                          -> deviceStatusResponse with all parameters
+    //  GET  deviceStatus?id=N with "Upgrade: websocket"  -> 101, afterwards POST bodies are accepted as text frames, and answered with text frames
+    // a closing handshake started by the server leaves closing the connection to the device
+    // parameters are accepted both as embedded JSON strings and as nested objects; the latter is acknowledged in deviceOnlineResponse.
+    // With CBOR supported, CBOR bodies (binary frames) are accepted, and requests offering application/cbor in Accept are answered in it.
+    // Otherwise CBOR bodies get 415
+    class DeviceStatusServer : public SimulatedServer
+    {
+    private:
+        struct HttpRequest
+        {
+            std::string method;
+            std::string target;
+            std::string body;
+            std::string webSocketKey;   // set for WebSocket upgrade requests only
+            bool        acceptsCbor;
+            bool        cborBody;
+        };
+
+        struct DeviceRecord
+        {
+            std::map<std::string, std::string> parameters;   // parameter name -> parameter JSON
+        };
+
+        FaultInjection                          faults;
+        bool                                    nestedPayloadsSupported;
+        bool                                    cborSupported;
+
+        std::mutex                              devicesLock;
+        std::map<unsigned long, DeviceRecord>   devices;
+        unsigned long                           nextDeviceId;
+
+        std::mutex                              pushesLock;
+        std::map<unsigned long, std::vector<std::string>> pendingPushes;
+        std::set<unsigned long>                 pendingCloses;
+
+        std::atomic<unsigned int>               remainingServerErrors;
+        std::atomic<unsigned long>              connectionsCounter;
+
+        std::atomic<unsigned long>              connections;
+        std::atomic<unsigned long>              requests;
+        std::atomic<unsigned long>              devicesRegistered;
+        std::atomic<unsigned long>              parameterUpdates;
+        std::atomic<unsigned long>              statusRequests;
+        std::atomic<unsigned long>              serverErrors;
+        std::atomic<unsigned long>              droppedConnections;
+        std::atomic<unsigned long>              badRequests;
+        std::atomic<unsigned long>              webSocketUpgrades;
+        std::atomic<unsigned long>              webSocketMessages;
+        std::atomic<unsigned long>              webSocketCloses;
+        std::atomic<unsigned long>              cborRequests;
+        std::atomic<unsigned long>              cborResponses;
+
+        static bool extractRequest(std::string&, HttpRequest&);
+        static bool parseDeviceId(const std::string&, unsigned long&);
+        static std::string responseBody(const std::string&);
+        static std::string makeResponse(const unsigned int&, const std::string&, const std::string& = std::string(), const char *contentType = "application/json");
+        static std::string toCborResponse(const std::string&);
+        static std::string makeEventResponse(const unsigned int&, const std::string&, const std::string&, const std::string &responseData);
+
+        unsigned int sampleLatency(std::mt19937&) const;
+        bool shouldFail();
+
+        std::string handleRequest(const HttpRequest&);
+        std::string answer(const HttpRequest&);
+        std::string handleDeviceOnline(const std::string&);
+        std::string handleDeviceEvent(const unsigned long&, const std::string&);
+        std::string handleStatusRequest(const unsigned long&);
+
+        void respond(SimulatedConnection&, const std::string&, std::mt19937&);
+        void handleHttpData(SimulatedConnection&);
+        void handleWebSocketData(SimulatedConnection&);
+
+    public:
+        explicit DeviceStatusServer(const FaultInjection &faults = FaultInjection(), const bool &nestedPayloadsSupported = true, const bool &cborSupported = false);
+
+        void onConnect(SimulatedConnection&) override;
+        void onData(SimulatedConnection&, const std::string&) override;
+        void onDisconnect(SimulatedConnection&) override;
+        void onTick(SimulatedConnection&) override;
+
+        // every following request is answered with 5xx, until 'count' of them are served. Useful to script backend restarts
+        void startServerErrorBurst(const unsigned int &count);
+
+        // queues a server initiated event for the device. It's delivered as soon as the device has an open WebSocket
+        void pushEvent(const unsigned long &deviceId, const std::string &eventJson);
+
+        // starts a closing handshake (1001, going away) on the device's WebSocket, as soon as it has an open one
+        void closeWebSocket(const unsigned long &deviceId);
+
+        DeviceStatusServerStatistics getStatistics() const;
+        bool isDeviceRegistered(const unsigned long &deviceId);
+        unsigned long getDevicesCount();
+        std::string getParameter(const unsigned long &deviceId, const std::string &name);
+    };
+}
@@ -0,0 +1,167 @@
+#include "FleetRunner.h"
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+
+namespace Simulator_n
+{
+    FleetRunner::FleetRunner(const FleetConfiguration &configuration, DeviceFactory deviceFactory) : configuration(configuration)
+    {
+        devices.reserve(configuration.devicesCount);
+
+        for (unsigned int i = 0; i < configuration.devicesCount; i++)
+            devices.push_back(deviceFactory(i));
+    }
+
+    FleetReport FleetRunner::run()
+    {
+        WorkStealingPool pool(configuration.threadsCount);
+
+        auto slice = std::max(configuration.slice, configuration.tick);
+
+        auto startTime = std::chrono::steady_clock::now();
+
+        // devices do not share any state except the peers they talk to, so every slice of every device is an independent task.
+        // Slices keep the fleet roughly aligned in virtual time, and let idle workers steal devices from busy ones.
+        for (unsigned int elapsed = 0; elapsed < configuration.duration; elapsed += slice)
+        {
+            auto currentSlice = std::min(slice, configuration.duration - elapsed);
+
+            for (auto &device : devices)
+            {
+                auto simulatedDevice = device.get();
+
+                if (simulatedDevice == nullptr)
+                    continue;
+
+                pool.submit([simulatedDevice, currentSlice, this]()
+                {
+                    simulatedDevice->runFor(currentSlice, configuration.tick);
+                });
+            }
+
+            pool.wait();
+        }
+
+        auto wallTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+        FleetReport report = FleetReport();
+
+        report.devicesCount = configuration.devicesCount;
+        report.threadsCount = pool.size();
+        report.wallTime     = wallTime;
+        report.stolenTasks  = pool.getStolenTasksCount();
+
+        std::vector<unsigned int> timesToConnected;
+        std::vector<unsigned int> reconnectLatencies;
+
+        for (const auto &device : devices)
+        {
+            if (device == nullptr)
+                continue;
+
+            const auto &statistics = device->getStatistics();
+
+            report.fsmEvents    += device->getProcessedEventsCount();
+            report.httpMessages += statistics.httpMessagesSent + statistics.httpMessagesReceived;
+
+            if (statistics.timeToConnected != 0)
+                timesToConnected.push_back(statistics.timeToConnected);
+
+            reconnectLatencies.insert(reconnectLatencies.end(), statistics.reconnectLatencies.begin(), statistics.reconnectLatencies.end());
+
+            const auto &retryStatistics = device->getRetryStatistics();
+
+            for (byte kind = 0; kind < RetryKind::COUNT; kind++)
+                report.retries[kind] += retryStatistics.retries[kind];
+
+            report.retryBackoffMax = std::max(report.retryBackoffMax, retryStatistics.currentBackoff);
+
+            report.steadyStateAllocations += statistics.steadyStateAllocations;
+            report.steadyStateMessages    += statistics.steadyStateMessages;
+            report.messageArenaOverflows  += device->getMessageArenaOverflows();
+
+            const auto &outboundStatistics = device->getOutboundQueueStatistics();
+
+            report.outboundQueueMaxDepth = std::max(report.outboundQueueMaxDepth, static_cast<unsigned int>(outboundStatistics.maxDepth));
+            report.outboundSuperseded   += outboundStatistics.superseded;
+            report.outboundEvicted      += outboundStatistics.evicted;
+            report.outboundRejected     += outboundStatistics.rejected;
+
+            report.eventPayloadsExhausted += device->getEventPayloadsExhausted();
+            report.droppedScanResults     += device->getDroppedScanResults();
+            report.truncatedHostNames     += device->getTruncatedHostNames();
+        }
+
+        if (wallTime > 0)
+        {
+            report.fsmEventsPerSecond    = report.fsmEvents / wallTime;
+            report.httpMessagesPerSecond = report.httpMessages / wallTime;
+        }
+
+        std::sort(timesToConnected.begin(), timesToConnected.end());
+        std::sort(reconnectLatencies.begin(), reconnectLatencies.end());
+
+        report.connectedDevices    = static_cast<unsigned int>(timesToConnected.size());
+        report.timeToConnectedP50  = percentile(timesToConnected, 50);
+        report.timeToConnectedP90  = percentile(timesToConnected, 90);
+        report.timeToConnectedP99  = percentile(timesToConnected, 99);
+        report.timeToConnectedMax  = timesToConnected.empty() ? 0 : timesToConnected.back();
+        report.reconnects          = reconnectLatencies.size();
+        report.reconnectLatencyP50 = percentile(reconnectLatencies, 50);
+        report.reconnectLatencyP99 = percentile(reconnectLatencies, 99);
+
+        return report;
+    }
+
+    const std::vector<std::unique_ptr<SimulatedDevice>> &FleetRunner::getDevices() const
+    {
+        return devices;
+    }
+
+    unsigned int FleetRunner::percentile(const std::vector<unsigned int> &sortedValues, const unsigned int &percent)
+    {
+        if (sortedValues.empty())
+            return 0;
+
+        // nearest-rank method
+        auto rank = (percent * sortedValues.size() + 99) / 100;
+
+        return sortedValues[rank == 0 ? 0 : rank - 1];
+    }
+
+    std::string FleetRunner::reportToString(const FleetReport &report)
+    {
+        std::ostringstream out;
+
+        out << "devices:               " << report.devicesCount << " on " << report.threadsCount << " threads\n"
+            << "wall time:             " << report.wallTime << " s\n"
+            << "fsm events:            " << report.fsmEvents << " (" << report.fsmEventsPerSecond << " /s)\n"
+            << "http messages:         " << report.httpMessages << " (" << report.httpMessagesPerSecond << " /s)\n"
+            << "stolen tasks:          " << report.stolenTasks << "\n"
+            << "connected devices:     " << report.connectedDevices << "\n"
+            << "time to CONNECTED, ms: p50 " << report.timeToConnectedP50
+                                 << ", p90 " << report.timeToConnectedP90
+                                 << ", p99 " << report.timeToConnectedP99
+                                 << ", max " << report.timeToConnectedMax << "\n"
+            << "reconnects:            " << report.reconnects << "\n"
+            << "reconnect latency, ms: p50 " << report.reconnectLatencyP50
+                                 << ", p99 " << report.reconnectLatencyP99 << "\n"
+            << "retries:               " << report.retries[RetryKind::WIFI_CONNECTION] << " WiFi, "
+                                         << report.retries[RetryKind::SERVER_CONNECTION] << " server, "
+                                         << report.retries[RetryKind::RECONNECT] << " reconnects, "
+                                         << "widest backoff " << report.retryBackoffMax << " ms\n"
+            << "steady state heap:     " << report.steadyStateAllocations << " allocations in "
+                                         << report.steadyStateMessages << " messages, "
+                                         << report.messageArenaOverflows << " arena overflows\n"
+            << "outbound queue:        max depth " << report.outboundQueueMaxDepth << ", "
+                                         << report.outboundSuperseded << " superseded, "
+                                         << report.outboundEvicted << " evicted, "
+                                         << report.outboundRejected << " rejected\n"
+            << "truncation:            " << report.eventPayloadsExhausted << " event payloads exhausted, "
+                                         << report.droppedScanResults << " scan results dropped, "
+                                         << report.truncatedHostNames << " host names truncated\n";
+
+        return out.str();
+    }
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "SimulatedDevice.h"
+#include "WorkStealingPool.h"
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace Simulator_n
+{
+    using DeviceFactory = std::function<std::unique_ptr<SimulatedDevice>(const unsigned int &deviceIndex)>;
+
+    struct FleetConfiguration
+    {
+        unsigned int devicesCount;
+        unsigned int duration;         // virtual ms every device is run for
+        unsigned int tick;             // virtual ms per device loop iteration
+        unsigned int slice;            // virtual ms per scheduled task; devices are re-queued after every slice
+        unsigned int threadsCount;     // 0 means one thread per hardware core
+    };
+
+    struct FleetReport
+    {
+        unsigned int  devicesCount;
+        unsigned int  threadsCount;
+        double        wallTime;              // seconds
+        unsigned long fsmEvents;
+        unsigned long httpMessages;
+        double        fsmEventsPerSecond;
+        double        httpMessagesPerSecond;
+        unsigned long stolenTasks;
+
+        unsigned int  connectedDevices;
+        unsigned int  timeToConnectedP50;    // virtual ms
+        unsigned int  timeToConnectedP90;
+        unsigned int  timeToConnectedP99;
+        unsigned int  timeToConnectedMax;
+        unsigned long reconnects;
+        unsigned int  reconnectLatencyP50;
+        unsigned int  reconnectLatencyP99;
+        unsigned long retries[RetryKind::COUNT];
+        unsigned int  retryBackoffMax;       // ms, widest backoff window at the end of the run
+        unsigned long steadyStateAllocations;
+        unsigned long steadyStateMessages;
+        unsigned long messageArenaOverflows;
+        unsigned int  outboundQueueMaxDepth; // deepest queue of a single device
+        unsigned long outboundSuperseded;
+        unsigned long outboundEvicted;
+        unsigned long outboundRejected;
+        unsigned long eventPayloadsExhausted;
+        unsigned long droppedScanResults;
+        unsigned long truncatedHostNames;
+    };
+
+    class FleetRunner
+    {
+    private:
+        FleetConfiguration                            configuration;
+        std::vector<std::unique_ptr<SimulatedDevice>> devices;
+
+        static unsigned int percentile(const std::vector<unsigned int>&, const unsigned int&);
+
+    public:
+        FleetRunner(const FleetConfiguration&, DeviceFactory);
+
+        FleetReport run();
+
+        const std::vector<std::unique_ptr<SimulatedDevice>> &getDevices() const;
+
+        static std::string reportToString(const FleetReport&);
+    };
+}
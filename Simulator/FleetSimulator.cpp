@@ -0,0 +1,129 @@
+#include "FleetRunner.h"
+#include "DeviceStatusServer.h"
+#include <cstdlib>
+#include <iostream>
+
+using namespace Simulator_n;
+
+// usage: FleetSimulator [devices] [virtual duration, ms] [threads, 0 = all cores] [async connect, 0 / 1]
+// runs the fleet twice: JSON over HTTP, then CBOR over WebSocket against a CBOR capable server.
+// exits with 1, if the device loop has allocated on the heap once its connection has settled, in either of the runs
+
+namespace
+{
+    struct FleetVariant
+    {
+        const char        *name;
+        bool               useWebSocket;
+        WireFormat::Values wireFormat;
+    };
+
+    bool runFleet(const FleetVariant &variant, const FleetConfiguration &fleetConfiguration, const bool &asyncConnect)
+    {
+        const WifiConfiguration wifiConfiguration =
+        {
+            {{"FleetNetwork", "fleetpassword"}},    // knownNetworks
+            {{"192.168.0.10", 8080}},               // knownHosts
+            5000,                                   // networkScanTimeout
+            10000,                                  // wifiConnectionTimeout
+            10000,                                  // serverConnectionTimeout
+            1000,                                   // deviceStatusRequestTimeout
+            3,                                      // maxWifiConnectionRetries
+            3,                                      // maxServerConnectionRetries
+            PayloadFormat::LEGACY,                  // preferredPayloadFormat
+            0,                                      // paramsFlushWindow
+            16,                                     // maxParamsBatchSize
+            variant.useWebSocket,                   // useWebSocket
+            500,                                    // retryBackoffBase
+            30000,                                  // retryBackoffCap
+            100,                                    // retryBackoffTick
+            variant.wireFormat,                     // preferredWireFormat
+            4096                                    // messageArenaSize
+        };
+
+        FaultInjection faults =
+        {
+            {LatencyDistribution::EXPONENTIAL, 30, 5},  // latency
+            1,                                          // serverErrorRate
+            20,                                         // serverErrorBurstLength
+            0,                                          // dropRate
+            0,                                          // slowReadChunkSize
+            0                                           // slowReadInterval
+        };
+
+        DeviceStatusServer server(faults, true, variant.wireFormat == WireFormat::CBOR);
+
+        SimulatedNetwork network;
+
+        network.addAccessPoint({"FleetNetwork", "fleetpassword", 6, -55, false, true, 800, 10})
+               .addAccessPoint({"Neighbours",   "secret",        1, -70, false, true, 800, 0})
+               .addHost({"192.168.0.10", 8080, true, 40, &server});
+
+        FleetRunner fleet(fleetConfiguration, [&](const unsigned int &deviceIndex) -> std::unique_ptr<SimulatedDevice>
+        {
+            auto macAddress = "02:00:00:" + std::to_string((deviceIndex >> 16) & 0xFF) + ':' + std::to_string((deviceIndex >> 8) & 0xFF) + ':' + std::to_string(deviceIndex & 0xFF);
+
+            std::unique_ptr<SimulatedDevice> device(new SimulatedDevice("FleetDevice" + std::to_string(deviceIndex), wifiConfiguration, network, macAddress, deviceIndex));
+
+            device->setAsyncConnect(asyncConnect);
+
+            return device;
+        });
+
+        std::cout << variant.name << "\n";
+
+        auto report = fleet.run();
+
+        std::cout << FleetRunner::reportToString(report);
+
+        auto serverStatistics = server.getStatistics();
+
+        std::cout << "server:                " << serverStatistics.connections << " connections, "
+                                               << serverStatistics.requests << " requests, "
+                                               << serverStatistics.devicesRegistered << " devices registered, "
+                                               << serverStatistics.serverErrors << " 5xx, "
+                                               << serverStatistics.droppedConnections << " dropped, "
+                                               << serverStatistics.webSocketMessages << " WebSocket messages, "
+                                               << serverStatistics.cborRequests << " CBOR requests\n";
+
+        // with the arena reserved, the device loop is not supposed to touch the heap once a connection has settled
+        if ( (report.steadyStateAllocations > 0) || (report.messageArenaOverflows > 0) )
+        {
+            std::cout << "FAILED: heap allocations in steady state\n";
+            return false;
+        }
+
+        return true;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    FleetConfiguration fleetConfiguration =
+    {
+        1000,       // devicesCount
+        600000,     // duration
+        10,         // tick
+        1000,       // slice
+        0           // threadsCount
+    };
+
+    if (argc > 1) fleetConfiguration.devicesCount = static_cast<unsigned int>(std::strtoul(argv[1], nullptr, 10));
+    if (argc > 2) fleetConfiguration.duration     = static_cast<unsigned int>(std::strtoul(argv[2], nullptr, 10));
+    if (argc > 3) fleetConfiguration.threadsCount = static_cast<unsigned int>(std::strtoul(argv[3], nullptr, 10));
+
+    auto asyncConnect = (argc > 4) && (std::strtoul(argv[4], nullptr, 10) != 0);
+
+    const FleetVariant variants[] =
+    {
+        {"JSON over HTTP",      false, WireFormat::JSON},
+        {"CBOR over WebSocket", true,  WireFormat::CBOR}
+    };
+
+    auto passed = true;
+
+    for (const auto &variant : variants)
+        passed = runFleet(variant, fleetConfiguration, asyncConnect) && passed;
+
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,681 @@
+#include "SimulatedDevice.h"
+#include "DeviceStatusServer.h"
+#include "HttpResponseParser.h"
+#include "OutboundQueue.h"
+#include "RetryScheduler.h"
+#include "ServerSelector.h"
+#include <algorithm>
+#include <climits>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+using namespace Simulator_n;
+
+// Runs single devices through scripted server behaviour, which the fleet does not exercise, and checks how they come out of it.
+// Device components, which the fleet exercises only indirectly, are checked on their own against their stated behaviour.
+//
+// usage: ScenarioChecks
+// exits with 1, if any of the scenarios has failed
+
+namespace
+{
+    const unsigned long FIRST_DEVICE_ID = 1;   // the server numbers devices from 1
+
+    struct Scenario
+    {
+        const char           *name;
+        std::function<bool()> run;
+    };
+
+    WifiConfiguration makeConfiguration(const bool &useWebSocket, const WireFormat::Values &preferredWireFormat,
+                                        const unsigned short &paramsFlushWindow = 0, const byte &maxParamsBatchSize = 16)
+    {
+        return
+        {
+            {{"ScenarioNetwork", "scenariopassword"}},  // knownNetworks
+            {{"192.168.0.10", 8080}},                   // knownHosts
+            5000,                                       // networkScanTimeout
+            10000,                                      // wifiConnectionTimeout
+            10000,                                      // serverConnectionTimeout
+            1000,                                       // deviceStatusRequestTimeout
+            3,                                          // maxWifiConnectionRetries
+            3,                                          // maxServerConnectionRetries
+            PayloadFormat::LEGACY,                      // preferredPayloadFormat
+            paramsFlushWindow,                          // paramsFlushWindow
+            maxParamsBatchSize,                         // maxParamsBatchSize
+            useWebSocket,                               // useWebSocket
+            500,                                        // retryBackoffBase
+            30000,                                      // retryBackoffCap
+            100,                                        // retryBackoffTick
+            preferredWireFormat,                        // preferredWireFormat
+            4096                                        // messageArenaSize
+        };
+    }
+
+    SimulatedNetwork makeNetwork(DeviceStatusServer &server)
+    {
+        SimulatedNetwork network;
+
+        network.addAccessPoint({"ScenarioNetwork", "scenariopassword", 6, -55, false, true, 800, 0})
+               .addHost({"192.168.0.10", 8080, true, 40, &server});
+
+        return network;
+    }
+
+    // the application side of a device, which adds and changes its own parameters
+    class ApplicationDevice : public SimulatedDevice
+    {
+    public:
+        using SimulatedDevice::SimulatedDevice;
+        using SimulatedDevice::addParam;
+        using SimulatedDevice::setParamValue;
+    };
+
+    bool check(const bool &condition, const char *what)
+    {
+        if (!condition)
+            std::cout << "  failed: " << what << "\n";
+
+        return condition;
+    }
+
+    // runs the device in small steps, until it notices that it has lost the connection
+    bool leavesConnected(SimulatedDevice &device, const unsigned int &timeout)
+    {
+        for (unsigned int elapsed = 0; elapsed < timeout; elapsed += 10)
+        {
+            device.step(10);
+
+            if (device.getState() != State::CONNECTED)
+                return true;
+        }
+
+        return false;
+    }
+
+    // the server goes away with a closing handshake: the device answers it, closes the connection itself, and connects again
+    bool serverClosesWebSocket()
+    {
+        DeviceStatusServer server;
+
+        SimulatedDevice device("ScenarioDevice", makeConfiguration(true, WireFormat::JSON), makeNetwork(server), "02:00:00:00:00:01");
+
+        if (!check(device.runUntil(State::CONNECTED, 60000), "device has connected"))
+            return false;
+
+        device.runFor(2000);
+
+        if (!check(server.getStatistics().webSocketUpgrades == 1, "connection has been upgraded to WebSocket"))
+            return false;
+
+        server.closeWebSocket(FIRST_DEVICE_ID);
+
+        if (!check(leavesConnected(device, 5000), "device has left CONNECTED after the server's CLOSE"))
+            return false;
+
+        if (!check(server.getStatistics().webSocketCloses == 1, "device has closed the connection after its CLOSE reply"))
+            return false;
+
+        if (!check(device.runUntil(State::CONNECTED, 60000), "device has reconnected"))
+            return false;
+
+        device.runFor(2000);
+
+        auto statistics = server.getStatistics();
+
+        return check(statistics.connections == 2, "device has opened a new connection") &&
+               check(statistics.webSocketUpgrades == 2, "new connection has been upgraded to WebSocket");
+    }
+
+    // a CBOR host answers CBOR requests in CBOR and the rest in JSON. Only the former tell, whether it understands CBOR,
+    // so the device keeps sending CBOR through any number of JSON answers, also after a reconnect
+    bool serverAnswersCbor()
+    {
+        DeviceStatusServer server(FaultInjection(), true, true);
+
+        SimulatedDevice device("ScenarioDevice", makeConfiguration(false, WireFormat::CBOR), makeNetwork(server), "02:00:00:00:00:01");
+
+        if (!check(device.runUntil(State::CONNECTED, 60000), "device has connected"))
+            return false;
+
+        device.runFor(10000);
+
+        auto before = server.getStatistics();
+
+        // polls have no body: CBOR answers beyond the CBOR requests are theirs
+        if (!check(before.cborRequests > 0, "device has sent CBOR") ||
+            !check(before.cborResponses > before.cborRequests, "server has answered the polls in CBOR"))
+            return false;
+
+        device.dropServerConnection();
+
+        if (!check(device.runUntil(State::CONNECTED, 60000), "device has reconnected"))
+            return false;
+
+        device.runFor(2000);
+
+        auto after = server.getStatistics();
+
+        return check(after.cborRequests > before.cborRequests, "device still sends CBOR after the reconnect") &&
+               check(after.badRequests == 0, "server has understood every request");
+    }
+
+    // the platform reports link changes and arriving data instead of having them polled: the device reads answers
+    // only when told they are there, and notices a dropped connection or a lost network only when told so
+    bool readinessNotifications()
+    {
+        DeviceStatusServer server;
+
+        SimulatedDevice device("ScenarioDevice", makeConfiguration(false, WireFormat::JSON), makeNetwork(server), "02:00:00:00:00:01");
+
+        device.setReadinessNotifications(true);
+
+        if (!check(device.runUntil(State::CONNECTED, 60000), "device has connected"))
+            return false;
+
+        auto received = device.getStatistics().httpMessagesReceived;
+
+        device.runFor(10000);
+
+        if (!check(device.getState() == State::CONNECTED, "device has stayed connected") ||
+            !check(device.getStatistics().httpMessagesReceived > received + 1, "device keeps reading the answers to its polls"))
+            return false;
+
+        device.dropServerConnection();
+
+        if (!check(leavesConnected(device, 1000), "device has noticed the dropped connection") ||
+            !check(device.runUntil(State::CONNECTED, 60000), "device has reconnected after the dropped connection") ||
+            !check(server.getStatistics().connections == 2, "device has opened a new connection"))
+            return false;
+
+        auto &accessPoint = device.getNetwork().getAccessPoints().front();
+
+        accessPoint.inRange = false;
+
+        if (!check(leavesConnected(device, 1000), "device has noticed the lost network"))
+            return false;
+
+        accessPoint.inRange = true;
+
+        return check(device.runUntil(State::CONNECTED, 60000), "device has reconnected after the network has come back");
+    }
+
+    // changes within the flush window go out together in deviceParametersChanged. A batch, which has filled up,
+    // doesn't wait for the window to end
+    bool parameterChangesBatched()
+    {
+        DeviceStatusServer server;
+
+        ApplicationDevice device("ScenarioDevice", makeConfiguration(false, WireFormat::JSON, 500, 4), makeNetwork(server), "02:00:00:00:00:01");
+
+        if (!check(device.runUntil(State::CONNECTED, 60000), "device has connected"))
+            return false;
+
+        const std::vector<std::string> names = {"Light_1", "Light_2", "Light_3", "Light_4", "Light_5", "Light_6"};
+
+        for (const auto &name : names)
+        {
+            if (!check(device.addParam(DeviceParameter(name, DeviceParamType::TEXTBOX, false, "off")), "parameter has been added"))
+                return false;
+        }
+
+        device.runFor(2000);
+
+        auto before = server.getStatistics();
+
+        for (const auto &name : names)
+            device.setParamValue(name, "on");
+
+        device.runFor(100);
+
+        if (!check(server.getStatistics().parameterUpdates - before.parameterUpdates == 4, "full batch has gone out before the window has ended"))
+            return false;
+
+        device.runFor(1000);
+
+        auto after = server.getStatistics();
+
+        // polls go on meanwhile
+        auto eventRequests = (after.requests - after.statusRequests) - (before.requests - before.statusRequests);
+
+        return check(after.parameterUpdates - before.parameterUpdates == names.size(), "rest has gone out once the window has ended") &&
+               check(eventRequests == 2, "changes have been reported in two requests") &&
+               check(after.badRequests == 0, "server has understood every request");
+    }
+
+    // HTTP framing
+
+    struct ExpectedResponse
+    {
+        unsigned short status;
+        const char    *body;
+    };
+
+    // 100 Continue, Content-Length, chunked with extensions and a trailer, 204 and 304 without a body even with
+    // Content-Length, and an error with a body. Pipelined, they make up one stream
+    const std::string PIPELINED_RESPONSES =
+        "HTTP/1.1 100 Continue\r\n"
+        "\r\n"
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: application/json\r\n"
+        "Content-Length: 5\r\n"
+        "\r\n"
+        "hello"
+        "HTTP/1.1 200 OK\r\n"
+        "Transfer-Encoding: chunked\r\n"
+        "\r\n"
+        "4;name=value\r\n"
+        "Wiki\r\n"
+        "5\r\n"
+        "pedia\r\n"
+        "0\r\n"
+        "X-Trailer: ignored\r\n"
+        "\r\n"
+        "HTTP/1.1 204 No Content\r\n"
+        "Content-Length: 10\r\n"
+        "\r\n"
+        "HTTP/1.1 304 Not Modified\r\n"
+        "\r\n"
+        "HTTP/1.1 404 Not Found\r\n"
+        "Content-Length: 2\r\n"
+        "\r\n"
+        "no";
+
+    const std::vector<ExpectedResponse> PIPELINED_EXPECTED =
+    {
+        {100, ""},
+        {200, "hello"},
+        {200, "Wikipedia"},
+        {204, ""},
+        {304, ""},
+        {404, "no"}
+    };
+
+    bool parsesAs(const std::vector<std::string> &pieces, const std::vector<ExpectedResponse> &expected)
+    {
+        HttpResponseParser parser;
+        HttpResponse       response;
+        size_t             parsed = 0;
+
+        for (const auto &piece : pieces)
+        {
+            parser.feed(piece);
+
+            while (parser.next(response))
+            {
+                if ( (parsed >= expected.size()) || (response.status != expected[parsed].status) || (response.body != expected[parsed].body) )
+                    return false;
+
+                parsed++;
+            }
+        }
+
+        return !parser.hasProtocolError() && (parsed == expected.size());
+    }
+
+    // every split point, CR / LF split included, must give the same responses in the same order
+    bool httpFramingAnySplit()
+    {
+        if (!check(parsesAs({PIPELINED_RESPONSES}, PIPELINED_EXPECTED), "pipelined responses in one piece"))
+            return false;
+
+        for (size_t split = 1; split < PIPELINED_RESPONSES.size(); split++)
+        {
+            if (!parsesAs({PIPELINED_RESPONSES.substr(0, split), PIPELINED_RESPONSES.substr(split)}, PIPELINED_EXPECTED))
+            {
+                std::cout << "  failed at offset " << split << "\n";
+
+                return check(false, "pipelined responses in two pieces");
+            }
+        }
+
+        std::vector<std::string> bytes;
+
+        for (const auto &c : PIPELINED_RESPONSES)
+            bytes.push_back(std::string(1, c));
+
+        return check(parsesAs(bytes, PIPELINED_EXPECTED), "pipelined responses byte by byte");
+    }
+
+    // whatever follows 101 belongs to the WebSocket, also when it has arrived in the same piece
+    bool httpFramingRemainderAfterUpgrade()
+    {
+        const std::string upgrade = "HTTP/1.1 101 Switching Protocols\r\n"
+                                    "Upgrade: websocket\r\n"
+                                    "\r\n";
+        const std::string frames  = std::string("\x81\x02hi\x82\x01", 6) + std::string(1, '\0');
+        const std::string stream  = upgrade + frames;
+
+        for (size_t split = 1; split < stream.size(); split++)
+        {
+            HttpResponseParser parser;
+            HttpResponse       response;
+            std::string        remainder;
+
+            parser.feed(stream.substr(0, split));
+
+            auto upgraded = parser.next(response);
+
+            if (upgraded)
+                remainder = parser.takeRemainder() + stream.substr(split);
+            else
+            {
+                parser.feed(stream.substr(split));
+
+                upgraded  = parser.next(response);
+                remainder = parser.takeRemainder();
+            }
+
+            if (!upgraded || (response.status != 101) || (remainder != frames))
+            {
+                std::cout << "  failed at offset " << split << "\n";
+
+                return check(false, "frames after 101 are left for the WebSocket");
+            }
+        }
+
+        return true;
+    }
+
+    bool httpFramingInvalidChunkSize()
+    {
+        for (const auto &sizeLine : {"zz", "", "-5", "0x5", "+5", "5zz"})
+        {
+            HttpResponseParser parser;
+            HttpResponse       response;
+
+            parser.feed(std::string("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n") + sizeLine + "\r\nhello\r\n0\r\n\r\n");
+
+            if (parser.next(response) || !parser.hasProtocolError())
+            {
+                std::cout << "  chunk size line '" << sizeLine << "'\n";
+
+                return check(false, "invalid chunk size is a protocol error");
+            }
+        }
+
+        return check(parsesAs({"HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n5 ;ext\r\nhello\r\nA\r\n0123456789\r\n0\r\n\r\n"}, {{200, "hello0123456789"}}),
+                     "chunk sizes with whitespace before extensions, and upper case hex");
+    }
+
+    // outbound queue
+
+    bool queuedAt(const OutboundQueue &queue, const size_t &position, const OutboundKind::Values &kind, const ParamHandle &param)
+    {
+        OutboundKind::Values queuedKind;
+        ParamHandle          queuedParam;
+
+        return queue.peek(position, queuedKind, queuedParam) && (queuedKind == kind) && (queuedParam == param);
+    }
+
+    // registration first, then parameter events, then polls; FIFO within the same priority. A change of a parameter,
+    // whose parameterAdded is still queued, and a second poll are not queued again
+    bool outboundQueueOrder()
+    {
+        OutboundQueue queue;
+
+        queue.push(OutboundKind::STATUS_POLL);
+        queue.push(OutboundKind::PARAMETER_CHANGED, 1);
+        queue.push(OutboundKind::PARAMETER_ADDED, 2);
+        queue.push(OutboundKind::DEVICE_ONLINE);
+        queue.push(OutboundKind::PARAMETER_CHANGED, 3);
+
+        if (!check(queuedAt(queue, 0, OutboundKind::DEVICE_ONLINE, INVALID_PARAM_HANDLE) &&
+                   queuedAt(queue, 1, OutboundKind::PARAMETER_CHANGED, 1) &&
+                   queuedAt(queue, 2, OutboundKind::PARAMETER_ADDED, 2) &&
+                   queuedAt(queue, 3, OutboundKind::PARAMETER_CHANGED, 3) &&
+                   queuedAt(queue, 4, OutboundKind::STATUS_POLL, INVALID_PARAM_HANDLE) &&
+                   !queuedAt(queue, 5, OutboundKind::STATUS_POLL, INVALID_PARAM_HANDLE), "entries are in priority order, FIFO within a priority"))
+            return false;
+
+        queue.push(OutboundKind::PARAMETER_CHANGED, 2);
+        queue.push(OutboundKind::STATUS_POLL);
+
+        if (!check(queue.getStatistics().depth == 5, "queued parameterAdded and poll are not queued again") ||
+            !check(queue.getStatistics().superseded == 2, "merged pushes are counted as superseded") ||
+            !check(queue.count(OutboundKind::PARAMETER_CHANGED) == 2, "change of an added parameter is merged into parameterAdded"))
+            return false;
+
+        queue.pop(2);
+
+        if (!check(queuedAt(queue, 0, OutboundKind::PARAMETER_ADDED, 2), "pop takes entries from the front"))
+            return false;
+
+        queue.supersede(OutboundKind::PARAMETER_CHANGED);
+
+        return check(queue.count(OutboundKind::PARAMETER_CHANGED) == 0, "supersede removes every entry of the kind") &&
+               check(queue.getStatistics().superseded == 3, "superseded entries are counted") &&
+               check(queuedAt(queue, 0, OutboundKind::PARAMETER_ADDED, 2) && queuedAt(queue, 1, OutboundKind::STATUS_POLL, INVALID_PARAM_HANDLE),
+                     "supersede leaves the other entries in order");
+    }
+
+    // a full queue makes room for a push by evicting the newest entry of the lowest priority below it; a push of the
+    // same or lower priority than everything queued is refused, and canPush() says so beforehand
+    bool outboundQueueFull()
+    {
+        OutboundQueue queue;
+
+        queue.push(OutboundKind::STATUS_POLL);
+
+        for (ParamHandle param = 0; param < MAX_OUTBOUND_MESSAGES - 1; param++)
+            queue.push(OutboundKind::PARAMETER_CHANGED, param);
+
+        if (!check(queue.canPush(OutboundKind::PARAMETER_CHANGED, 100) && queue.push(OutboundKind::PARAMETER_CHANGED, 100), "parameter event evicts the poll") ||
+            !check(queue.count(OutboundKind::STATUS_POLL) == 0, "lowest priority goes first, even though it's the oldest"))
+            return false;
+
+        if (!check(queue.push(OutboundKind::DEVICE_ONLINE), "deviceOnline evicts a parameter event"))
+            return false;
+
+        for (size_t position = 0; position < MAX_OUTBOUND_MESSAGES; position++)
+        {
+            if (queuedAt(queue, position, OutboundKind::PARAMETER_CHANGED, 100))
+                return check(false, "newest entry of the lowest priority is evicted");
+        }
+
+        if (!check(queuedAt(queue, 0, OutboundKind::DEVICE_ONLINE, INVALID_PARAM_HANDLE) &&
+                   queuedAt(queue, MAX_OUTBOUND_MESSAGES - 1, OutboundKind::PARAMETER_CHANGED, MAX_OUTBOUND_MESSAGES - 2), "older entries are kept in order") ||
+            !check(queue.getStatistics().evicted == 2, "evictions are counted"))
+            return false;
+
+        if (!check(!queue.canPush(OutboundKind::PARAMETER_CHANGED, 101) && !queue.push(OutboundKind::PARAMETER_CHANGED, 101), "push of the same priority is refused") ||
+            !check(!queue.canPush(OutboundKind::STATUS_POLL) && !queue.push(OutboundKind::STATUS_POLL), "push of a lower priority is refused") ||
+            !check(queue.getStatistics().rejected == 2, "refused pushes are counted"))
+            return false;
+
+        return check(queue.canPush(OutboundKind::PARAMETER_CHANGED, 5) && queue.push(OutboundKind::PARAMETER_CHANGED, 5), "push, which merges, is taken also when full") &&
+               check( (queue.getStatistics().depth == MAX_OUTBOUND_MESSAGES) && (queue.getStatistics().maxDepth == MAX_OUTBOUND_MESSAGES), "queue never grows");
+    }
+    // retry scheduler. Its timer isn't run: onTimer() is called as if the tick has expired
+
+    const unsigned int RETRY_BASE = 100;
+    const unsigned int RETRY_CAP  = 1000;
+    const unsigned int RETRY_TICK = 10;
+
+    // the n-th retry waits for anything in [0, min(cap, base * 2^n)], over the whole range, and a success starts over from base
+    bool retrySchedulerBackoff()
+    {
+        EventSystem  eventSystem;
+        unsigned int now = 0;
+        TimerManager timerManager(&eventSystem, eventSystem.createEvent(), [&now]() -> unsigned int { return now; });
+
+        unsigned int lowest  = RETRY_CAP;
+        unsigned int highest = 0;
+
+        for (uint32_t seed = 1; seed <= 200; seed++)
+        {
+            RetryScheduler scheduler(RETRY_BASE, RETRY_CAP, RETRY_TICK, [&now]() -> unsigned int { return now; });
+
+            scheduler.init(&timerManager, seed);
+
+            for (unsigned char failures = 0; failures < 8; failures++)
+            {
+                auto bound = std::min(RETRY_CAP, RETRY_BASE << failures);
+                auto delay = scheduler.schedule(RetryKind::RECONNECT);
+
+                if ( (delay > bound) || (scheduler.getStatistics().currentBackoff != std::min(RETRY_CAP, RETRY_BASE << (failures + 1))) )
+                {
+                    std::cout << "  seed " << seed << ", retry " << static_cast<unsigned int>(failures) << ": delay " << delay << "\n";
+
+                    return check(false, "delay is within the backoff, which doubles up to the cap");
+                }
+
+                // the last one is capped
+                if (failures == 7)
+                {
+                    lowest  = std::min(lowest, delay);
+                    highest = std::max(highest, delay);
+                }
+
+                scheduler.cancel();
+            }
+
+            scheduler.succeeded();
+
+            if ( (scheduler.getStatistics().consecutiveFailures != 0) || (scheduler.getStatistics().currentBackoff != RETRY_BASE) ||
+                 (scheduler.schedule(RetryKind::RECONNECT) > RETRY_BASE) )
+                return check(false, "success starts the backoff over from base");
+        }
+
+        if (!check( (lowest < RETRY_CAP / 4) && (highest > RETRY_CAP * 3 / 4), "delays spread over the whole backoff"))
+            return false;
+
+        RetryScheduler disabled(0, RETRY_CAP, RETRY_TICK, [&now]() -> unsigned int { return now; });
+
+        disabled.init(&timerManager, 1);
+
+        return check( (disabled.schedule(RetryKind::RECONNECT) == 0) && !disabled.isPending(), "base 0 retries right away");
+    }
+
+    // the retry is due once its delay has passed, also when the clock wraps around meanwhile
+    bool retrySchedulerClockWrap()
+    {
+        EventSystem  eventSystem;
+        unsigned int now = UINT_MAX - 5;
+        TimerManager timerManager(&eventSystem, eventSystem.createEvent(), [&now]() -> unsigned int { return now; });
+
+        RetryScheduler scheduler(RETRY_BASE, RETRY_CAP, RETRY_TICK, [&now]() -> unsigned int { return now; });
+
+        scheduler.init(&timerManager, 1);
+
+        // a delay, which ends past the wrap
+        unsigned int delay = 0;
+
+        while (delay <= 5)
+        {
+            scheduler.cancel();
+            delay = scheduler.schedule(RetryKind::SERVER_CONNECTION);
+        }
+
+        if (!check(!scheduler.onTimer() && scheduler.isPending(), "retry isn't due right away"))
+            return false;
+
+        now += delay - 1;
+
+        if (!check(!scheduler.onTimer() && scheduler.isPending(), "retry isn't due before its delay has passed"))
+            return false;
+
+        now += 1;
+
+        return check(scheduler.onTimer() && !scheduler.isPending(), "retry is due once its delay has passed");
+    }
+    // server selector
+
+    // hosts of a new round in the order they're tried. Going past the last one starts over with the first
+    std::vector<std::string> roundOrder(ServerSelector &selector, const size_t &hosts)
+    {
+        std::vector<std::string> order;
+
+        selector.startRound();
+
+        for (size_t i = 0; i < hosts; i++)
+        {
+            order.push_back(selector.current().host);
+            selector.next();
+        }
+
+        if (selector.current().host != order.front())
+            order.push_back("no wrap around");
+
+        return order;
+    }
+
+    void moveTo(ServerSelector &selector, const std::string &host)
+    {
+        selector.startRound();
+
+        while (selector.current().host != host)
+            selector.next();
+    }
+
+    // measured hosts by connect and response time, then the ones never connected, failing ones last; an answered
+    // request makes a failing host healthy again
+    bool serverSelectorRanking()
+    {
+        ServerSelector selector({{"10.0.0.1", 8080}, {"10.0.0.2", 8080}, {"10.0.0.3", 8080}, {"10.0.0.4", 8080}});
+
+        if (!check(roundOrder(selector, 4) == std::vector<std::string>({"10.0.0.1", "10.0.0.2", "10.0.0.3", "10.0.0.4"}), "unknown hosts are tried in the given order"))
+            return false;
+
+        moveTo(selector, "10.0.0.1");
+        selector.reportConnected(300);
+
+        moveTo(selector, "10.0.0.2");
+        selector.reportConnected(100);
+        selector.reportResponseTime(50);
+
+        moveTo(selector, "10.0.0.3");
+        selector.reportFailure();
+
+        if (!check(roundOrder(selector, 4) == std::vector<std::string>({"10.0.0.2", "10.0.0.1", "10.0.0.4", "10.0.0.3"}), "fastest first, unmeasured next, failing last"))
+            return false;
+
+        // the fastest one fails over to the others
+        moveTo(selector, "10.0.0.2");
+        selector.reportFailure();
+        selector.reportFailure();
+
+        if (!check(roundOrder(selector, 4) == std::vector<std::string>({"10.0.0.1", "10.0.0.4", "10.0.0.3", "10.0.0.2"}), "host failing most often goes last"))
+            return false;
+
+        moveTo(selector, "10.0.0.3");
+        selector.reportConnected(50);
+        selector.reportSuccess();
+
+        return check(roundOrder(selector, 4) == std::vector<std::string>({"10.0.0.3", "10.0.0.1", "10.0.0.4", "10.0.0.2"}), "answered request clears the failures");
+    }
+}
+
+int main()
+{
+    const std::vector<Scenario> scenarios =
+    {
+        {"server closes WebSocket",   serverClosesWebSocket},
+        {"server answers CBOR",       serverAnswersCbor},
+        {"readiness notifications",   readinessNotifications},
+        {"parameter changes batched", parameterChangesBatched},
+        {"HTTP framing: any split",   httpFramingAnySplit},
+        {"HTTP framing: after 101",   httpFramingRemainderAfterUpgrade},
+        {"HTTP framing: chunk size",  httpFramingInvalidChunkSize},
+        {"outbound queue: order",     outboundQueueOrder},
+        {"outbound queue: full",      outboundQueueFull},
+        {"retry scheduler: backoff",  retrySchedulerBackoff},
+        {"retry scheduler: wrap",     retrySchedulerClockWrap},
+        {"server selector: ranking",  serverSelectorRanking}
+    };
+
+    size_t failed = 0;
+
+    for (const auto &scenario : scenarios)
+    {
+        std::cout << scenario.name << "\n";
+
+        if (!scenario.run())
+            failed++;
+    }
+
+    std::cout << (scenarios.size() - failed) << " of " << scenarios.size() << " scenarios passed\n";
+
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,465 @@
+#include "SimulatedDevice.h"
+#include "AllocationCounter.h"
+#include <cstring>
+
+namespace Simulator_n
+{
+    SimulatedDevice::SimulatedDevice(const std::string &deviceName, const WifiConfiguration &configuration, const SimulatedNetwork &network, const std::string &macAddress, const unsigned int &seed)
+    : SmartHomeDevice(deviceName, configuration),
+      network(network),
+      macAddress(macAddress),
+      randomGenerator(seed),
+      debugPrintFunc(nullptr),
+      connectedAccessPoint(-1),
+      wifiStatus(WifiStatus::DISCONNECTED),
+      statistics(),
+      lastState(State::INITIAL),
+      disconnectedAt(0),
+      connectedAt(0),
+      halted(false),
+      asyncConnect(false),
+      connectingInBackground(false),
+      connectAttempt(0),
+      readinessNotifications(false),
+      notifiedWifiStatus(WifiStatus::DISCONNECTED),
+      notifiedConnectionOpen(false)
+    {
+    }
+
+    SimulatedDevice::~SimulatedDevice()
+    {
+        if (connection != nullptr)
+            connection->disconnect();
+    }
+
+    void SimulatedDevice::step(const unsigned int &milliseconds)
+    {
+        if (halted)
+            return;
+
+        clock.advance(milliseconds);
+
+        runScript();
+
+        if (connection != nullptr)
+            connection->tick();
+
+        if (readinessNotifications)
+            raiseNotifications();
+
+        auto steadyState = (lastState == State::CONNECTED) && (clock.now() - connectedAt >= STEADY_STATE_WARMUP);
+        auto messages    = statistics.httpMessagesSent + statistics.httpMessagesReceived;
+
+        unsigned long allocations = 0;
+
+        {
+            AllocationCounter counter(steadyState ? &allocations : nullptr);
+
+            run();
+        }
+
+        updateStatistics();
+
+        // a step, which has left CONNECTED, went through the reconnect path; that's not the steady state
+        if (steadyState && (lastState == State::CONNECTED))
+        {
+            statistics.steadyStateAllocations += allocations;
+            statistics.steadyStateMessages    += statistics.httpMessagesSent + statistics.httpMessagesReceived - messages;
+        }
+    }
+
+    void SimulatedDevice::runFor(const unsigned int &milliseconds, const unsigned int &tick)
+    {
+        auto until = clock.now() + milliseconds;
+
+        while (!halted && (clock.now() < until))
+            step(tick);
+    }
+
+    bool SimulatedDevice::runUntil(const State::Values &state, const unsigned int &timeout, const unsigned int &tick)
+    {
+        auto until = clock.now() + timeout;
+
+        while (!halted && (clock.now() < until))
+        {
+            step(tick);
+
+            if (getState() == state)
+                return true;
+        }
+
+        return false;
+    }
+
+    void SimulatedDevice::schedule(const unsigned int &at, SimulationAction action)
+    {
+        script.insert(std::make_pair(at, action));
+    }
+
+    void SimulatedDevice::dropServerConnection()
+    {
+        if (connection != nullptr)
+            connection->close();
+    }
+
+    void SimulatedDevice::setDebugPrintFunc(DebugPrintFunc debugPrintFunc)
+    {
+        this->debugPrintFunc = debugPrintFunc;
+    }
+
+    void SimulatedDevice::setAsyncConnect(const bool &asyncConnect)
+    {
+        this->asyncConnect = asyncConnect;
+    }
+
+    void SimulatedDevice::setReadinessNotifications(const bool &readinessNotifications)
+    {
+        this->readinessNotifications = readinessNotifications;
+    }
+
+    VirtualClock &SimulatedDevice::getClock()
+    {
+        return clock;
+    }
+
+    SimulatedNetwork &SimulatedDevice::getNetwork()
+    {
+        return network;
+    }
+
+    const SimulationStatistics &SimulatedDevice::getStatistics() const
+    {
+        return statistics;
+    }
+
+    bool SimulatedDevice::isHalted() const
+    {
+        return halted;
+    }
+
+    void SimulatedDevice::runScript()
+    {
+        while (!script.empty() && (script.begin()->first <= clock.now()))
+        {
+            auto action = script.begin()->second;
+
+            script.erase(script.begin());
+
+            action(*this);
+        }
+    }
+
+    void SimulatedDevice::updateStatistics()
+    {
+        auto state = getState();
+
+        if (state != lastState)
+        {
+            if (state == State::CONNECTED)
+            {
+                connectedAt = clock.now();
+
+                if (statistics.timeToConnected == 0)
+                    statistics.timeToConnected = clock.now();
+                else
+                    statistics.reconnectLatencies.push_back(clock.now() - disconnectedAt);
+            }
+            else if (lastState == State::CONNECTED)
+                disconnectedAt = clock.now();
+
+            lastState = state;
+        }
+    }
+
+    void SimulatedDevice::raiseNotifications()
+    {
+        auto wifiStatus = getWifiStatus();
+
+        if (wifiStatus != notifiedWifiStatus)
+        {
+            notifiedWifiStatus = wifiStatus;
+
+            notifyWifiStatusChanged();
+        }
+
+        auto connectionOpen = (connection != nullptr) && connection->isOpen();
+
+        // only a connection, which was open, can go down
+        if (notifiedConnectionOpen && !connectionOpen)
+            notifyServerDisconnected();
+
+        notifiedConnectionOpen = connectionOpen;
+
+        // raised as long as anything is left unread, so data arriving after a read isn't missed
+        if (connectionOpen && connection->dataAvailable())
+            notifyDataReady();
+    }
+
+    // platform interface
+
+    std::string SimulatedDevice::getMacAddress()
+    {
+        return macAddress;
+    }
+
+    void SimulatedDevice::connectToWiFi(const std::string &ssid, const std::string &password)
+    {
+        statistics.wifiConnectionAttempts++;
+
+        disconnectFromWiFi();
+
+        auto accessPoint = network.findAccessPoint(ssid);
+
+        if (accessPoint == nullptr)
+        {
+            wifiStatus = WifiStatus::NO_SSID_AVAILABLE;
+            return;
+        }
+
+        // association blocks the caller, as it would on the real radio. In the background the time has already passed
+        if (!connectingInBackground)
+            clock.advance(accessPoint->associationTime);
+
+        auto failed = std::uniform_int_distribution<unsigned int>(0, 99)(randomGenerator) < accessPoint->failureRate;
+
+        if (failed || (!accessPoint->isOpen && (accessPoint->password != password)))
+            wifiStatus = WifiStatus::CONNECT_FAILED;
+        else
+        {
+            connectedAccessPoint = static_cast<int>(accessPoint - network.getAccessPoints().data());
+            wifiStatus = WifiStatus::CONNECTED;
+        }
+    }
+
+    void SimulatedDevice::connectToWiFiOnChannel(const std::string &ssid, const std::string &password, const int &channel)
+    {
+        auto accessPoint = network.findAccessPoint(ssid);
+
+        // the radio listens only on the given channel: an AP, which has moved to another one, is not found
+        if ( (accessPoint != nullptr) && (accessPoint->channel != channel) )
+        {
+            statistics.wifiConnectionAttempts++;
+
+            disconnectFromWiFi();
+
+            wifiStatus = WifiStatus::NO_SSID_AVAILABLE;
+            return;
+        }
+
+        connectToWiFi(ssid, password);
+    }
+
+    void SimulatedDevice::disconnectFromWiFi()
+    {
+        disconnectFromServer();
+
+        connectedAccessPoint = -1;
+        wifiStatus = WifiStatus::DISCONNECTED;
+    }
+
+    void SimulatedDevice::scanForNetworks(std::function<void(int)> scanCallback)
+    {
+        statistics.networkScans++;
+
+        scanResults.clear();
+
+        for (const auto &accessPoint : network.getAccessPoints())
+        {
+            if (accessPoint.inRange)
+            {
+                NetworkInfo networkInfo;
+                memset(&networkInfo, 0, sizeof(networkInfo));
+
+                strncpy(networkInfo.ssid, accessPoint.ssid.c_str(), sizeof(networkInfo.ssid) - 1);
+                networkInfo.channel = accessPoint.channel;
+                networkInfo.rssi    = accessPoint.rssi;
+                networkInfo.isOpen  = accessPoint.isOpen;
+
+                scanResults.push_back(networkInfo);
+            }
+        }
+
+        clock.advance(network.getScanDuration());
+
+        if (scanCallback != nullptr)
+            scanCallback(static_cast<int>(scanResults.size()));
+    }
+
+    NetworkInfo SimulatedDevice::getInfoForNetwork(const byte &networkNumber)
+    {
+        if (networkNumber < scanResults.size())
+            return scanResults[networkNumber];
+
+        NetworkInfo networkInfo;
+        memset(&networkInfo, 0, sizeof(networkInfo));
+
+        return networkInfo;
+    }
+
+    void SimulatedDevice::connectToServer(const std::string &host, const unsigned short &port)
+    {
+        statistics.serverConnectionAttempts++;
+
+        disconnectFromServer();
+
+        if (getWifiStatus() != WifiStatus::CONNECTED)
+            return;
+
+        auto simulatedHost = network.findHost(host, port);
+
+        if ( (simulatedHost == nullptr) || !simulatedHost->reachable )
+        {
+            if (!connectingInBackground)
+                clock.advance(network.getUnreachableHostTimeout());
+            return;
+        }
+
+        if (!connectingInBackground)
+            clock.advance(simulatedHost->connectTime);
+
+        connection.reset(new SimulatedConnection(clock, simulatedHost->server));
+
+        if (simulatedHost->server != nullptr)
+            simulatedHost->server->onConnect(*connection);
+    }
+
+    void SimulatedDevice::disconnectFromServer()
+    {
+        connectAttempt++;
+
+        if (connection != nullptr)
+        {
+            connection->disconnect();
+            connection.reset();
+        }
+    }
+
+    bool SimulatedDevice::dataAvailable()
+    {
+        return connectedToServer() && connection->dataAvailable();
+    }
+
+    bool SimulatedDevice::connectedToServer()
+    {
+        return (getWifiStatus() == WifiStatus::CONNECTED) && (connection != nullptr) && connection->isOpen();
+    }
+
+    std::string SimulatedDevice::readData()
+    {
+        AllocationCounter notCounted(nullptr);
+
+        if (!connectedToServer())
+            return std::string();
+
+        statistics.httpMessagesReceived++;
+
+        return connection->read();
+    }
+
+    void SimulatedDevice::sendData(const std::string &textData)
+    {
+        AllocationCounter notCounted(nullptr);
+
+        if (connectedToServer())
+        {
+            statistics.httpMessagesSent++;
+
+            connection->send(textData);
+        }
+    }
+
+    WifiStatus::Values SimulatedDevice::getWifiStatus()
+    {
+        if (connectedAccessPoint >= 0)
+        {
+            const auto &accessPoint = network.getAccessPoints()[connectedAccessPoint];
+
+            if (!accessPoint.inRange)
+            {
+                connectedAccessPoint = -1;
+                wifiStatus = WifiStatus::CONNECTION_LOST;
+            }
+        }
+
+        return wifiStatus;
+    }
+
+    unsigned int SimulatedDevice::getCurrentTime()
+    {
+        return clock.now();
+    }
+
+    void SimulatedDevice::reset()
+    {
+        statistics.resets++;
+
+        disconnectFromWiFi();
+
+        halted = true;
+    }
+
+    void SimulatedDevice::debugPrint(const std::string &debugMessage)
+    {
+        AllocationCounter notCounted(nullptr);
+
+        if (debugPrintFunc != nullptr)
+            debugPrintFunc(debugMessage);
+    }
+
+    bool SimulatedDevice::asyncConnectSupported()
+    {
+        return asyncConnect;
+    }
+
+    bool SimulatedDevice::readinessNotificationsSupported()
+    {
+        return readinessNotifications;
+    }
+
+    void SimulatedDevice::startConnectToWiFi(const std::string &ssid, const std::string &password, const int &channel)
+    {
+        disconnectFromWiFi();
+
+        auto accessPoint = network.findAccessPoint(ssid);
+        auto duration    = accessPoint != nullptr ? accessPoint->associationTime : 0;
+        auto attempt     = connectAttempt;
+
+        // the association is done once its time has passed, the device loop runs meanwhile
+        schedule(clock.now() + duration, [ssid, password, channel, attempt](SimulatedDevice &device)
+        {
+            if (device.connectAttempt != attempt)
+                return;
+
+            device.connectingInBackground = true;
+            device.connectToWiFiOnChannel(ssid, password, channel);
+            device.connectingInBackground = false;
+
+            device.notifyWifiConnectCompleted(device.wifiStatus == WifiStatus::CONNECTED);
+        });
+    }
+
+    void SimulatedDevice::startConnectToServer(const std::string &host, const unsigned short &port)
+    {
+        disconnectFromServer();
+
+        auto simulatedHost = network.findHost(host, port);
+        auto duration      = 0u;
+
+        if (getWifiStatus() == WifiStatus::CONNECTED)
+            duration = ( (simulatedHost == nullptr) || !simulatedHost->reachable ) ? network.getUnreachableHostTimeout() : simulatedHost->connectTime;
+
+        auto attempt = connectAttempt;
+
+        schedule(clock.now() + duration, [host, port, attempt](SimulatedDevice &device)
+        {
+            if (device.connectAttempt != attempt)
+                return;
+
+            device.connectingInBackground = true;
+            device.connectToServer(host, port);
+            device.connectingInBackground = false;
+
+            device.notifyServerConnectCompleted(device.connectedToServer());
+        });
+    }
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "SmartHomeDevice.h"
+#include "SimulatedNetwork.h"
+#include "VirtualClock.h"
+#include <functional>
+#include <map>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace Simulator_n
+{
+    using namespace SmartHomeDevice_n;
+
+    class SimulatedDevice;
+
+    using SimulationAction = std::function<void(SimulatedDevice&)>;
+
+    struct SimulationStatistics
+    {
+        unsigned int              timeToConnected;       // virtual ms from start to first CONNECTED, 0 if not reached yet
+        std::vector<unsigned int> reconnectLatencies;    // virtual ms from leaving CONNECTED to reaching it again
+        unsigned long             networkScans;
+        unsigned long             wifiConnectionAttempts;
+        unsigned long             serverConnectionAttempts;
+        unsigned long             httpMessagesSent;
+        unsigned long             httpMessagesReceived;
+        unsigned long             resets;
+        unsigned long             steadyStateAllocations;  // by the device loop, CONNECTED for longer than STEADY_STATE_WARMUP. Platform calls excluded
+        unsigned long             steadyStateMessages;     // sent and received meanwhile
+    };
+
+    const unsigned int STEADY_STATE_WARMUP = 5000;   // virtual ms after reaching CONNECTED, for the buffers to grow to their working size
+
+    class SimulatedDevice : public SmartHomeDevice
+    {
+    private:
+        VirtualClock                         clock;
+        SimulatedNetwork                     network;
+        std::string                          macAddress;
+        std::mt19937                         randomGenerator;
+        DebugPrintFunc                       debugPrintFunc;
+
+        std::vector<NetworkInfo>             scanResults;
+        int                                  connectedAccessPoint;
+        WifiStatus::Values                   wifiStatus;
+        std::unique_ptr<SimulatedConnection> connection;
+
+        std::multimap<unsigned int, SimulationAction> script;
+
+        SimulationStatistics                 statistics;
+        State::Values                        lastState;
+        unsigned int                         disconnectedAt;
+        unsigned int                         connectedAt;
+        bool                                 halted;
+
+        bool                                 asyncConnect;
+        bool                                 connectingInBackground;  // the clock isn't advanced while connecting
+        unsigned int                         connectAttempt;          // changes on disconnect, which cancels attempts in flight
+
+        bool                                 readinessNotifications;
+        WifiStatus::Values                   notifiedWifiStatus;      // as the device has last been told
+        bool                                 notifiedConnectionOpen;
+
+        void runScript();
+        void updateStatistics();
+        void raiseNotifications();
+
+    protected:
+        std::string         getMacAddress() override;
+        void                connectToWiFi(const std::string &ssid, const std::string &password) override;
+        void                connectToWiFiOnChannel(const std::string &ssid, const std::string &password, const int &channel) override;
+        void                disconnectFromWiFi() override;
+        void                scanForNetworks(std::function<void(int)> scanCallback) override;
+        NetworkInfo         getInfoForNetwork(const byte &networkNumber) override;
+        void                connectToServer(const std::string &host, const unsigned short &port) override;
+        void                disconnectFromServer() override;
+        bool                dataAvailable() override;
+        bool                connectedToServer() override;
+        std::string         readData() override;
+        void                sendData(const std::string &textData) override;
+        WifiStatus::Values  getWifiStatus() override;
+        unsigned int        getCurrentTime() override;
+        void                reset() override;
+        void                debugPrint(const std::string &debugMessage) override;
+
+        bool                asyncConnectSupported() override;
+        void                startConnectToWiFi(const std::string &ssid, const std::string &password, const int &channel) override;
+        void                startConnectToServer(const std::string &host, const unsigned short &port) override;
+
+        bool                readinessNotificationsSupported() override;
+
+    public:
+        SimulatedDevice(const std::string&, const WifiConfiguration&, const SimulatedNetwork&, const std::string&, const unsigned int &seed = 0);
+        ~SimulatedDevice() override;
+
+        // advances virtual time by the given amount of ms, and runs the device loop once
+        void step(const unsigned int&);
+
+        // runs the device loop for the given amount of virtual time. Returns early, if the device has requested a reset
+        void runFor(const unsigned int&, const unsigned int &tick = 10);
+
+        // runs the device loop until the given state is reached or the virtual timeout passes
+        bool runUntil(const State::Values&, const unsigned int &timeout, const unsigned int &tick = 10);
+
+        // schedules an action (e.g. access point going out of range, server dropping the connection) at the given virtual time
+        void schedule(const unsigned int&, SimulationAction);
+
+        void dropServerConnection();
+
+        void setDebugPrintFunc(DebugPrintFunc);
+
+        // connect in the background: association and TCP handshake times pass while the device loop keeps running.
+        // Has to be set before the device loop is started
+        void setAsyncConnect(const bool&);
+
+        // report link changes and arriving data through the notify methods, as a radio stack would from its interrupts,
+        // instead of having them polled. Has to be set before the device loop is started
+        void setReadinessNotifications(const bool&);
+
+        VirtualClock &getClock();
+        SimulatedNetwork &getNetwork();
+        const SimulationStatistics &getStatistics() const;
+        bool isHalted() const;
+    };
+}
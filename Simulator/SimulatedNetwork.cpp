@@ -0,0 +1,154 @@
+#include "SimulatedNetwork.h"
+
+namespace Simulator_n
+{
+    SimulatedConnection::SimulatedConnection(const VirtualClock &clock, SimulatedServer *server) : clock(clock), server(server), open(true) { }
+
+    unsigned int SimulatedConnection::now() const
+    {
+        return clock.now();
+    }
+
+    bool SimulatedConnection::isOpen() const
+    {
+        return open;
+    }
+
+    void SimulatedConnection::close()
+    {
+        open = false;
+    }
+
+    ConnectionContext *SimulatedConnection::getContext() const
+    {
+        return context.get();
+    }
+
+    void SimulatedConnection::setContext(ConnectionContext *context)
+    {
+        this->context.reset(context);
+    }
+
+    void SimulatedConnection::deliver(const std::string &data, const unsigned int &delay)
+    {
+        if (open && !data.empty())
+            inbound.push_back({clock.now() + delay, data});
+    }
+
+    bool SimulatedConnection::dataAvailable() const
+    {
+        return !inbound.empty() && (inbound.front().readyAt <= clock.now());
+    }
+
+    std::string SimulatedConnection::read()
+    {
+        std::string data;
+
+        // like a socket read: everything, which has arrived so far, in one piece
+        while (dataAvailable())
+        {
+            data += inbound.front().data;
+            inbound.pop_front();
+        }
+
+        return data;
+    }
+
+    void SimulatedConnection::send(const std::string &data)
+    {
+        if (open && (server != nullptr))
+            server->onData(*this, data);
+    }
+
+    void SimulatedConnection::tick()
+    {
+        if (open && (server != nullptr))
+            server->onTick(*this);
+    }
+
+    void SimulatedConnection::disconnect()
+    {
+        open = false;
+
+        // the server is notified even if it has closed the connection itself, so it can release its per-connection state
+        if (server != nullptr)
+        {
+            server->onDisconnect(*this);
+            server = nullptr;
+        }
+
+        inbound.clear();
+    }
+
+    SimulatedNetwork::SimulatedNetwork() : scanDuration(1500), unreachableHostTimeout(5000) { }
+
+    SimulatedNetwork &SimulatedNetwork::addAccessPoint(const SimulatedAccessPoint &accessPoint)
+    {
+        accessPoints.push_back(accessPoint);
+
+        return *this;
+    }
+
+    SimulatedNetwork &SimulatedNetwork::addHost(const SimulatedHost &host)
+    {
+        hosts.push_back(host);
+
+        return *this;
+    }
+
+    SimulatedNetwork &SimulatedNetwork::setScanDuration(const unsigned int &scanDuration)
+    {
+        this->scanDuration = scanDuration;
+
+        return *this;
+    }
+
+    SimulatedNetwork &SimulatedNetwork::setUnreachableHostTimeout(const unsigned int &unreachableHostTimeout)
+    {
+        this->unreachableHostTimeout = unreachableHostTimeout;
+
+        return *this;
+    }
+
+    std::vector<SimulatedAccessPoint> &SimulatedNetwork::getAccessPoints()
+    {
+        return accessPoints;
+    }
+
+    std::vector<SimulatedHost> &SimulatedNetwork::getHosts()
+    {
+        return hosts;
+    }
+
+    const unsigned int &SimulatedNetwork::getScanDuration() const
+    {
+        return scanDuration;
+    }
+
+    const unsigned int &SimulatedNetwork::getUnreachableHostTimeout() const
+    {
+        return unreachableHostTimeout;
+    }
+
+    SimulatedAccessPoint *SimulatedNetwork::findAccessPoint(const std::string &ssid)
+    {
+        for (auto &accessPoint : accessPoints)
+        {
+            if (accessPoint.inRange && (accessPoint.ssid == ssid))
+                return &accessPoint;
+        }
+
+        return nullptr;
+    }
+
+    SimulatedHost *SimulatedNetwork::findHost(const std::string &host, const unsigned short &port)
+    {
+        for (auto &simulatedHost : hosts)
+        {
+            if ( (simulatedHost.host == host) && (simulatedHost.port == port) )
+                return &simulatedHost;
+        }
+
+        return nullptr;
+    }
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "VirtualClock.h"
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+
+namespace Simulator_n
+{
+    class SimulatedConnection;
+
+    // application level peer, which is reachable through the simulated network
+    class SimulatedServer
+    {
+    public:
+        virtual ~SimulatedServer() = default;
+
+        virtual void onConnect(SimulatedConnection&) { }
+        virtual void onData(SimulatedConnection&, const std::string&) = 0;
+        virtual void onDisconnect(SimulatedConnection&) { }
+        virtual void onTick(SimulatedConnection&) { }      // called from the device loop, lets the server push data unprompted
+    };
+
+    // per-connection state, which a server attaches to the connection
+    struct ConnectionContext
+    {
+        virtual ~ConnectionContext() = default;
+    };
+
+    struct SimulatedAccessPoint
+    {
+        std::string  ssid;
+        std::string  password;
+        int          channel;
+        int          rssi;
+        bool         isOpen;
+        bool         inRange;
+        unsigned int associationTime;     // virtual ms, spent inside connectToWiFi
+        unsigned int failureRate;         // percent of association attempts, which fail
+    };
+
+    struct SimulatedHost
+    {
+        std::string      host;
+        unsigned short   port;
+        bool             reachable;
+        unsigned int     connectTime;     // virtual ms, spent inside connectToServer
+        SimulatedServer *server;
+    };
+
+    class SimulatedConnection
+    {
+    private:
+        struct Chunk
+        {
+            unsigned int readyAt;
+            std::string  data;
+        };
+
+        const VirtualClock                &clock;
+        SimulatedServer                   *server;
+        std::deque<Chunk>                  inbound;
+        std::unique_ptr<ConnectionContext> context;
+        bool                               open;
+
+    public:
+        SimulatedConnection(const VirtualClock&, SimulatedServer*);
+
+        unsigned int now() const;
+
+        bool isOpen() const;
+        void close();
+
+        ConnectionContext *getContext() const;
+        void setContext(ConnectionContext*);
+
+        // server side
+        void deliver(const std::string&, const unsigned int &delay = 0);
+
+        // device side
+        bool dataAvailable() const;
+        std::string read();
+        void send(const std::string&);
+        void tick();
+        void disconnect();
+    };
+
+    class SimulatedNetwork
+    {
+    private:
+        std::vector<SimulatedAccessPoint> accessPoints;
+        std::vector<SimulatedHost>        hosts;
+        unsigned int                      scanDuration;
+        unsigned int                      unreachableHostTimeout;
+
+    public:
+        SimulatedNetwork();
+
+        SimulatedNetwork &addAccessPoint(const SimulatedAccessPoint&);
+        SimulatedNetwork &addHost(const SimulatedHost&);
+        SimulatedNetwork &setScanDuration(const unsigned int&);
+        SimulatedNetwork &setUnreachableHostTimeout(const unsigned int&);
+
+        std::vector<SimulatedAccessPoint> &getAccessPoints();
+        std::vector<SimulatedHost> &getHosts();
+        const unsigned int &getScanDuration() const;
+        const unsigned int &getUnreachableHostTimeout() const;
+
+        SimulatedAccessPoint *findAccessPoint(const std::string&);
+        SimulatedHost *findHost(const std::string&, const unsigned short&);
+    };
+}
@@ -0,0 +1,16 @@
+#include "VirtualClock.h"
+
+namespace Simulator_n
+{
+    VirtualClock::VirtualClock() : currentTime(0) { }
+
+    unsigned int VirtualClock::now() const
+    {
+        return currentTime;
+    }
+
+    void VirtualClock::advance(const unsigned int &milliseconds)
+    {
+        currentTime += milliseconds;
+    }
+}
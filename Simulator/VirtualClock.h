@@ -0,0 +1,17 @@
+#pragma once
+
+namespace Simulator_n
+{
+    class VirtualClock
+    {
+    private:
+        unsigned int currentTime;
+
+    public:
+        VirtualClock();
+
+        unsigned int now() const;
+
+        void advance(const unsigned int&);
+    };
+}
@@ -0,0 +1,190 @@
+#include "DeviceParameter.h"
+#include "ServerMessage.h"
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+using namespace SmartHomeDevice_n;
+
+// Compares the JSON and CBOR encodings of device parameters: checks that every parameter survives a round trip
+// through either of them, and reports message sizes and encode/decode throughput.
+//
+// usage: WireFormatComparison [iterations]
+
+namespace
+{
+    std::vector<DeviceParameter> makeParameters()
+    {
+        return
+        {
+            DeviceParameter("Device_MAC_Address", DeviceParamType::TEXTBOX,  true,  "02:00:00:00:00:01"),
+            DeviceParameter("Power",              DeviceParamType::CHECKBOX, false, "true",   {"true", "false"}),
+            DeviceParameter("Mode",               DeviceParamType::COMBOBOX, false, "Auto",   {"Off", "Heat", "Cool", "Auto", "Dry", "Fan"}),
+            DeviceParameter("Fan_Speed",          DeviceParamType::COMBOBOX, false, "Medium", {"Low", "Medium", "High"}),
+            DeviceParameter("Target_Temperature", DeviceParamType::TEXTBOX,  false, "22.5"),
+            DeviceParameter("Room_Name",          DeviceParamType::TEXTBOX,  false, "Living room")
+        };
+    }
+
+    bool sameParameter(const DeviceParameter &a, const DeviceParameter &b)
+    {
+        return (a.getName() == b.getName()) && (a.getType() == b.getType()) && (a.getCurrentValue() == b.getCurrentValue()) &&
+               (a.getValues() == b.getValues()) && (a.isReadOnly() == b.isReadOnly());
+    }
+
+    // deviceOnline with nested parameters, as the device sends it in either format
+    template <typename Writer>
+    void writeDeviceOnline(Writer &writer, const std::vector<DeviceParameter> &params)
+    {
+        writer.StartObject();
+
+        writeJsonKey(writer, "eventName");
+        writer.String("deviceOnline");
+
+        writeJsonKey(writer, "parameters");
+        writer.StartArray();
+
+        for (const auto &param : params)
+            param.writeJson(writer);
+
+        writer.EndArray();
+
+        writer.EndObject();
+    }
+
+    void writeDeviceOnline(CborWriter &writer, const std::vector<DeviceParameter> &params)
+    {
+        writer.StartObject();
+
+        writeJsonKey(writer, "eventName");
+        writer.String("deviceOnline");
+
+        writeJsonKey(writer, "parameters");
+        writer.StartArray();
+
+        for (const auto &param : params)
+            param.writeCbor(writer);
+
+        writer.EndArray();
+
+        writer.EndObject();
+    }
+
+    std::string deviceOnlineJson(const std::vector<DeviceParameter> &params)
+    {
+        rapidjson::StringBuffer buffer;
+        rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+
+        writeDeviceOnline(writer, params);
+
+        return std::string(buffer.GetString(), buffer.GetSize());
+    }
+
+    std::string deviceOnlineCbor(const std::vector<DeviceParameter> &params)
+    {
+        CborWriter writer;
+
+        writeDeviceOnline(writer, params);
+
+        return writer.take();
+    }
+
+    bool checkRoundTrips(const std::vector<DeviceParameter> &params)
+    {
+        auto ok = true;
+
+        for (const auto &param : params)
+        {
+            if (!sameParameter(param, DeviceParameter::fromJson(param.toJson())))
+            {
+                std::cout << "JSON round trip failed: " << param.getName() << "\n";
+                ok = false;
+            }
+
+            if (!sameParameter(param, DeviceParameter::fromCbor(param.toCbor())))
+            {
+                std::cout << "CBOR round trip failed: " << param.getName() << "\n";
+                ok = false;
+            }
+        }
+
+        // server command: COMBOBOX value as index
+        CborWriter writer;
+
+        writer.StartObject();
+        writeJsonKey(writer, "eventName");
+        writer.String("setDeviceParameter");
+        writeJsonKey(writer, "parameter");
+        writer.StartObject();
+        writeJsonKey(writer, "name");
+        writer.String("Mode");
+        writeJsonKey(writer, "value");
+        writer.Uint(2);
+        writer.EndObject();
+        writer.EndObject();
+
+        auto command = writer.take();
+
+        ServerMessage message;
+
+        if (!parseServerMessageCbor(command, message) || !message.eventName.equals("setDeviceParameter") || !message.paramName.equals("Mode") ||
+            !message.hasParamValueIndex || (message.paramValueIndex != 2))
+        {
+            std::cout << "CBOR server message parse failed\n";
+            ok = false;
+        }
+
+        return ok;
+    }
+
+    template <typename Func>
+    double measure(const unsigned int &iterations, Func func)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        for (unsigned int i = 0; i < iterations; i++)
+            func();
+
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int iterations = 100000;
+
+    if (argc > 1) iterations = static_cast<unsigned int>(std::strtoul(argv[1], nullptr, 10));
+
+    auto params = makeParameters();
+
+    if (!checkRoundTrips(params))
+        return 1;
+
+    auto json = deviceOnlineJson(params);
+    auto cbor = deviceOnlineCbor(params);
+
+    size_t sink = 0;
+
+    auto jsonEncodeTime = measure(iterations, [&]() { sink += deviceOnlineJson(params).size(); });
+    auto cborEncodeTime = measure(iterations, [&]() { sink += deviceOnlineCbor(params).size(); });
+
+    auto jsonParam = params[2].toJson();
+    auto cborParam = params[2].toCbor();
+
+    auto jsonDecodeTime = measure(iterations, [&]() { sink += DeviceParameter::fromJson(jsonParam).getValues().size(); });
+    auto cborDecodeTime = measure(iterations, [&]() { sink += DeviceParameter::fromCbor(cborParam).getValues().size(); });
+
+    std::cout << "deviceOnline, " << params.size() << " parameters:\n"
+              << "  JSON:                " << json.size() << " bytes\n"
+              << "  CBOR:                " << cbor.size() << " bytes (" << (100 * cbor.size() / json.size()) << "% of JSON)\n"
+              << "encode, messages/s:    JSON " << static_cast<unsigned long>(iterations / jsonEncodeTime)
+                                     << ", CBOR " << static_cast<unsigned long>(iterations / cborEncodeTime) << "\n"
+              << "COMBOBOX parameter:    JSON " << jsonParam.size() << " bytes, CBOR " << cborParam.size() << " bytes\n"
+              << "decode, parameters/s:  JSON " << static_cast<unsigned long>(iterations / jsonDecodeTime)
+                                     << ", CBOR " << static_cast<unsigned long>(iterations / cborDecodeTime) << "\n";
+
+    return sink == 0 ? 1 : 0;
+}
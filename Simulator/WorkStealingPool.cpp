@@ -0,0 +1,145 @@
+#include "WorkStealingPool.h"
+
+namespace Simulator_n
+{
+    WorkStealingPool::WorkStealingPool(const unsigned int &threadsCount) : pendingTasks(0), queuedTasks(0), stolenTasks(0), nextWorker(0), stopping(false)
+    {
+        auto count = threadsCount;
+
+        if (count == 0)
+            count = std::thread::hardware_concurrency();
+
+        if (count == 0)
+            count = 1;
+
+        for (unsigned int i = 0; i < count; i++)
+            workers.emplace_back(new Worker());
+
+        for (unsigned int i = 0; i < count; i++)
+            threads.emplace_back(&WorkStealingPool::workerLoop, this, i);
+    }
+
+    WorkStealingPool::~WorkStealingPool()
+    {
+        {
+            std::lock_guard<std::mutex> guard(stateLock);
+            stopping = true;
+        }
+
+        workAvailable.notify_all();
+
+        for (auto &thread : threads)
+            thread.join();
+    }
+
+    void WorkStealingPool::submit(PoolTask task)
+    {
+        unsigned int workerIndex;
+
+        {
+            std::lock_guard<std::mutex> guard(stateLock);
+
+            workerIndex = nextWorker;
+            nextWorker  = (nextWorker + 1) % workers.size();
+
+            pendingTasks++;
+            queuedTasks++;
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(workers[workerIndex]->lock);
+            workers[workerIndex]->tasks.push_back(std::move(task));
+        }
+
+        workAvailable.notify_one();
+    }
+
+    void WorkStealingPool::wait()
+    {
+        std::unique_lock<std::mutex> guard(stateLock);
+
+        allDone.wait(guard, [this]() -> bool { return pendingTasks == 0; });
+    }
+
+    unsigned int WorkStealingPool::size() const
+    {
+        return static_cast<unsigned int>(workers.size());
+    }
+
+    unsigned long WorkStealingPool::getStolenTasksCount() const
+    {
+        return stolenTasks;
+    }
+
+    bool WorkStealingPool::popTask(const unsigned int &workerIndex, PoolTask &task)
+    {
+        auto &worker = *workers[workerIndex];
+
+        std::lock_guard<std::mutex> guard(worker.lock);
+
+        if (worker.tasks.empty())
+            return false;
+
+        task = std::move(worker.tasks.back());
+        worker.tasks.pop_back();
+
+        queuedTasks--;
+
+        return true;
+    }
+
+    bool WorkStealingPool::stealTask(const unsigned int &thiefIndex, PoolTask &task)
+    {
+        for (unsigned int i = 1; i < workers.size(); i++)
+        {
+            auto &victim = *workers[(thiefIndex + i) % workers.size()];
+
+            std::lock_guard<std::mutex> guard(victim.lock);
+
+            if (!victim.tasks.empty())
+            {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+
+                queuedTasks--;
+                stolenTasks++;
+
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void WorkStealingPool::workerLoop(const unsigned int workerIndex)
+    {
+        while (true)
+        {
+            PoolTask task;
+
+            if (popTask(workerIndex, task) || stealTask(workerIndex, task))
+            {
+                task();
+
+                if (--pendingTasks == 0)
+                {
+                    std::lock_guard<std::mutex> guard(stateLock);
+                    allDone.notify_all();
+                }
+
+                continue;
+            }
+
+            std::unique_lock<std::mutex> guard(stateLock);
+
+            if (stopping)
+                return;
+
+            // re-check under the lock, so a submit() between the failed steal and the wait is not missed
+            workAvailable.wait(guard, [this]() -> bool { return stopping || (queuedTasks > 0); });
+
+            if (stopping)
+                return;
+        }
+    }
+}
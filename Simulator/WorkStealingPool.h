@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Simulator_n
+{
+    using PoolTask = std::function<void()>;
+
+    // fixed size thread pool: every worker owns a deque, takes its own work from the back
+    // and steals from the front of the other workers' deques when it runs dry
+    class WorkStealingPool
+    {
+    private:
+        struct Worker
+        {
+            std::mutex           lock;
+            std::deque<PoolTask> tasks;
+        };
+
+        std::vector<std::unique_ptr<Worker>> workers;
+        std::vector<std::thread>             threads;
+
+        std::mutex                           stateLock;
+        std::condition_variable              workAvailable;
+        std::condition_variable              allDone;
+        std::atomic<unsigned long>           pendingTasks;    // submitted, but not finished yet
+        std::atomic<unsigned long>           queuedTasks;     // submitted, but not picked up by a worker yet
+        std::atomic<unsigned long>           stolenTasks;
+        unsigned int                         nextWorker;
+        bool                                 stopping;
+
+        bool popTask(const unsigned int&, PoolTask&);
+        bool stealTask(const unsigned int&, PoolTask&);
+        void workerLoop(const unsigned int);
+
+        WorkStealingPool(const WorkStealingPool&) = delete;
+        WorkStealingPool &operator=(const WorkStealingPool&) = delete;
+
+    public:
+        explicit WorkStealingPool(const unsigned int &threadsCount = 0); // 0 means one thread per hardware core
+        ~WorkStealingPool();
+
+        void submit(PoolTask);
+        void wait();
+
+        unsigned int size() const;
+        unsigned long getStolenTasksCount() const;
+    };
+}
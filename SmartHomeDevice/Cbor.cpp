@@ -0,0 +1,421 @@
+#include "Cbor.h"
+#include <cstring>
+
+namespace SmartHomeDevice_n
+{
+    static const unsigned char CBOR_INDEFINITE = 31;
+    static const unsigned char CBOR_BREAK      = 0xFF;
+    static const unsigned char CBOR_FALSE      = 0xF4;
+    static const unsigned char CBOR_TRUE       = 0xF5;
+    static const unsigned char CBOR_NULL       = 0xF6;
+
+    // nesting of the server messages is shallow, anything deeper is treated as malformed
+    static const unsigned int  MAX_CBOR_DEPTH  = 16;
+
+    CborWriter::CborWriter() : buffer(ownBuffer) { }
+
+    CborWriter::CborWriter(std::string &output) : buffer(output) { }
+
+    void CborWriter::writeHeader(const CborMajorType::Values &majorType, const uint64_t &value)
+    {
+        auto initialByte = static_cast<unsigned char>(majorType << 5);
+
+        // shortest form: small values are embedded in the initial byte, others follow in 1, 2, 4 or 8 bytes
+        if (value < 24)
+        {
+            buffer.push_back(static_cast<char>(initialByte | value));
+            return;
+        }
+
+        unsigned char additionalInfo;
+        unsigned int  bytes;
+
+        if (value <= 0xFF)              { additionalInfo = 24; bytes = 1; }
+        else if (value <= 0xFFFF)       { additionalInfo = 25; bytes = 2; }
+        else if (value <= 0xFFFFFFFFu)  { additionalInfo = 26; bytes = 4; }
+        else                            { additionalInfo = 27; bytes = 8; }
+
+        buffer.push_back(static_cast<char>(initialByte | additionalInfo));
+
+        for (auto i = bytes; i > 0; i--)
+            buffer.push_back(static_cast<char>((value >> ((i - 1) * 8)) & 0xFF));
+    }
+
+    bool CborWriter::StartObject()
+    {
+        buffer.push_back(static_cast<char>((CborMajorType::MAP << 5) | CBOR_INDEFINITE));
+        return true;
+    }
+
+    bool CborWriter::EndObject(const size_t &memberCount)
+    {
+        (void)memberCount;
+
+        buffer.push_back(static_cast<char>(CBOR_BREAK));
+        return true;
+    }
+
+    bool CborWriter::StartArray()
+    {
+        buffer.push_back(static_cast<char>((CborMajorType::ARRAY << 5) | CBOR_INDEFINITE));
+        return true;
+    }
+
+    bool CborWriter::EndArray(const size_t &elementCount)
+    {
+        (void)elementCount;
+
+        buffer.push_back(static_cast<char>(CBOR_BREAK));
+        return true;
+    }
+
+    bool CborWriter::Key(const char *str, const size_t &length, const bool &copy)
+    {
+        return String(str, length, copy);
+    }
+
+    bool CborWriter::String(const char *str)
+    {
+        return String(str, strlen(str));
+    }
+
+    bool CborWriter::String(const char *str, const size_t &length, const bool &copy)
+    {
+        (void)copy;
+
+        writeHeader(CborMajorType::TEXT_STRING, length);
+        buffer.append(str, length);
+
+        return true;
+    }
+
+    bool CborWriter::Bool(const bool &value)
+    {
+        buffer.push_back(static_cast<char>(value ? CBOR_TRUE : CBOR_FALSE));
+        return true;
+    }
+
+    bool CborWriter::Null()
+    {
+        buffer.push_back(static_cast<char>(CBOR_NULL));
+        return true;
+    }
+
+    bool CborWriter::Uint(const unsigned &value)
+    {
+        writeHeader(CborMajorType::UNSIGNED_INT, value);
+        return true;
+    }
+
+    bool CborWriter::Uint64(const uint64_t &value)
+    {
+        writeHeader(CborMajorType::UNSIGNED_INT, value);
+        return true;
+    }
+
+    bool CborWriter::Int(const int &value)
+    {
+        // negative n is encoded as -1 - n
+        if (value < 0)
+            writeHeader(CborMajorType::NEGATIVE_INT, static_cast<uint64_t>(-(static_cast<int64_t>(value) + 1)));
+        else
+            writeHeader(CborMajorType::UNSIGNED_INT, static_cast<uint64_t>(value));
+
+        return true;
+    }
+
+    const std::string &CborWriter::getBuffer() const
+    {
+        return buffer;
+    }
+
+    std::string CborWriter::take()
+    {
+        std::string result;
+
+        result.swap(buffer);
+
+        return result;
+    }
+
+    CborReader::CborReader(const char *data, const size_t &length)
+    : data(reinterpret_cast<const unsigned char*>(data)),
+      length(length),
+      position(0),
+      error(false)
+    {
+    }
+
+    bool CborReader::readHeader(CborMajorType::Values &majorType, uint64_t &value, bool &indefinite)
+    {
+        if (error || (position >= length))
+        {
+            error = true;
+            return false;
+        }
+
+        auto initialByte    = data[position++];
+        auto additionalInfo = static_cast<unsigned char>(initialByte & 0x1F);
+
+        majorType  = static_cast<CborMajorType::Values>(initialByte >> 5);
+        value      = additionalInfo;
+        indefinite = false;
+
+        if (additionalInfo < 24)
+            return true;
+
+        if (additionalInfo == CBOR_INDEFINITE)
+        {
+            indefinite = true;
+            value      = 0;
+            return true;
+        }
+
+        if (additionalInfo > 27)
+        {
+            error = true;
+            return false;
+        }
+
+        size_t bytes = static_cast<size_t>(1) << (additionalInfo - 24);
+
+        if (length - position < bytes)
+        {
+            error = true;
+            return false;
+        }
+
+        value = 0;
+
+        for (size_t i = 0; i < bytes; i++)
+            value = (value << 8) | data[position++];
+
+        return true;
+    }
+
+    bool CborReader::peekMajorType(CborMajorType::Values &majorType) const
+    {
+        if (error || (position >= length))
+            return false;
+
+        majorType = static_cast<CborMajorType::Values>(data[position] >> 5);
+
+        return true;
+    }
+
+    bool CborReader::enterMap(CborContainer &container)
+    {
+        CborMajorType::Values majorType;
+        uint64_t              count;
+
+        if (!readHeader(majorType, count, container.indefinite) || (majorType != CborMajorType::MAP))
+        {
+            error = true;
+            return false;
+        }
+
+        container.remaining = count * 2;
+
+        return true;
+    }
+
+    bool CborReader::enterArray(CborContainer &container)
+    {
+        CborMajorType::Values majorType;
+
+        if (!readHeader(majorType, container.remaining, container.indefinite) || (majorType != CborMajorType::ARRAY))
+        {
+            error = true;
+            return false;
+        }
+
+        return true;
+    }
+
+    bool CborReader::next(CborContainer &container)
+    {
+        if (error)
+            return false;
+
+        if (!container.indefinite)
+        {
+            if (container.remaining == 0)
+                return false;
+
+            container.remaining--;
+            return true;
+        }
+
+        if (position >= length)
+        {
+            error = true;
+            return false;
+        }
+
+        if (data[position] == CBOR_BREAK)
+        {
+            position++;
+            return false;
+        }
+
+        return true;
+    }
+
+    bool CborReader::isText() const
+    {
+        CborMajorType::Values majorType;
+
+        return peekMajorType(majorType) && (majorType == CborMajorType::TEXT_STRING);
+    }
+
+    bool CborReader::isUint() const
+    {
+        CborMajorType::Values majorType;
+
+        return peekMajorType(majorType) && (majorType == CborMajorType::UNSIGNED_INT);
+    }
+
+    bool CborReader::isMap() const
+    {
+        CborMajorType::Values majorType;
+
+        return peekMajorType(majorType) && (majorType == CborMajorType::MAP);
+    }
+
+    bool CborReader::isBool() const
+    {
+        return !error && (position < length) && ( (data[position] == CBOR_TRUE) || (data[position] == CBOR_FALSE) );
+    }
+
+    bool CborReader::readText(const char *&str, size_t &textLength)
+    {
+        CborMajorType::Values majorType;
+        uint64_t              value;
+        bool                  indefinite;
+
+        // chunked (indefinite length) strings would have to be copied together, CborWriter never produces them
+        if (!readHeader(majorType, value, indefinite) || (majorType != CborMajorType::TEXT_STRING) || indefinite || (value > length - position))
+        {
+            error = true;
+            return false;
+        }
+
+        str        = reinterpret_cast<const char*>(data + position);
+        textLength = static_cast<size_t>(value);
+        position  += textLength;
+
+        return true;
+    }
+
+    bool CborReader::readUint(uint64_t &value)
+    {
+        CborMajorType::Values majorType;
+        bool                  indefinite;
+
+        if (!readHeader(majorType, value, indefinite) || (majorType != CborMajorType::UNSIGNED_INT) || indefinite)
+        {
+            error = true;
+            return false;
+        }
+
+        return true;
+    }
+
+    bool CborReader::readBool(bool &value)
+    {
+        if (error || (position >= length) || ( (data[position] != CBOR_TRUE) && (data[position] != CBOR_FALSE) ))
+        {
+            error = true;
+            return false;
+        }
+
+        value = data[position++] == CBOR_TRUE;
+
+        return true;
+    }
+
+    bool CborReader::skip()
+    {
+        return skip(0);
+    }
+
+    bool CborReader::skip(const unsigned int &depth)
+    {
+        CborMajorType::Values majorType;
+        uint64_t              value;
+        bool                  indefinite;
+
+        if ( (depth > MAX_CBOR_DEPTH) || !readHeader(majorType, value, indefinite) )
+        {
+            error = true;
+            return false;
+        }
+
+        switch (majorType)
+        {
+            case CborMajorType::UNSIGNED_INT:
+            case CborMajorType::NEGATIVE_INT:
+                return true;
+
+            case CborMajorType::BYTE_STRING:
+            case CborMajorType::TEXT_STRING:
+                if (indefinite)
+                {
+                    CborContainer chunks = {true, 0};
+
+                    while (next(chunks))
+                    {
+                        if (!skip(depth + 1))
+                            return false;
+                    }
+
+                    return !error;
+                }
+
+                if (value > length - position)
+                {
+                    error = true;
+                    return false;
+                }
+
+                position += static_cast<size_t>(value);
+                return true;
+
+            case CborMajorType::ARRAY:
+            case CborMajorType::MAP:
+            {
+                CborContainer container = {indefinite, majorType == CborMajorType::MAP ? value * 2 : value};
+
+                while (next(container))
+                {
+                    if (!skip(depth + 1))
+                        return false;
+                }
+
+                return !error;
+            }
+
+            case CborMajorType::TAG:
+                return skip(depth + 1);
+
+            case CborMajorType::SIMPLE:
+                // floats: the value has already been read as the argument. A stray break is malformed
+                if (indefinite)
+                    error = true;
+
+                return !error;
+        }
+
+        return false;
+    }
+
+    bool CborReader::hasError() const
+    {
+        return error;
+    }
+
+    bool CborReader::atEnd() const
+    {
+        return position >= length;
+    }
+}
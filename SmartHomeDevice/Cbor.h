@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace SmartHomeDevice_n
+{
+    namespace CborMajorType
+    {
+        enum Values : unsigned char
+        {
+            UNSIGNED_INT = 0,
+            NEGATIVE_INT = 1,
+            BYTE_STRING  = 2,
+            TEXT_STRING  = 3,
+            ARRAY        = 4,
+            MAP          = 5,
+            TAG          = 6,
+            SIMPLE       = 7     // false, true, null, floats, break
+        };
+    };
+
+    // RFC 8949 encoder with the SAX interface of rapidjson::Writer, so the same code writes either format.
+    // Objects and arrays are written with indefinite length: their size doesn't have to be known up front
+    class CborWriter
+    {
+    private:
+        std::string  ownBuffer;
+        std::string &buffer;
+
+        void writeHeader(const CborMajorType::Values&, const uint64_t&);
+
+    public:
+        CborWriter();
+        explicit CborWriter(std::string &output);   // appends to 'output' instead of a buffer of its own
+
+        CborWriter(const CborWriter&) = delete;
+        CborWriter &operator=(const CborWriter&) = delete;
+
+        bool StartObject();
+        bool EndObject(const size_t &memberCount = 0);
+        bool StartArray();
+        bool EndArray(const size_t &elementCount = 0);
+        bool Key(const char*, const size_t&, const bool &copy = false);
+        bool String(const char*);
+        bool String(const char*, const size_t&, const bool &copy = false);
+        bool Bool(const bool&);
+        bool Null();
+        bool Uint(const unsigned&);
+        bool Uint64(const uint64_t&);
+        bool Int(const int&);
+
+        const std::string &getBuffer() const;
+        std::string take();
+    };
+
+    // definite or indefinite length array/map being read
+    struct CborContainer
+    {
+        bool     indefinite;
+        uint64_t remaining;     // items, for maps keys and values both count
+    };
+
+    // pull decoder for data written by CborWriter, or by any other encoder. Strings point into the input
+    class CborReader
+    {
+    private:
+        const unsigned char *data;
+        size_t               length;
+        size_t               position;
+        bool                 error;
+
+        bool readHeader(CborMajorType::Values&, uint64_t&, bool &indefinite);
+        bool peekMajorType(CborMajorType::Values&) const;
+        bool skip(const unsigned int &depth);
+
+    public:
+        CborReader(const char*, const size_t&);
+
+        bool enterMap(CborContainer&);
+        bool enterArray(CborContainer&);
+        // true, if there's another item in the container. Consumes the break at the end of an indefinite one
+        bool next(CborContainer&);
+
+        bool isText() const;
+        bool isUint() const;
+        bool isMap() const;
+        bool isBool() const;
+
+        bool readText(const char *&str, size_t &length);
+        bool readUint(uint64_t&);
+        bool readBool(bool&);
+
+        // skips one complete item, nested ones included
+        bool skip();
+
+        bool hasError() const;
+        bool atEnd() const;
+    };
+}
@@ -1,25 +1,201 @@
 #include "DebugDevice.h"
+#include <cstring>
 
 namespace DebugDevice_n
 {
+    static const char TRUNCATION_MARK[] = "...\n";
+
+    LogRecord::LogRecord(DebugDevice *device, const size_t &slot) : device(device), slot(slot), length(0), truncated(false) { }
+
+    LogRecord::LogRecord(LogRecord &&other) : device(other.device), slot(other.slot), length(other.length), truncated(other.truncated)
+    {
+        other.device = nullptr;
+    }
+
+    LogRecord::~LogRecord()
+    {
+        if (device == nullptr)
+            return;
+
+        if (truncated)
+        {
+            auto &text = device->slots[slot].text;
+
+            length = static_cast<unsigned short>(DEBUG_DEVICE_RECORD_LENGTH - (sizeof(TRUNCATION_MARK) - 1));
+
+            memcpy(text + length, TRUNCATION_MARK, sizeof(TRUNCATION_MARK) - 1);
+
+            length += sizeof(TRUNCATION_MARK) - 1;
+        }
+
+        device->publish(slot, length);
+    }
+
+    LogRecord &LogRecord::append(const char *str, const size_t &strLength)
+    {
+        if ( (device == nullptr) || truncated )
+            return *this;
+
+        size_t room  = DEBUG_DEVICE_RECORD_LENGTH - length;
+        size_t count = strLength < room ? strLength : room;
+
+        memcpy(device->slots[slot].text + length, str, count);
+
+        length = static_cast<unsigned short>(length + count);
+
+        if (count < strLength)
+            truncated = true;
+
+        return *this;
+    }
+
+    LogRecord &LogRecord::appendNumber(unsigned long value, const bool &negative)
+    {
+        char digits[24];
+        auto position = sizeof(digits);
+
+        do
+        {
+            digits[--position] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        }
+        while (value > 0);
+
+        if (negative)
+            digits[--position] = '-';
+
+        return append(digits + position, sizeof(digits) - position);
+    }
+
+    LogRecord &LogRecord::operator<<(const char *str)
+    {
+        return str != nullptr ? append(str, strlen(str)) : *this;
+    }
+
+    LogRecord &LogRecord::operator<<(const std::string &str)
+    {
+        return append(str.data(), str.size());
+    }
+
+    LogRecord &LogRecord::operator<<(const int &value)
+    {
+        return *this << static_cast<long>(value);
+    }
+
+    LogRecord &LogRecord::operator<<(const unsigned int &value)
+    {
+        return appendNumber(value, false);
+    }
+
+    LogRecord &LogRecord::operator<<(const long &value)
+    {
+        // magnitude of LONG_MIN doesn't fit into long, it does into unsigned long
+        return value < 0 ? appendNumber(0ul - static_cast<unsigned long>(value), true) : appendNumber(static_cast<unsigned long>(value), false);
+    }
+
+    LogRecord &LogRecord::operator<<(const unsigned long &value)
+    {
+        return appendNumber(value, false);
+    }
+
     DebugDevice::DebugDevice(DebugPrintFunc debugPrintFunc)
+    : reserved(0),
+      released(0),
+      dropped(0),
+      level(LogLevel::VERBOSE),
+      debugPrintFunc(debugPrintFunc)
+    {
+        for (auto &slot : slots)
+            slot.ready.store(false, std::memory_order_relaxed);
+    }
+
+    void DebugDevice::init()
+    {
+    }
+
+    void DebugDevice::go()
     {
-        this->debugPrintFunc = debugPrintFunc;
+        for (int i = 0; (i < DEBUG_DEVICE_DRAIN_BATCH) && printNext(); i++);
     }
 
-    DebugDevice &DebugDevice::operator<<(const std::string &debugMessage)
+    void DebugDevice::terminate()
     {
+        flush();
+    }
+
+    void DebugDevice::setLevel(const LogLevel::Values &level)
+    {
+        this->level = level;
+    }
+
+    bool DebugDevice::isEnabled(const LogLevel::Values &level) const
+    {
+        return level >= this->level;
+    }
+
+    LogRecord DebugDevice::record(const LogLevel::Values &level)
+    {
+        if (reserved - released.load(std::memory_order_acquire) >= DEBUG_DEVICE_RECORDS)
+        {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+
+            return LogRecord(nullptr, 0);
+        }
+
+        auto slot = reserved++ % DEBUG_DEVICE_RECORDS;
+
+        slots[slot].level = level;
+
+        return LogRecord(this, slot);
+    }
+
+    void DebugDevice::publish(const size_t &slot, const unsigned short &length)
+    {
+        slots[slot].length = length;
+        slots[slot].ready.store(true, std::memory_order_release);
+    }
+
+    bool DebugDevice::printNext()
+    {
+        auto droppedCount = dropped.exchange(0, std::memory_order_relaxed);
+
+        // reported ahead of the records still in the ring
+        if ( (droppedCount > 0) && (debugPrintFunc != nullptr) )
+        {
+            line.assign("[");
+            line.append(std::to_string(droppedCount));
+            line.append(" log records dropped]\n");
+
+            debugPrintFunc(line);
+        }
+
+        // records are printed in the order they were started. One, which is still being written, holds up the ones after it
+        auto index = released.load(std::memory_order_relaxed);
+        auto &slot = slots[index % DEBUG_DEVICE_RECORDS];
+
+        if (!slot.ready.load(std::memory_order_acquire))
+            return false;
+
         if (debugPrintFunc != nullptr)
-            debugPrintFunc(debugMessage);
+        {
+            line.assign(slot.text, slot.length);
 
-        return *this;
+            debugPrintFunc(line);
+        }
+
+        slot.ready.store(false, std::memory_order_relaxed);
+        released.store(index + 1, std::memory_order_release);
+
+        return true;
     }
 
-    DebugDevice &DebugDevice::operator<<(const char *debugMessage)
+    void DebugDevice::flush()
     {
-        if ( (debugPrintFunc != nullptr) && (debugMessage != nullptr) )
-            debugPrintFunc(std::string(debugMessage));
+        while (printNext());
+    }
 
-        return *this;
+    bool DebugDevice::isEmpty() const
+    {
+        return (released.load(std::memory_order_acquire) == reserved) && (dropped.load(std::memory_order_relaxed) == 0);
     }
-}
\ No newline at end of file
+}
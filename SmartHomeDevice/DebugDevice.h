@@ -1,22 +1,140 @@
 #pragma once
 
+#include "TaskManager.h"
+#include <atomic>
+#include <cstddef>
 #include <functional>
 #include <string>
 
+// records below this level are compiled out, together with the formatting of their arguments. 0 keeps all of them
+#ifndef DEBUG_DEVICE_MIN_LEVEL
+#define DEBUG_DEVICE_MIN_LEVEL 0
+#endif
+
+// ring buffer: number of records, and characters per record. Longer records are truncated
+#ifndef DEBUG_DEVICE_RECORDS
+#define DEBUG_DEVICE_RECORDS 16
+#endif
+
+#ifndef DEBUG_DEVICE_RECORD_LENGTH
+#define DEBUG_DEVICE_RECORD_LENGTH 120
+#endif
+
+// records printed per go() of the drain task, so a slow serial port doesn't hold up the device loop
+#ifndef DEBUG_DEVICE_DRAIN_BATCH
+#define DEBUG_DEVICE_DRAIN_BATCH 4
+#endif
+
+//  LOG_WARNING(debugDevice) << "Unhandled http status received: " << status << "\n";
+// an expression rather than an if statement, so it can't take over the else of an if around it
+#define LOG_AT(debugDevice, level) \
+    ( (static_cast<int>(level) < DEBUG_DEVICE_MIN_LEVEL) || ((debugDevice) == nullptr) || !(debugDevice)->isEnabled(level) ) ? \
+        (void)0 : DebugDevice_n::LogStatement() & (debugDevice)->record(level)
+
+#define LOG_VERBOSE(debugDevice)  LOG_AT(debugDevice, DebugDevice_n::LogLevel::VERBOSE)
+#define LOG_INFO(debugDevice)     LOG_AT(debugDevice, DebugDevice_n::LogLevel::INFO)
+#define LOG_WARNING(debugDevice)  LOG_AT(debugDevice, DebugDevice_n::LogLevel::WARNING)
+#define LOG_CRITICAL(debugDevice) LOG_AT(debugDevice, DebugDevice_n::LogLevel::CRITICAL)
+
 namespace DebugDevice_n
 {
+    using namespace TaskManager_n;
+
     using DebugPrintFunc = std::function<void(const std::string&)>;
 
-    class DebugDevice
+    namespace LogLevel
+    {
+        enum Values : unsigned char
+        {
+            VERBOSE,    // FSM transitions
+            INFO,
+            WARNING,    // malformed or unexpected server data
+            CRITICAL    // device is about to reset
+        };
+    };
+
+    class DebugDevice;
+
+    // one record being formatted, straight into its slot of the ring. It's published once the statement ends
+    class LogRecord
     {
     private:
+        DebugDevice   *device;      // nullptr, if the ring was full and the record is dropped
+        size_t         slot;
+        unsigned short length;
+        bool           truncated;
+
+        LogRecord &append(const char*, const size_t&);
+        LogRecord &appendNumber(unsigned long, const bool &negative);
+
+    public:
+        LogRecord(DebugDevice*, const size_t &slot);
+        LogRecord(LogRecord&&);
+        ~LogRecord();
+
+        LogRecord(const LogRecord&) = delete;
+        LogRecord &operator=(const LogRecord&) = delete;
+
+        LogRecord &operator <<(const char*);
+        LogRecord &operator <<(const std::string&);
+        LogRecord &operator <<(const int&);
+        LogRecord &operator <<(const unsigned int&);
+        LogRecord &operator <<(const long&);
+        LogRecord &operator <<(const unsigned long&);
+    };
+
+    // ends a LOG_...() statement: '&' binds looser than '<<', so the whole chain is written before the record is discarded
+    struct LogStatement
+    {
+        void operator &(const LogRecord&) { }
+    };
+
+    // Lock-free ring of fixed size records. Formatting doesn't allocate and doesn't wait for the output: records are printed
+    // later by go(), which runs as a low priority task. A record, which finds the ring full, is dropped and counted.
+    // Records are written by a single thread (the device loop); they may be printed by the same or by another one
+    class DebugDevice : public Task
+    {
+    private:
+        struct Slot
+        {
+            std::atomic<bool>  ready;
+            LogLevel::Values   level;
+            unsigned short     length;
+            char               text[DEBUG_DEVICE_RECORD_LENGTH];
+        };
+
+        Slot                       slots[DEBUG_DEVICE_RECORDS];
+        size_t                     reserved;      // slots handed out to records. Written by the producer only
+        std::atomic<size_t>        released;      // slots printed and free again. Written by the consumer only
+        std::atomic<unsigned long> dropped;
+        LogLevel::Values           level;
+        DebugPrintFunc             debugPrintFunc;
+        std::string                line;          // handed to debugPrintFunc, keeps its capacity
+
         DebugDevice() = delete;
 
-        DebugPrintFunc debugPrintFunc;
+        bool printNext();
+        void publish(const size_t &slot, const unsigned short &length);
+
+        friend class LogRecord;
+
     public:
         DebugDevice(DebugPrintFunc);
 
-        DebugDevice &operator <<(const std::string&);
-        DebugDevice &operator <<(const char*);
+        void init() override;
+        void go() override;
+        void terminate() override;
+
+        // records below the level are skipped at run time; see DEBUG_DEVICE_MIN_LEVEL for leaving them out of the build
+        void setLevel(const LogLevel::Values&);
+        bool isEnabled(const LogLevel::Values&) const;
+
+        LogRecord record(const LogLevel::Values&);
+
+        // prints everything recorded so far, e.g. before a reset
+        void flush();
+
+        // nothing is waiting to be printed. Called by the thread, which writes the records
+        bool isEmpty() const;
     };
-}
\ No newline at end of file
+}
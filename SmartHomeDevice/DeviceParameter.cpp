@@ -2,19 +2,48 @@
 #include "rapidjson/document.h"
 #include "rapidjson/stringbuffer.h"
 #include "rapidjson/writer.h"
+#include <cstring>
 #include <map>
 
 namespace SmartHomeDevice_n
 {
     using namespace rapidjson;
 
+    // CHECKBOX without its own options: "false" / "true" become flag 0 / 1
+    static const DeviceParamValuesList &checkboxValues()
+    {
+        static const DeviceParamValuesList checkboxValues = {"false", "true"};
+
+        return checkboxValues;
+    }
+
+    static const DeviceParamValuesList &noValues()
+    {
+        static const DeviceParamValuesList noValues;
+
+        return noValues;
+    }
+
+    DeviceParameter::DeviceParameter()
+    : valueIndex(TEXT_VALUE),
+      type(DeviceParamType::TEXTBOX),
+      readOnly(false)
+    {
+    }
+
     DeviceParameter::DeviceParameter(const std::string &name, const DeviceParamType &type, const bool &readOnly, const std::string &currentValue, const DeviceParamValuesList &values)
+    : name(name),
+      values(values.empty() ? nullptr : std::make_shared<DeviceParamValuesList>(values)),
+      valueIndex(TEXT_VALUE),
+      type(type),
+      readOnly(readOnly)
     {
-        this->name         = name;
-        this->type         = type;
-        this->readOnly     = readOnly;
-        this->currentValue = currentValue;
-        this->values       = values;
+        setCurrentValue(currentValue);
+    }
+
+    const DeviceParamValuesList &DeviceParameter::indexedValues() const
+    {
+        return ( (type == DeviceParamType::CHECKBOX) && !values ) ? checkboxValues() : getValues();
     }
 
     const std::string &DeviceParameter::getName() const
@@ -24,7 +53,7 @@ namespace SmartHomeDevice_n
 
     const DeviceParamValuesList &DeviceParameter::getValues() const
     {
-        return values;
+        return values ? *values : noValues();
     }
 
     const DeviceParamType &DeviceParameter::getType() const
@@ -34,7 +63,7 @@ namespace SmartHomeDevice_n
 
     const std::string &DeviceParameter::getCurrentValue() const
     {
-        return currentValue;
+        return valueIndex == TEXT_VALUE ? textValue : indexedValues()[valueIndex];
     }
 
     const bool &DeviceParameter::isReadOnly() const
@@ -49,20 +78,41 @@ namespace SmartHomeDevice_n
 
     void DeviceParameter::addValue(const std::string &value)
     {
-        values.push_back(value);
+        auto currentValue = getCurrentValue();
+
+        if (!values || (values.use_count() > 1))
+            values = std::make_shared<DeviceParamValuesList>(getValues());
+
+        values->push_back(value);
 
-        if (values.size() == 1)
-            setCurrentValue(values.front());
+        // a CHECKBOX index may have referred to the implicit "false" / "true" options, so the value is encoded again
+        setCurrentValue(values->size() == 1 ? values->front() : currentValue);
     }
 
     void DeviceParameter::setType(const DeviceParamType &type)
     {
+        auto currentValue = getCurrentValue();
+
         this->type = type;
+
+        setCurrentValue(currentValue);
     }
 
     void DeviceParameter::setCurrentValue(const std::string &currentValue)
     {
-        this->currentValue = currentValue;
+        size_t index;
+
+        if ( (type != DeviceParamType::TEXTBOX) && findValueIndex(currentValue, index) && (index < TEXT_VALUE) )
+        {
+            valueIndex = static_cast<uint16_t>(index);
+            textValue.clear();
+            textValue.shrink_to_fit();
+        }
+        else
+        {
+            valueIndex = TEXT_VALUE;
+            textValue  = currentValue;
+        }
     }
 
     void DeviceParameter::setReadOnly(const bool &readOnly)
@@ -71,6 +121,11 @@ namespace SmartHomeDevice_n
     }
 
     std::string DeviceParameter::typeToStr(const DeviceParamType &type)
+    {
+        return std::string(typeToCStr(type));
+    }
+
+    const char *DeviceParameter::typeToCStr(const DeviceParamType &type)
     {
         switch (type)
         {
@@ -98,53 +153,12 @@ namespace SmartHomeDevice_n
 
     std::string DeviceParameter::toJson() const
     {
-        Document jsonDoc;
-        
-        jsonDoc.SetObject();
-
-        Document::AllocatorType& allocator = jsonDoc.GetAllocator();
-
-        Value _name;
-        Value _type;
-        Value _currentValue;
-        Value _values;
-        Value _readOnly;
-
-        _name.SetString(name.c_str(), name.length(), allocator);
-        
-        auto typeStr = typeToStr(type);
-        
-        _type.SetString(typeStr.c_str(), typeStr.length(), allocator);
-
-        _currentValue.SetString(currentValue.c_str(), currentValue.length(), allocator);
-
-        _readOnly.SetBool(readOnly);
-
-        _values.SetArray();
-        
-        for (auto val : values)
-        {
-            Value _val;
-            
-            _val.SetString(val.c_str(), val.length(), allocator);
-
-            _values.PushBack(_val, allocator);
-        }
-
-        jsonDoc.AddMember("name",         _name,         allocator);
-        jsonDoc.AddMember("type",         _type,         allocator);
-        jsonDoc.AddMember("currentValue", _currentValue, allocator);
-        jsonDoc.AddMember("values",       _values,       allocator);
-        jsonDoc.AddMember("readOnly",     _readOnly,     allocator);
-
         StringBuffer buffer;
-
-        buffer.Clear();
-
         Writer<StringBuffer> writer(buffer);
-        jsonDoc.Accept(writer);
 
-        return std::string(buffer.GetString());
+        writeJson(writer);
+
+        return std::string(buffer.GetString(), buffer.GetSize());
     }
 
     DeviceParameter DeviceParameter::fromJson(const std::string &jsonStr)
@@ -169,7 +183,7 @@ namespace SmartHomeDevice_n
                 auto name         = std::string(nameJsonObj.GetString());
                 auto type         = strToType(typeJsonObj.GetString());
                 auto currentValue = std::string(currentValueJsonObj.GetString());
-                auto values       = std::list<std::string>();
+                auto values       = DeviceParamValuesList();
                 auto readOnly     = readOnlyJsonObj.GetBool();
 
                 for (SizeType i = 0; i < valuesJsonObj.Size(); i++)
@@ -186,4 +200,150 @@ namespace SmartHomeDevice_n
 
         return DeviceParameter();
     }
-}
\ No newline at end of file
+
+    bool DeviceParameter::findValueIndex(const std::string &value, size_t &index) const
+    {
+        const auto &list = indexedValues();
+
+        for (index = 0; index < list.size(); index++)
+        {
+            if (list[index] == value)
+                return true;
+        }
+
+        return false;
+    }
+
+    const std::string *DeviceParameter::getValueAt(const size_t &index) const
+    {
+        const auto &list = getValues();
+
+        return index < list.size() ? &list[index] : nullptr;
+    }
+
+    void DeviceParameter::writeCbor(CborWriter &writer) const
+    {
+        writer.StartObject();
+
+        writeJsonKey(writer, "name");
+        writeJsonString(writer, name);
+
+        writeJsonKey(writer, "type");
+        writer.Uint(type);
+
+        writeJsonKey(writer, "currentValue");
+
+        // already an index, nothing to look up
+        if ( (type == DeviceParamType::COMBOBOX) && (valueIndex != TEXT_VALUE) )
+            writer.Uint(valueIndex);
+        else
+            writeJsonString(writer, getCurrentValue());
+
+        writeJsonKey(writer, "values");
+        writer.StartArray();
+
+        for (const auto &value : getValues())
+            writeJsonString(writer, value);
+
+        writer.EndArray();
+
+        writeJsonKey(writer, "readOnly");
+        writer.Bool(readOnly);
+
+        writer.EndObject();
+    }
+
+    std::string DeviceParameter::toCbor() const
+    {
+        CborWriter writer;
+
+        writeCbor(writer);
+
+        return writer.take();
+    }
+
+    DeviceParameter DeviceParameter::fromCbor(const std::string &cbor)
+    {
+        CborReader reader(cbor.data(), cbor.size());
+
+        DeviceParameter param;
+
+        if (readCbor(reader, param))
+            return param;
+
+        return DeviceParameter();
+    }
+
+    bool DeviceParameter::readCbor(CborReader &reader, DeviceParameter &param)
+    {
+        CborContainer object;
+
+        if (!reader.enterMap(object))
+            return false;
+
+        std::string           name;
+        auto                  type     = static_cast<DeviceParamType>(-1);
+        std::string           currentValue;
+        DeviceParamValuesList values;
+        bool                  readOnly = false;
+
+        bool     hasCurrentValueIndex = false;
+        uint64_t currentValueIndex    = 0;
+
+        while (reader.next(object))
+        {
+            const char *key;
+            size_t      keyLength;
+
+            if (!reader.readText(key, keyLength) || !reader.next(object))
+                return false;
+
+            auto isKey = [&](const char *name) -> bool { return (strlen(name) == keyLength) && (strncmp(key, name, keyLength) == 0); };
+
+            const char *str;
+            size_t      length;
+            uint64_t    number;
+
+            if (isKey("name") && reader.readText(str, length))
+                name.assign(str, length);
+            else if (isKey("type") && reader.readUint(number))
+                type = static_cast<DeviceParamType>(number);
+            else if (isKey("currentValue") && reader.isUint() && reader.readUint(currentValueIndex))
+                hasCurrentValueIndex = true;
+            else if (isKey("currentValue") && reader.readText(str, length))
+                currentValue.assign(str, length);
+            else if (isKey("readOnly"))
+                reader.readBool(readOnly);
+            else if (isKey("values"))
+            {
+                CborContainer valuesArray;
+
+                if (!reader.enterArray(valuesArray))
+                    return false;
+
+                while (reader.next(valuesArray))
+                {
+                    if (reader.readText(str, length))
+                        values.emplace_back(str, length);
+                }
+            }
+            else
+                reader.skip();
+
+            if (reader.hasError())
+                return false;
+        }
+
+        if (hasCurrentValueIndex)
+        {
+            if (currentValueIndex >= values.size())
+                return false;
+
+            currentValue = values[static_cast<size_t>(currentValueIndex)];
+        }
+
+        param = DeviceParameter(name, type, readOnly, currentValue, values);
+
+        return !reader.hasError();
+    }
+}
@@ -1,7 +1,12 @@
 #pragma once
 
+#include <memory>
 #include <string>
-#include <list>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include "rapidjson/rapidjson.h"
+#include "Cbor.h"
 
 namespace SmartHomeDevice_n
 {
@@ -15,20 +20,28 @@ namespace SmartHomeDevice_n
         };
     };
    
-    using DeviceParamValuesList = std::list<std::string>;
+    using DeviceParamValuesList = std::vector<std::string>;
     using DeviceParamType = DeviceParameterType::Values;
 
+    // Option list is shared between copies of a parameter (e.g. the caller's and the registry's); a value added to a shared
+    // list copies it first, to an unshared one it's appended in place. Current value of a COMBOBOX is kept as an index into the options, of a CHECKBOX as a flag; only values,
+    // which can't be encoded like that (TEXTBOX ones, or an option, which isn't in the list), are stored as text
     class DeviceParameter
     {
     private:
-        std::string           name;
-        DeviceParamType       type;
-        std::string           currentValue;
-        DeviceParamValuesList values;
-        bool                  readOnly;
+        static const uint16_t TEXT_VALUE = 0xFFFF;   // 'valueIndex' for values kept in 'textValue'
+
+        std::string                            name;
+        std::shared_ptr<DeviceParamValuesList> values;       // nullptr for no options
+        std::string                            textValue;
+        uint16_t                               valueIndex;   // into indexedValues()
+        DeviceParamType                        type;
+        bool                                   readOnly;
+
+        const DeviceParamValuesList &indexedValues() const;
 
     public:
-        DeviceParameter() = default;
+        DeviceParameter();
         DeviceParameter(const std::string&, const DeviceParamType&, const bool&, const std::string& = std::string(""), const DeviceParamValuesList& = DeviceParamValuesList());
 
         const std::string &getName() const;
@@ -44,9 +57,66 @@ namespace SmartHomeDevice_n
         void setReadOnly(const bool&);
 
         static std::string typeToStr(const DeviceParamType&);
+        static const char *typeToCStr(const DeviceParamType&);
         static DeviceParamType strToType(const std::string&);
 
+        // streams the parameter straight into a rapidjson-compatible writer, without building a DOM
+        template <typename JsonWriter>
+        void writeJson(JsonWriter&) const;
+
         std::string toJson() const;
         static DeviceParameter fromJson(const std::string&);
+
+        // same fields as JSON, compacted: type is a number, and COMBOBOX current value is its index in 'values'
+        void writeCbor(CborWriter&) const;
+        std::string toCbor() const;
+        static DeviceParameter fromCbor(const std::string&);
+        static bool readCbor(CborReader&, DeviceParameter&);
+
+        // position in 'values', for the index based encodings
+        bool findValueIndex(const std::string&, size_t&) const;
+        const std::string *getValueAt(const size_t&) const;
     };
+
+    template <typename JsonWriter, std::size_t N>
+    inline void writeJsonKey(JsonWriter &writer, const char (&key)[N])
+    {
+        writer.Key(key, static_cast<rapidjson::SizeType>(N - 1));
+    }
+
+    template <typename JsonWriter>
+    inline void writeJsonString(JsonWriter &writer, const std::string &str)
+    {
+        writer.String(str.c_str(), static_cast<rapidjson::SizeType>(str.length()));
+    }
+
+    template <typename JsonWriter>
+    void DeviceParameter::writeJson(JsonWriter &writer) const
+    {
+        auto typeStr = typeToCStr(type);
+
+        writer.StartObject();
+
+        writeJsonKey(writer, "name");
+        writeJsonString(writer, name);
+
+        writeJsonKey(writer, "type");
+        writer.String(typeStr);
+
+        writeJsonKey(writer, "currentValue");
+        writeJsonString(writer, getCurrentValue());
+
+        writeJsonKey(writer, "values");
+        writer.StartArray();
+
+        for (const auto &value : getValues())
+            writeJsonString(writer, value);
+
+        writer.EndArray();
+
+        writeJsonKey(writer, "readOnly");
+        writer.Bool(readOnly);
+
+        writer.EndObject();
+    }
 }
\ No newline at end of file
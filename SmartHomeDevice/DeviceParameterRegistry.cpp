@@ -0,0 +1,91 @@
+#include "DeviceParameterRegistry.h"
+#include "Fnv1a.h"
+
+namespace SmartHomeDevice_n
+{
+    DeviceParameterRegistry::DeviceParameterRegistry() : buckets(16, INVALID_PARAM_HANDLE) { }
+
+    void DeviceParameterRegistry::insertIntoIndex(const ParamHandle &handle)
+    {
+        auto mask   = buckets.size() - 1;
+        auto bucket = hashes[handle] & mask;
+
+        while (buckets[bucket] != INVALID_PARAM_HANDLE)
+            bucket = (bucket + 1) & mask;
+
+        buckets[bucket] = handle;
+    }
+
+    void DeviceParameterRegistry::rehash(const std::size_t &bucketsCount)
+    {
+        buckets.assign(bucketsCount, INVALID_PARAM_HANDLE);
+
+        for (ParamHandle handle = 0; handle < params.size(); handle++)
+            insertIntoIndex(handle);
+    }
+
+    ParamHandle DeviceParameterRegistry::add(const DeviceParameter &param)
+    {
+        if ( (find(param.getName()) != INVALID_PARAM_HANDLE) || (params.size() >= INVALID_PARAM_HANDLE) )
+            return INVALID_PARAM_HANDLE;
+
+        auto handle = static_cast<ParamHandle>(params.size());
+
+        params.push_back(param);
+        hashes.push_back(fnv1a(param.getName().data(), param.getName().size()));
+
+        // keep load factor below 1/2, so probe sequences stay short
+        if (params.size() * 2 > buckets.size())
+            rehash(buckets.size() * 2);
+        else
+            insertIntoIndex(handle);
+
+        return handle;
+    }
+
+    ParamHandle DeviceParameterRegistry::find(const std::string &name) const
+    {
+        return find(name.data(), name.size());
+    }
+
+    ParamHandle DeviceParameterRegistry::find(const char *name, const std::size_t &length) const
+    {
+        auto nameHash = fnv1a(name, length);
+        auto mask     = buckets.size() - 1;
+
+        for (auto bucket = nameHash & mask; buckets[bucket] != INVALID_PARAM_HANDLE; bucket = (bucket + 1) & mask)
+        {
+            auto handle = buckets[bucket];
+
+            if ( (hashes[handle] == nameHash) && (params[handle].getName().compare(0, std::string::npos, name, length) == 0) )
+                return handle;
+        }
+
+        return INVALID_PARAM_HANDLE;
+    }
+
+    DeviceParameter *DeviceParameterRegistry::get(const ParamHandle &handle)
+    {
+        return handle < params.size() ? &params[handle] : nullptr;
+    }
+
+    const DeviceParameter *DeviceParameterRegistry::get(const ParamHandle &handle) const
+    {
+        return handle < params.size() ? &params[handle] : nullptr;
+    }
+
+    std::size_t DeviceParameterRegistry::size() const
+    {
+        return params.size();
+    }
+
+    DeviceParameterRegistry::const_iterator DeviceParameterRegistry::begin() const
+    {
+        return params.begin();
+    }
+
+    DeviceParameterRegistry::const_iterator DeviceParameterRegistry::end() const
+    {
+        return params.end();
+    }
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "DeviceParameter.h"
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+namespace SmartHomeDevice_n
+{
+    using ParamHandle = unsigned short;
+
+    const ParamHandle INVALID_PARAM_HANDLE = static_cast<ParamHandle>(-1);
+
+    // flat parameter storage with an open addressing hash index on top of it.
+    // Parameter names are stored only once (in the parameters themselves); the index keeps just handles and cached name hashes.
+    // Parameters are never removed, so handles stay valid for the whole lifetime of the registry.
+    class DeviceParameterRegistry
+    {
+    private:
+        std::vector<DeviceParameter> params;
+        std::vector<uint32_t>        hashes;        // fnv1a() of the names
+        std::vector<ParamHandle>     buckets;
+
+        void insertIntoIndex(const ParamHandle&);
+        void rehash(const std::size_t&);
+
+    public:
+        using const_iterator = std::vector<DeviceParameter>::const_iterator;
+
+        DeviceParameterRegistry();
+
+        ParamHandle add(const DeviceParameter&);          // INVALID_PARAM_HANDLE if a parameter with this name already exists
+        ParamHandle find(const std::string&) const;
+        ParamHandle find(const char*, const std::size_t&) const;   // e.g. a name pointing into a parsed server message
+
+        DeviceParameter *get(const ParamHandle&);
+        const DeviceParameter *get(const ParamHandle&) const;
+
+        std::size_t size() const;
+
+        const_iterator begin() const;
+        const_iterator end() const;
+    };
+}
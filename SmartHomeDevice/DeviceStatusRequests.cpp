@@ -0,0 +1,111 @@
+#include "DeviceStatusRequests.h"
+
+namespace SmartHomeDevice_n
+{
+    static void appendUnsigned(std::string &str, unsigned long value)
+    {
+        char digits[20];
+        unsigned char count = 0;
+
+        do
+        {
+            digits[count++] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        }
+        while (value > 0);
+
+        while (count > 0)
+            str += digits[--count];
+    }
+
+    static const char *httpMethodToCStr(const HttpMethod::Values &method)
+    {
+        switch (method)
+        {
+            case HttpMethod::PUT:  return "PUT";
+            case HttpMethod::POST: return "POST";
+            default:               return "GET";
+        }
+    }
+
+    void DeviceStatusRequests::renderHead(std::string &head, const HttpMethod::Values &method, const std::string &host, const unsigned long *deviceId)
+    {
+        head.clear();
+
+        head += httpMethodToCStr(method);
+        head += " deviceStatus";
+
+        if (deviceId != nullptr)
+        {
+            head += "?id=";
+            appendUnsigned(head, *deviceId);
+        }
+
+        head += " HTTP/1.1\r\nHost: ";
+        head += host;
+        head += "\r\n";
+    }
+
+    void DeviceStatusRequests::renderAccept(std::string &head, const char *accept)
+    {
+        head += "Accept: ";
+        head += accept;
+        head += "\r\n";
+    }
+
+    void DeviceStatusRequests::renderBodyHeaders(std::string &head, const char *contentType)
+    {
+        head += "Content-Type: ";
+        head += contentType;
+        head += "\r\nContent-Length: ";
+    }
+
+    void DeviceStatusRequests::render(const std::string &host, const unsigned long &deviceId, const char *accept, const char *contentType)
+    {
+        // PUT registers the device, so it goes without the ID
+        renderHead(registration, HttpMethod::PUT, host, nullptr);
+        renderAccept(registration, accept);
+        renderBodyHeaders(registration, contentType);
+
+        renderHead(status, HttpMethod::POST, host, &deviceId);
+        renderAccept(status, accept);
+        renderBodyHeaders(status, contentType);
+
+        // the poll is answered with the device's parameters, so it offers the same formats
+        renderHead(poll, HttpMethod::GET, host, &deviceId);
+        renderAccept(poll, accept);
+        poll += "\r\n";
+
+        renderHead(upgrade, HttpMethod::GET, host, &deviceId);
+        upgrade += "Upgrade: websocket\r\n"
+                   "Connection: Upgrade\r\n"
+                   "Sec-WebSocket-Version: 13\r\n"
+                   "Sec-WebSocket-Key: ";
+    }
+
+    const std::string &DeviceStatusRequests::write(std::string &request, const HttpMethod::Values &method, const std::string &body) const
+    {
+        request += method == HttpMethod::PUT ? registration : status;
+
+        appendUnsigned(request, body.length());
+
+        request += "\r\n\r\n";
+        request += body;
+
+        return request;
+    }
+
+    const std::string &DeviceStatusRequests::getPoll() const
+    {
+        return poll;
+    }
+
+    const std::string &DeviceStatusRequests::writeUpgrade(std::string &request, const std::string &key) const
+    {
+        request += upgrade;
+        request += key;
+        request += "\r\n\r\n";
+
+        return request;
+    }
+}
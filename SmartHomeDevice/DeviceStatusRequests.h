@@ -0,0 +1,34 @@
+#pragma once
+
+#include "HttpMessage.h"
+#include <string>
+
+namespace SmartHomeDevice_n
+{
+    using namespace HttpMessage_n;
+
+    // deviceStatus requests, pre-rendered. Request line and headers change only with the host, the device ID and the
+    // wire format, so they are rendered when one of those does; a request with a body is then just the template,
+    // Content-Length and the body. GET has no body, its template is the whole request
+    class DeviceStatusRequests
+    {
+    private:
+        std::string registration;   // PUT, up to the Content-Length value
+        std::string status;         // POST, same
+        std::string poll;           // GET
+        std::string upgrade;        // GET with the WebSocket handshake, up to the Sec-WebSocket-Key value
+
+        static void renderHead(std::string&, const HttpMethod::Values&, const std::string &host, const unsigned long *deviceId);
+        static void renderAccept(std::string&, const char *accept);
+        static void renderBodyHeaders(std::string&, const char *contentType);
+
+    public:
+        void render(const std::string &host, const unsigned long &deviceId, const char *accept, const char *contentType);
+
+        // PUT or POST with the body, appended to 'request'
+        const std::string &write(std::string &request, const HttpMethod::Values&, const std::string &body) const;
+        const std::string &getPoll() const;
+        // WebSocket upgrade with the key, appended to 'request'
+        const std::string &writeUpgrade(std::string &request, const std::string &key) const;
+    };
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+
+namespace SmartHomeDevice_n
+{
+    using PayloadSlot = unsigned char;
+
+    const PayloadSlot INVALID_PAYLOAD_SLOT = static_cast<PayloadSlot>(-1);
+
+    // fixed number of preallocated payloads with reference counters.
+    // Events carry only a slot number; whoever delivers the event releases its reference afterwards,
+    // and whoever forwards the same payload with another event takes one more reference instead of copying it.
+    // Not thread safe: payloads are owned by a single device loop
+    template <typename Payload, std::size_t SIZE>
+    class EventPayloadPool
+    {
+        static_assert(SIZE < INVALID_PAYLOAD_SLOT, "EventPayloadPool: too many slots");
+
+    private:
+        Payload       payloads[SIZE];
+        unsigned char refCounts[SIZE];
+        PayloadSlot   nextFree[SIZE];
+        PayloadSlot   firstFree;
+
+    public:
+        EventPayloadPool() : firstFree(0)
+        {
+            for (std::size_t slot = 0; slot < SIZE; slot++)
+            {
+                refCounts[slot] = 0;
+                nextFree[slot]  = (slot + 1 < SIZE) ? static_cast<PayloadSlot>(slot + 1) : INVALID_PAYLOAD_SLOT;
+            }
+        }
+
+        // returns INVALID_PAYLOAD_SLOT, when all slots are taken. The payload is not cleared, the caller fills it in
+        PayloadSlot acquire()
+        {
+            auto slot = firstFree;
+
+            if (slot != INVALID_PAYLOAD_SLOT)
+            {
+                firstFree       = nextFree[slot];
+                refCounts[slot] = 1;
+            }
+
+            return slot;
+        }
+
+        void addRef(const PayloadSlot &slot)
+        {
+            if ( (slot < SIZE) && (refCounts[slot] > 0) )
+                refCounts[slot]++;
+        }
+
+        void release(const PayloadSlot &slot)
+        {
+            if ( (slot < SIZE) && (refCounts[slot] > 0) && (--refCounts[slot] == 0) )
+            {
+                nextFree[slot] = firstFree;
+                firstFree      = slot;
+            }
+        }
+
+        Payload *get(const PayloadSlot &slot)
+        {
+            return ( (slot < SIZE) && (refCounts[slot] > 0) ) ? &payloads[slot] : nullptr;
+        }
+    };
+}
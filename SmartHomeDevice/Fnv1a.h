@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace SmartHomeDevice_n
+{
+    // FNV-1a, usable in case labels and static tables
+    constexpr uint32_t fnv1a(const char *str, const size_t &length)
+    {
+        uint32_t hash = 2166136261u;
+
+        for (size_t i = 0; i < length; i++)
+            hash = (hash ^ static_cast<unsigned char>(str[i])) * 16777619u;
+
+        return hash;
+    }
+
+    template <size_t N>
+    constexpr uint32_t fnv1a(const char (&str)[N])
+    {
+        return fnv1a(str, N - 1);
+    }
+}
@@ -0,0 +1,356 @@
+#include "HttpResponseParser.h"
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+namespace SmartHomeDevice_n
+{
+    static const size_t MAX_HTTP_LINE_LEN = 1024;
+    static const size_t MAX_HTTP_BODY_LEN = 64 * 1024;
+
+    static bool containsIgnoreCase(const std::string &str, const char *lowerCaseWord)
+    {
+        auto wordLength = strlen(lowerCaseWord);
+
+        for (size_t start = 0; start + wordLength <= str.size(); start++)
+        {
+            size_t i = 0;
+
+            while ( (i < wordLength) && (tolower(static_cast<unsigned char>(str[start + i])) == lowerCaseWord[i]) )
+                i++;
+
+            if (i == wordLength)
+                return true;
+        }
+
+        return false;
+    }
+
+    const std::string &HttpResponse::header(const std::string &lowerCaseName) const
+    {
+        return header(lowerCaseName.c_str());
+    }
+
+    const std::string &HttpResponse::header(const char *lowerCaseName) const
+    {
+        static const std::string empty;
+
+        for (const auto &header : headers)
+        {
+            if (header.first == lowerCaseName)
+                return header.second;
+        }
+
+        return empty;
+    }
+
+    HttpResponseParser::HttpResponseParser()
+    : consumed(0),
+      lineScanned(0),
+      state(STATUS_LINE),
+      bodyRemaining(0),
+      protocolError(false)
+    {
+    }
+
+    void HttpResponseParser::recycle(HttpResponse &response)
+    {
+        response.status = 0;
+        response.reason.clear();
+        response.body.clear();
+
+        for (auto &header : response.headers)
+            spareHeaders.push_back(std::move(header));
+
+        response.headers.clear();
+    }
+
+    void HttpResponseParser::feed(const std::string &data)
+    {
+        feed(data.data(), data.size());
+    }
+
+    void HttpResponseParser::feed(const char *data, const size_t &length)
+    {
+        // drop the consumed prefix only when new data arrives, so next() never moves memory
+        if (consumed > 0)
+        {
+            buffer.erase(0, consumed);
+            consumed = 0;
+        }
+
+        buffer.append(data, length);
+    }
+
+    bool HttpResponseParser::readLine(std::string &line)
+    {
+        // a CR at the very end of the scanned part may be followed by LF in the next piece, so it's scanned again
+        auto searchFrom = consumed + (lineScanned > 0 ? lineScanned - 1 : 0);
+        auto lineEnd    = buffer.find("\r\n", searchFrom);
+
+        if (lineEnd == std::string::npos)
+        {
+            lineScanned = buffer.size() - consumed;
+
+            if (lineScanned > MAX_HTTP_LINE_LEN)
+                protocolError = true;
+
+            return false;
+        }
+
+        line.assign(buffer, consumed, lineEnd - consumed);
+
+        consumed    = lineEnd + 2;
+        lineScanned = 0;
+
+        return true;
+    }
+
+    bool HttpResponseParser::parseStatusLine(const std::string &line)
+    {
+        // HTTP/1.1 200 OK
+        if (line.compare(0, 5, "HTTP/") != 0)
+            return false;
+
+        auto statusStart = line.find(' ');
+
+        if ( (statusStart == std::string::npos) || (line.size() < statusStart + 4) )
+            return false;
+
+        unsigned short status = 0;
+
+        for (size_t i = statusStart + 1; i < statusStart + 4; i++)
+        {
+            if (!isdigit(static_cast<unsigned char>(line[i])))
+                return false;
+
+            status = static_cast<unsigned short>(status * 10 + (line[i] - '0'));
+        }
+
+        current.status = status;
+
+        if (line.size() > statusStart + 5)
+            current.reason.assign(line, statusStart + 5, std::string::npos);
+        else
+            current.reason.clear();
+
+        return true;
+    }
+
+    void HttpResponseParser::parseHeader(const std::string &line)
+    {
+        auto colon = line.find(':');
+
+        if (colon == std::string::npos)
+            return;
+
+        if (spareHeaders.empty())
+            current.headers.emplace_back();
+        else
+        {
+            current.headers.push_back(std::move(spareHeaders.back()));
+            spareHeaders.pop_back();
+        }
+
+        auto &name  = current.headers.back().first;
+        auto &value = current.headers.back().second;
+
+        auto valueStart = line.find_first_not_of(" \t", colon + 1);
+        auto valueEnd   = line.find_last_not_of(" \t");
+
+        name.assign(line, 0, colon);
+
+        if (valueStart != std::string::npos)
+            value.assign(line, valueStart, valueEnd - valueStart + 1);
+        else
+            value.clear();
+
+        for (auto &c : name)
+            c = static_cast<char>(tolower(c));
+    }
+
+    // hex digits, then optionally extensions after ';'. Anything else isn't a chunk size: a garbage line mustn't pass for the last chunk
+    bool HttpResponseParser::parseChunkSize(const std::string &line, size_t &size)
+    {
+        size_t digits = 0;
+
+        size = 0;
+
+        for (; (digits < line.size()) && isxdigit(static_cast<unsigned char>(line[digits])); digits++)
+        {
+            auto c = static_cast<unsigned char>(tolower(static_cast<unsigned char>(line[digits])));
+
+            size = size * 16 + (isdigit(c) ? c - '0' : c - 'a' + 10);
+
+            // larger than any body may be; this also keeps the value from overflowing
+            if (size > MAX_HTTP_BODY_LEN)
+                return false;
+        }
+
+        if (digits == 0)
+            return false;
+
+        return (digits == line.size()) || (line[digits] == ';') || (line[digits] == ' ') || (line[digits] == '\t');
+    }
+
+    void HttpResponseParser::startBody()
+    {
+        if (containsIgnoreCase(current.header("transfer-encoding"), "chunked"))
+        {
+            state = CHUNK_SIZE;
+            return;
+        }
+
+        const auto &contentLength = current.header("content-length");
+
+        bodyRemaining = contentLength.empty() ? 0 : std::strtoul(contentLength.c_str(), nullptr, 10);
+
+        // 1xx, 204 and 304 never have a body
+        if ( (current.status < 200) || (current.status == 204) || (current.status == 304) )
+            bodyRemaining = 0;
+
+        if (bodyRemaining > MAX_HTTP_BODY_LEN)
+            protocolError = true;
+
+        state = BODY;
+    }
+
+    bool HttpResponseParser::next(HttpResponse &response)
+    {
+        while (!protocolError)
+        {
+            switch (state)
+            {
+                case STATUS_LINE:
+                    if (!readLine(line))
+                        return false;
+
+                    // tolerate empty lines between responses
+                    if (line.empty())
+                        break;
+
+                    recycle(current);
+
+                    if (!parseStatusLine(line))
+                    {
+                        protocolError = true;
+                        return false;
+                    }
+
+                    state = HEADERS;
+                    break;
+
+                case HEADERS:
+                    if (!readLine(line))
+                        return false;
+
+                    if (line.empty())
+                        startBody();
+                    else
+                        parseHeader(line);
+                    break;
+
+                case BODY:
+                {
+                    auto available = buffer.size() - consumed;
+
+                    if (available < bodyRemaining)
+                        return false;
+
+                    current.body.assign(buffer, consumed, bodyRemaining);
+                    consumed += bodyRemaining;
+
+                    // the caller's previous response becomes 'current', and is recycled with the next status line
+                    std::swap(response, current);
+                    state = STATUS_LINE;
+
+                    return true;
+                }
+
+                case CHUNK_SIZE:
+                    if (!readLine(line))
+                        return false;
+
+                    if (!parseChunkSize(line, bodyRemaining) || (current.body.size() + bodyRemaining > MAX_HTTP_BODY_LEN))
+                    {
+                        protocolError = true;
+                        return false;
+                    }
+
+                    state = bodyRemaining > 0 ? CHUNK_DATA : TRAILERS;
+                    break;
+
+                case CHUNK_DATA:
+                {
+                    auto available = buffer.size() - consumed;
+                    auto length    = available < bodyRemaining ? available : bodyRemaining;
+
+                    // chunk data is moved into the body as it arrives, so it's never looked at twice
+                    current.body.append(buffer, consumed, length);
+                    consumed      += length;
+                    bodyRemaining -= length;
+
+                    if (bodyRemaining > 0)
+                        return false;
+
+                    state = CHUNK_DATA_END;
+                    break;
+                }
+
+                case CHUNK_DATA_END:
+                    if (!readLine(line))
+                        return false;
+
+                    if (!line.empty())
+                    {
+                        protocolError = true;
+                        return false;
+                    }
+
+                    state = CHUNK_SIZE;
+                    break;
+
+                case TRAILERS:
+                    if (!readLine(line))
+                        return false;
+
+                    if (line.empty())
+                    {
+                        std::swap(response, current);
+                        state = STATUS_LINE;
+
+                        return true;
+                    }
+                    break;
+            }
+        }
+
+        return false;
+    }
+
+    void HttpResponseParser::reset()
+    {
+        buffer.clear();
+        recycle(current);
+
+        consumed      = 0;
+        lineScanned   = 0;
+        state         = STATUS_LINE;
+        bodyRemaining = 0;
+        protocolError = false;
+    }
+
+    std::string HttpResponseParser::takeRemainder()
+    {
+        auto remainder = buffer.substr(consumed);
+
+        reset();
+
+        return remainder;
+    }
+
+    bool HttpResponseParser::hasProtocolError() const
+    {
+        return protocolError;
+    }
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstddef>
+
+namespace SmartHomeDevice_n
+{
+    struct HttpResponse
+    {
+        unsigned short status;      // numeric status code, e.g. 200
+        std::string    reason;
+        std::string    body;
+
+        std::vector<std::pair<std::string, std::string>> headers;   // names are lower case
+
+        const std::string &header(const std::string &lowerCaseName) const;   // empty string if there is no such header
+        const std::string &header(const char *lowerCaseName) const;
+    };
+
+    // incremental HTTP/1.1 response framing. Data may be fed in arbitrary pieces: half a response, or several
+    // pipelined ones at once. Bodies are framed by Content-Length or chunked transfer encoding; responses without
+    // either are taken to have no body. Bytes are scanned only once, a partial response is resumed where it stopped.
+    // Strings are reused from one response to the next: next() swaps the finished response with the one passed in,
+    // so a caller, which keeps passing the same HttpResponse, doesn't cause any allocations once the buffers have grown
+    class HttpResponseParser
+    {
+    private:
+        enum ParseState : unsigned char
+        {
+            STATUS_LINE,
+            HEADERS,
+            BODY,
+            CHUNK_SIZE,
+            CHUNK_DATA,
+            CHUNK_DATA_END,
+            TRAILERS
+        };
+
+        std::string  buffer;
+        std::string  line;
+        size_t       consumed;          // bytes of 'buffer', which belong to responses already parsed (or to the current one)
+        size_t       lineScanned;       // bytes after 'consumed', which are known not to contain the end of the line
+        ParseState   state;
+        HttpResponse current;
+        size_t       bodyRemaining;     // for BODY and CHUNK_DATA
+        bool         protocolError;
+
+        std::vector<std::pair<std::string, std::string>> spareHeaders;   // of earlier responses, reused with their capacity
+
+        void recycle(HttpResponse&);
+        bool readLine(std::string&);
+        bool parseStatusLine(const std::string&);
+        void parseHeader(const std::string&);
+        void startBody();
+
+        static bool parseChunkSize(const std::string&, size_t&);
+
+    public:
+        HttpResponseParser();
+
+        void feed(const std::string&);
+        void feed(const char*, const size_t&);
+        bool next(HttpResponse&);
+        void reset();
+
+        // bytes fed after the last complete response, e.g. WebSocket frames following 101 Switching Protocols.
+        // The parser is reset afterwards
+        std::string takeRemainder();
+
+        bool hasProtocolError() const;
+    };
+}
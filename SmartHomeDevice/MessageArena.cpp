@@ -0,0 +1,83 @@
+#include "MessageArena.h"
+
+namespace SmartHomeDevice_n
+{
+    MessageArena::WriterBuffer::WriterBuffer()
+    : stackAllocator(stackBuffer, WRITER_STACK_SIZE),
+      stackCapacity(stackAllocator.Capacity()),
+      reservedSize(0)
+    {
+    }
+
+    MessageArena::MessageArena() : reservedFrameSize(0), overflows(0) { }
+
+    void MessageArena::init(const size_t &messageSize)
+    {
+        // an embedded value is a part of the message, so it never needs more room than the message itself
+        message.text.reserve(messageSize);
+        embedded.text.reserve(messageSize);
+        frame.reserve(messageSize + FRAME_OVERHEAD);
+
+        message.reservedSize  = message.text.capacity();
+        embedded.reservedSize = embedded.text.capacity();
+        reservedFrameSize     = frame.capacity();
+    }
+
+    void MessageArena::checkReservation(const std::string &buffer, size_t &reservedSize)
+    {
+        // without a reservation growing is the normal way of finding the size, not an overflow
+        if ( (reservedSize > 0) && (buffer.capacity() > reservedSize) )
+        {
+            overflows++;
+            reservedSize = buffer.capacity();
+        }
+    }
+
+    std::string &MessageArena::start(WriterBuffer &buffer)
+    {
+        checkReservation(buffer.text, buffer.reservedSize);
+
+        // chunks taken from the heap, once the stack buffer was exhausted, are released here
+        if ( (buffer.reservedSize > 0) && (buffer.stackAllocator.Capacity() > buffer.stackCapacity) )
+            overflows++;
+
+        buffer.stackAllocator.Clear();
+        buffer.text.clear();
+
+        return buffer.text;
+    }
+
+    std::string &MessageArena::startMessage()
+    {
+        return start(message);
+    }
+
+    std::string &MessageArena::startEmbedded()
+    {
+        return start(embedded);
+    }
+
+    std::string &MessageArena::startFrame()
+    {
+        checkReservation(frame, reservedFrameSize);
+
+        frame.clear();
+
+        return frame;
+    }
+
+    ArenaStackAllocator *MessageArena::messageWriterStack()
+    {
+        return &message.stackAllocator;
+    }
+
+    ArenaStackAllocator *MessageArena::embeddedWriterStack()
+    {
+        return &embedded.stackAllocator;
+    }
+
+    unsigned long MessageArena::getOverflows() const
+    {
+        return overflows;
+    }
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "rapidjson/allocators.h"
+#include <cstddef>
+#include <string>
+
+namespace SmartHomeDevice_n
+{
+    // rapidjson output stream, which appends to a string. Unlike StringBuffer, the string keeps its capacity between messages
+    struct StringOutputStream
+    {
+        typedef char Ch;
+
+        std::string &str;
+
+        explicit StringOutputStream(std::string &str) : str(str) { }
+
+        void Put(const Ch c) { str.push_back(c); }
+        void Flush() { }
+    };
+
+    using ArenaStackAllocator = rapidjson::MemoryPoolAllocator<>;
+
+    // scratch memory for outbound messages: the encoded payload, parameters embedded into it as strings (LEGACY payload format),
+    // and the HTTP request or WebSocket frame carrying it. Buffers are reset per message and keep their capacity, so once they
+    // have grown to the largest message (or init() has reserved that much up front) sending doesn't allocate. Nesting stacks
+    // of the JSON writers live in fixed buffers. A message, which doesn't fit into the reservation, still goes out; the buffer
+    // grows and it's counted as an overflow. The next start...() of the same buffer invalidates what the previous one returned
+    class MessageArena
+    {
+    private:
+        static const size_t WRITER_STACK_SIZE = 1024;   // rapidjson::Writer takes 16 bytes per nesting level, for 32 levels at first
+        static const size_t FRAME_OVERHEAD    = 256;    // request line and headers, or WebSocket frame header
+
+        // text written by a rapidjson::Writer, together with the writer's nesting stack
+        struct WriterBuffer
+        {
+            alignas(8) char     stackBuffer[WRITER_STACK_SIZE];
+            ArenaStackAllocator stackAllocator;
+            size_t              stackCapacity;
+            std::string         text;
+            size_t              reservedSize;   // 0 until init()
+
+            WriterBuffer();
+        };
+
+        WriterBuffer  message;
+        WriterBuffer  embedded;
+        std::string   frame;
+        size_t        reservedFrameSize;
+        unsigned long overflows;
+
+        void checkReservation(const std::string&, size_t &reservedSize);
+        std::string &start(WriterBuffer&);
+
+    public:
+        MessageArena();
+
+        MessageArena(const MessageArena&) = delete;
+        MessageArena &operator=(const MessageArena&) = delete;
+
+        // reserves room for messages up to the given size. The only allocations the arena makes on its own
+        void init(const size_t &messageSize);
+
+        std::string &startMessage();                    // empty payload buffer
+        std::string &startEmbedded();                   // empty buffer for a value rendered on its own and embedded into the payload
+        std::string &startFrame();                      // empty buffer for the request / frame carrying the payload
+
+        // for the rapidjson::Writer of the payload / embedded value; reset by startMessage() / startEmbedded()
+        ArenaStackAllocator *messageWriterStack();
+        ArenaStackAllocator *embeddedWriterStack();
+
+        unsigned long getOverflows() const;
+    };
+}
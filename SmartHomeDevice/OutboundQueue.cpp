@@ -0,0 +1,218 @@
+#include "OutboundQueue.h"
+
+namespace SmartHomeDevice_n
+{
+    OutboundQueue::OutboundQueue() : nextSequence(0), statistics()
+    {
+        for (auto &entry : entries)
+            entry.used = false;
+    }
+
+    unsigned char OutboundQueue::priorityOf(const OutboundKind::Values &kind)
+    {
+        // lower goes first
+        switch (kind)
+        {
+            case OutboundKind::DEVICE_ONLINE:     return 0;
+            case OutboundKind::WEBSOCKET_UPGRADE: return 0;
+            case OutboundKind::PARAMETER_ADDED:   return 1;
+            case OutboundKind::PARAMETER_CHANGED: return 1;
+            default:                              return 2;
+        }
+    }
+
+    int OutboundQueue::find(const OutboundKind::Values &kind, const ParamHandle &param) const
+    {
+        for (int i = 0; i < MAX_OUTBOUND_MESSAGES; i++)
+        {
+            if (!entries[i].used || (entries[i].param != param))
+                continue;
+
+            // parameterAdded carries the current value as well
+            if ( (entries[i].kind == kind) || ((kind == OutboundKind::PARAMETER_CHANGED) && (entries[i].kind == OutboundKind::PARAMETER_ADDED)) )
+                return i;
+        }
+
+        return -1;
+    }
+
+    int OutboundQueue::findFree() const
+    {
+        for (int i = 0; i < MAX_OUTBOUND_MESSAGES; i++)
+        {
+            if (!entries[i].used)
+                return i;
+        }
+
+        return -1;
+    }
+
+    int OutboundQueue::findEvictable(const OutboundKind::Values &kind) const
+    {
+        int evictable = -1;
+
+        for (int i = 0; i < MAX_OUTBOUND_MESSAGES; i++)
+        {
+            if ( !entries[i].used || (priorityOf(entries[i].kind) <= priorityOf(kind)) )
+                continue;
+
+            if ( (evictable < 0) ||
+                 (priorityOf(entries[i].kind) > priorityOf(entries[evictable].kind)) ||
+                 ((priorityOf(entries[i].kind) == priorityOf(entries[evictable].kind)) && (entries[i].sequence > entries[evictable].sequence)) )
+                evictable = i;
+        }
+
+        return evictable;
+    }
+
+    // entry sent right after the given one, or the front for -1
+    int OutboundQueue::findAfter(const int &previous) const
+    {
+        auto goesFirst = [this](const int &a, const int &b) -> bool
+        {
+            return (priorityOf(entries[a].kind) < priorityOf(entries[b].kind)) ||
+                   ((priorityOf(entries[a].kind) == priorityOf(entries[b].kind)) && (entries[a].sequence < entries[b].sequence));
+        };
+
+        int next = -1;
+
+        for (int i = 0; i < MAX_OUTBOUND_MESSAGES; i++)
+        {
+            if ( !entries[i].used || ((previous >= 0) && !goesFirst(previous, i)) )
+                continue;
+
+            if ( (next < 0) || goesFirst(i, next) )
+                next = i;
+        }
+
+        return next;
+    }
+
+    int OutboundQueue::findFront() const
+    {
+        return findAfter(-1);
+    }
+
+    void OutboundQueue::remove(const int &index)
+    {
+        entries[index].used = false;
+        statistics.depth--;
+    }
+
+    bool OutboundQueue::canPush(const OutboundKind::Values &kind, const ParamHandle &param) const
+    {
+        return (find(kind, param) >= 0) || (statistics.depth < MAX_OUTBOUND_MESSAGES) || (findEvictable(kind) >= 0);
+    }
+
+    bool OutboundQueue::push(const OutboundKind::Values &kind, const ParamHandle &param)
+    {
+        if (find(kind, param) >= 0)
+        {
+            statistics.superseded++;
+            return true;
+        }
+
+        auto index = findFree();
+
+        if (index < 0)
+        {
+            index = findEvictable(kind);
+
+            if (index < 0)
+            {
+                statistics.rejected++;
+                return false;
+            }
+
+            remove(index);
+            statistics.evicted++;
+        }
+
+        entries[index].used     = true;
+        entries[index].kind     = kind;
+        entries[index].param    = param;
+        entries[index].sequence = nextSequence++;
+
+        if (++statistics.depth > statistics.maxDepth)
+            statistics.maxDepth = statistics.depth;
+
+        return true;
+    }
+
+    bool OutboundQueue::front(OutboundKind::Values &kind, ParamHandle &param) const
+    {
+        auto index = findFront();
+
+        if (index < 0)
+            return false;
+
+        kind  = entries[index].kind;
+        param = entries[index].param;
+
+        return true;
+    }
+
+    bool OutboundQueue::peek(const size_t &position, OutboundKind::Values &kind, ParamHandle &param) const
+    {
+        auto index = findFront();
+
+        for (size_t i = 0; (i < position) && (index >= 0); i++)
+            index = findAfter(index);
+
+        if (index < 0)
+            return false;
+
+        kind  = entries[index].kind;
+        param = entries[index].param;
+
+        return true;
+    }
+
+    void OutboundQueue::pop(const size_t &count)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            auto index = findFront();
+
+            if (index < 0)
+                return;
+
+            remove(index);
+        }
+    }
+
+    void OutboundQueue::supersede(const OutboundKind::Values &kind)
+    {
+        for (int i = 0; i < MAX_OUTBOUND_MESSAGES; i++)
+        {
+            if (entries[i].used && (entries[i].kind == kind))
+            {
+                remove(i);
+                statistics.superseded++;
+            }
+        }
+    }
+
+    size_t OutboundQueue::count(const OutboundKind::Values &kind) const
+    {
+        size_t count = 0;
+
+        for (const auto &entry : entries)
+        {
+            if (entry.used && (entry.kind == kind))
+                count++;
+        }
+
+        return count;
+    }
+
+    bool OutboundQueue::empty() const
+    {
+        return statistics.depth == 0;
+    }
+
+    const OutboundQueueStatistics &OutboundQueue::getStatistics() const
+    {
+        return statistics;
+    }
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "DeviceParameterRegistry.h"
+#include <cstddef>
+
+namespace SmartHomeDevice_n
+{
+    // messages waiting for the server, see OutboundQueue
+    #define MAX_OUTBOUND_MESSAGES 32
+
+    namespace OutboundKind
+    {
+        enum Values : unsigned char
+        {
+            DEVICE_ONLINE,          // registration, carries current values of all parameters
+            WEBSOCKET_UPGRADE,      // once registered; everything queued behind it goes out through the WebSocket
+            PARAMETER_ADDED,
+            PARAMETER_CHANGED,
+            STATUS_POLL,
+
+            COUNT
+        };
+    };
+
+    struct OutboundQueueStatistics
+    {
+        unsigned char depth;       // entries waiting right now
+        unsigned char maxDepth;
+        unsigned long superseded;  // not queued, or taken out, because a newer entry reports the same
+        unsigned long evicted;     // lower priority entries pushed out by higher priority ones, while the queue was full
+        unsigned long rejected;    // pushes refused while the queue was full; the caller has been told
+    };
+
+    // Messages for the server in a fixed number of slots, in priority order: deviceOnline and the WebSocket upgrade, then parameter events, then status
+    // polls; FIFO within the same priority. An entry names what is to be reported, the message is encoded when it's sent,
+    // so a parameter queued while the connection is down goes out with its latest value and in the format of the new
+    // connection. The same parameter is never queued twice for the same event. When all slots are taken, a push evicts
+    // the newest entry of the lowest priority below its own, or is refused; the queue never grows. Not thread safe, like the device loop
+    class OutboundQueue
+    {
+    private:
+        struct Entry
+        {
+            bool                 used;
+            OutboundKind::Values kind;
+            ParamHandle          param;
+            unsigned long        sequence;
+        };
+
+        Entry                   entries[MAX_OUTBOUND_MESSAGES];
+        unsigned long           nextSequence;
+        OutboundQueueStatistics statistics;
+
+        static unsigned char priorityOf(const OutboundKind::Values&);
+
+        int find(const OutboundKind::Values&, const ParamHandle&) const;
+        int findFree() const;
+        int findEvictable(const OutboundKind::Values&) const;
+        int findAfter(const int&) const;
+        int findFront() const;
+        void remove(const int&);
+
+    public:
+        OutboundQueue();
+
+        // true if push() would take the entry, either into a slot or merged with one already queued
+        bool canPush(const OutboundKind::Values&, const ParamHandle &param = INVALID_PARAM_HANDLE) const;
+        bool push(const OutboundKind::Values&, const ParamHandle &param = INVALID_PARAM_HANDLE);
+
+        // entry of the highest priority, queued first. False if the queue is empty
+        bool front(OutboundKind::Values&, ParamHandle&) const;
+        // entry at the position in sending order, 0 being the front. False if there are not as many
+        bool peek(const size_t&, OutboundKind::Values&, ParamHandle&) const;
+        void pop(const size_t &count = 1);
+
+        // e.g. deviceOnline reports every parameter, so their queued events are superseded
+        void supersede(const OutboundKind::Values&);
+
+        size_t count(const OutboundKind::Values&) const;
+        bool empty() const;
+
+        const OutboundQueueStatistics &getStatistics() const;
+    };
+}
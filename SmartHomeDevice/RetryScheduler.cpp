@@ -0,0 +1,133 @@
+#include "RetryScheduler.h"
+
+namespace SmartHomeDevice_n
+{
+    RetryScheduler::RetryScheduler(const unsigned int &base, const unsigned int &cap, const unsigned int &tick, std::function<unsigned int()> currentTime)
+    : base(base),
+      cap(cap > base ? cap : base),
+      tick(tick > 0 ? tick : 1),
+      currentTime(currentTime),
+      timerManager(nullptr),
+      tickTimer(INVALID_TIMER_HANDLE),
+      randomState(1),
+      pending(false),
+      dueAt(0),
+      statistics()
+    {
+        statistics.currentBackoff = base;
+    }
+
+    void RetryScheduler::init(TimerManager *timerManager, const uint32_t &seed)
+    {
+        this->timerManager = timerManager;
+
+        // xorshift gets stuck at 0
+        randomState = seed != 0 ? seed : 0x9E3779B9u;
+
+        if ( (timerManager != nullptr) && enabled() && (tickTimer == INVALID_TIMER_HANDLE) )
+            tickTimer = timerManager->createTimer(tick);
+    }
+
+    bool RetryScheduler::enabled() const
+    {
+        return base > 0;
+    }
+
+    uint32_t RetryScheduler::nextRandom()
+    {
+        // xorshift32: only has to decorrelate devices, not to be unpredictable
+        randomState ^= randomState << 13;
+        randomState ^= randomState >> 17;
+        randomState ^= randomState << 5;
+
+        return randomState;
+    }
+
+    unsigned int RetryScheduler::backoffFor(const unsigned char &failures) const
+    {
+        auto backoff = base;
+
+        for (unsigned char i = 0; (i < failures) && (backoff < cap); i++)
+            backoff *= 2;
+
+        return backoff < cap ? backoff : cap;
+    }
+
+    unsigned int RetryScheduler::schedule(const RetryKind::Values &kind)
+    {
+        statistics.retries[kind]++;
+
+        if (!enabled() || (tickTimer == INVALID_TIMER_HANDLE))
+        {
+            statistics.lastDelay = 0;
+            return 0;
+        }
+
+        auto backoff = backoffFor(statistics.consecutiveFailures);
+
+        if (statistics.consecutiveFailures < 255)
+            statistics.consecutiveFailures++;
+
+        // full jitter: anything between now and the backoff
+        auto delay = nextRandom() % (backoff + 1);
+
+        statistics.currentBackoff = backoffFor(statistics.consecutiveFailures);
+        statistics.lastDelay      = delay;
+
+        if (delay == 0)
+            return 0;
+
+        pending = true;
+        dueAt   = currentTime() + delay;
+
+        timerManager->restartTimer(tickTimer);
+
+        return delay;
+    }
+
+    void RetryScheduler::cancel()
+    {
+        pending = false;
+
+        if (tickTimer != INVALID_TIMER_HANDLE)
+            timerManager->stopTimer(tickTimer);
+    }
+
+    bool RetryScheduler::isPending() const
+    {
+        return pending;
+    }
+
+    void RetryScheduler::succeeded()
+    {
+        statistics.consecutiveFailures = 0;
+        statistics.currentBackoff      = base;
+    }
+
+    bool RetryScheduler::isTimer(const TimerHandle &timer) const
+    {
+        return (tickTimer != INVALID_TIMER_HANDLE) && (timer == tickTimer);
+    }
+
+    bool RetryScheduler::onTimer()
+    {
+        if (!pending)
+            return false;
+
+        // wrap-safe: the difference is less than 'cap' while waiting
+        if (static_cast<int>(currentTime() - dueAt) >= 0)
+        {
+            pending = false;
+            return true;
+        }
+
+        timerManager->restartTimer(tickTimer);
+
+        return false;
+    }
+
+    const RetryStatistics &RetryScheduler::getStatistics() const
+    {
+        return statistics;
+    }
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "TimerManager.h"
+#include <cstdint>
+#include <functional>
+
+namespace SmartHomeDevice_n
+{
+    using namespace TimerManager_n;
+
+    namespace RetryKind
+    {
+        enum Values : unsigned char
+        {
+            WIFI_CONNECTION,    // next attempt to associate with the same network
+            SERVER_CONNECTION,  // next host in the same connection round
+            RECONNECT,          // connection has been lost or given up on: start over with the scan
+
+            COUNT
+        };
+    };
+
+    struct RetryStatistics
+    {
+        unsigned long retries[RetryKind::COUNT];   // scheduled so far
+        unsigned char consecutiveFailures;         // since the last success, the exponent of the backoff
+        unsigned int  currentBackoff;              // ms, upper bound of the delay of the next retry
+        unsigned int  lastDelay;                   // ms, delay of the latest retry
+    };
+
+    // Delays retries with exponential backoff and full jitter: the n-th retry after a success waits for a random time
+    // in [0, min(cap, base * 2^n)]. Devices, which have lost the server at the same moment, spread their reconnects
+    // over the whole window instead of coming back in lockstep. A single retry is pending at a time; it's timed with
+    // a periodic TimerManager timer, so the delay is as precise as the tick
+    class RetryScheduler
+    {
+    private:
+        unsigned int                  base;
+        unsigned int                  cap;
+        unsigned int                  tick;
+        std::function<unsigned int()> currentTime;
+        TimerManager                 *timerManager;
+        TimerHandle                   tickTimer;
+        uint32_t                      randomState;
+        bool                          pending;
+        unsigned int                  dueAt;
+        RetryStatistics               statistics;
+
+        uint32_t nextRandom();
+        unsigned int backoffFor(const unsigned char &failures) const;
+
+    public:
+        // base 0 disables the backoff: retries are due right away
+        RetryScheduler(const unsigned int &base, const unsigned int &cap, const unsigned int &tick, std::function<unsigned int()> currentTime);
+
+        // the timer can only be created once TimerManager exists; seed should differ between devices
+        void init(TimerManager*, const uint32_t &seed);
+
+        bool enabled() const;
+
+        // counts a failure and returns the delay of the retry. Unless it's 0, the retry is pending until onTimer() reports it's due
+        unsigned int schedule(const RetryKind::Values&);
+        void cancel();
+        bool isPending() const;
+
+        // connection has been established and accepted: the backoff starts from 'base' again
+        void succeeded();
+
+        bool isTimer(const TimerHandle&) const;
+        // called when the tick timer expires. Returns true once the pending retry is due
+        bool onTimer();
+
+        const RetryStatistics &getStatistics() const;
+    };
+}
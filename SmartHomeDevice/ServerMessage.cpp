@@ -0,0 +1,304 @@
+#include "ServerMessage.h"
+#include "Cbor.h"
+#include "rapidjson/reader.h"
+#include <cstdio>
+#include <cstring>
+
+namespace SmartHomeDevice_n
+{
+    using namespace rapidjson;
+
+    bool JsonStringRef::equals(const char *other) const
+    {
+        return (strlen(other) == length) && (strncmp(str, other, length) == 0);
+    }
+
+    class ServerMessageHandler : public BaseReaderHandler<UTF8<>, ServerMessageHandler>
+    {
+    private:
+        enum Section : unsigned char
+        {
+            ROOT,
+            RESPONSE_DATA,
+            PARAMETER,
+            OTHER
+        };
+
+        ServerMessage &message;
+        unsigned int   depth;
+        Section        section;
+        uint32_t       key;
+        char          *responseDataStr;   // legacy: responseData embedded as a JSON string
+
+        void setString(const char *str, const SizeType &length)
+        {
+            JsonStringRef value = {str, length};
+
+            if ( (depth == 1) && (key == fnv1a("eventName")) )
+            {
+                message.eventName     = value;
+                message.eventNameHash = fnv1a(str, length);
+            }
+            else if ( (depth == 1) && (key == fnv1a("responseData")) )
+                responseDataStr = const_cast<char*>(str);
+            else if ( (depth == 2) && (section == RESPONSE_DATA) && (key == fnv1a("payloadFormat")) )
+                message.payloadFormat = value;
+            else if ( (depth == 2) && (section == PARAMETER) && (key == fnv1a("name")) )
+                message.paramName = value;
+            else if (isParamValue())
+                setParamValue(str, length);
+        }
+
+        bool isParamValue() const
+        {
+            return (depth == 2) && (section == PARAMETER) && ( (key == fnv1a("currentValue")) || (key == fnv1a("value")) );
+        }
+
+        void setParamValue(const char *str, const size_t &length)
+        {
+            message.paramValue    = {str, length};
+            message.hasParamValue = true;
+        }
+
+        // numbers are set as they would be typed into a TEXTBOX
+        template <typename Number>
+        bool formatParamValue(const char *format, const Number &value)
+        {
+            auto length = snprintf(message.paramValueText, sizeof(message.paramValueText), format, value);
+
+            if ( (length > 0) && (static_cast<size_t>(length) < sizeof(message.paramValueText)) )
+                setParamValue(message.paramValueText, static_cast<size_t>(length));
+
+            return true;
+        }
+
+        bool setNumber(const uint64_t &value)
+        {
+            if ( (depth == 2) && (section == RESPONSE_DATA) && (key == fnv1a("deviceId")) )
+            {
+                message.hasDeviceId = true;
+                message.deviceId    = static_cast<unsigned long>(value);
+            }
+
+            return true;
+        }
+
+    public:
+        ServerMessageHandler(ServerMessage &message, const unsigned int &depth, const Section &section)
+        : message(message), depth(depth), section(section), key(0), responseDataStr(nullptr)
+        {
+        }
+
+        // nested parse of the legacy responseData string: its members are treated as if the object was embedded
+        static ServerMessageHandler forResponseData(ServerMessage &message)
+        {
+            return ServerMessageHandler(message, 1, RESPONSE_DATA);
+        }
+
+        static ServerMessageHandler forMessage(ServerMessage &message)
+        {
+            return ServerMessageHandler(message, 0, ROOT);
+        }
+
+        char *getResponseDataStr() const { return responseDataStr; }
+
+        bool Default()                       { return true; }
+        bool Int(int value)                  { return isParamValue() ? formatParamValue("%d", value) : value >= 0 ? setNumber(static_cast<uint64_t>(value)) : true; }
+        bool Uint(unsigned value)            { return isParamValue() ? formatParamValue("%u", value) : setNumber(value); }
+        bool Int64(int64_t value)            { return isParamValue() ? formatParamValue("%lld", static_cast<long long>(value)) : value >= 0 ? setNumber(static_cast<uint64_t>(value)) : true; }
+        bool Uint64(uint64_t value)          { return isParamValue() ? formatParamValue("%llu", static_cast<unsigned long long>(value)) : setNumber(value); }
+        bool Double(double value)            { return isParamValue() ? formatParamValue("%.15g", value) : true; }
+
+        bool Bool(bool value)
+        {
+            if (isParamValue())
+                setParamValue(value ? "true" : "false", value ? 4 : 5);
+
+            return true;
+        }
+
+        bool String(const char *str, SizeType length, bool)
+        {
+            setString(str, length);
+            return true;
+        }
+
+        bool Key(const char *str, SizeType length, bool)
+        {
+            key = fnv1a(str, length);
+            return true;
+        }
+
+        bool StartObject()
+        {
+            if ( (depth == 1) && (section == ROOT) )
+            {
+                if (key == fnv1a("responseData"))
+                    section = RESPONSE_DATA;
+                else if (key == fnv1a("parameter"))
+                    section = PARAMETER;
+                else
+                    section = OTHER;
+            }
+
+            depth++;
+            key = 0;
+
+            return true;
+        }
+
+        bool EndObject(SizeType)
+        {
+            depth--;
+
+            if (depth == 1)
+                section = ROOT;
+
+            key = 0;
+
+            return true;
+        }
+
+        bool StartArray()
+        {
+            depth++;
+            return true;
+        }
+
+        bool EndArray(SizeType)
+        {
+            depth--;
+            return true;
+        }
+    };
+
+    static void clearServerMessage(ServerMessage &message)
+    {
+        message = ServerMessage();
+        message.eventName     = {"", 0};
+        message.payloadFormat = {"", 0};
+        message.paramName     = {"", 0};
+        message.paramValue    = {"", 0};
+    }
+
+    bool parseServerMessage(char *buffer, ServerMessage &message)
+    {
+        clearServerMessage(message);
+
+        Reader reader;
+
+        InsituStringStream stream(buffer);
+
+        auto handler = ServerMessageHandler::forMessage(message);
+
+        if (reader.Parse<kParseInsituFlag>(stream, handler).IsError())
+            return false;
+
+        // older servers send responseData as a JSON document in a string. It's already unescaped in place, so it's parsed right there
+        if (handler.getResponseDataStr() != nullptr)
+        {
+            InsituStringStream responseDataStream(handler.getResponseDataStr());
+
+            auto responseDataHandler = ServerMessageHandler::forResponseData(message);
+
+            Reader responseDataReader;
+
+            // not a JSON document (e.g. empty): no response data
+            (void)responseDataReader.Parse<kParseInsituFlag>(responseDataStream, responseDataHandler);
+        }
+
+        return true;
+    }
+
+    // reads the members of the map at the current position. 'onMember' consumes the value of the members it knows
+    template <typename OnMember>
+    static bool readCborMap(CborReader &reader, OnMember onMember)
+    {
+        CborContainer map;
+
+        if (!reader.enterMap(map))
+            return false;
+
+        while (reader.next(map))
+        {
+            JsonStringRef key;
+
+            if (!reader.readText(key.str, key.length) || !reader.next(map))
+                return false;
+
+            if (!onMember(fnv1a(key.str, key.length)))
+                reader.skip();
+
+            if (reader.hasError())
+                return false;
+        }
+
+        return !reader.hasError();
+    }
+
+    bool parseServerMessageCbor(const std::string &buffer, ServerMessage &message)
+    {
+        clearServerMessage(message);
+
+        CborReader reader(buffer.data(), buffer.size());
+
+        return readCborMap(reader, [&](const uint32_t &key) -> bool
+        {
+            if ( (key == fnv1a("eventName")) && reader.isText() )
+            {
+                reader.readText(message.eventName.str, message.eventName.length);
+                message.eventNameHash = fnv1a(message.eventName.str, message.eventName.length);
+            }
+            else if ( (key == fnv1a("responseData")) && reader.isMap() )
+            {
+                readCborMap(reader, [&](const uint32_t &key) -> bool
+                {
+                    uint64_t deviceId;
+
+                    if ( (key == fnv1a("deviceId")) && reader.isUint() && reader.readUint(deviceId) )
+                    {
+                        message.hasDeviceId = true;
+                        message.deviceId    = static_cast<unsigned long>(deviceId);
+                    }
+                    else if ( (key == fnv1a("payloadFormat")) && reader.isText() )
+                        reader.readText(message.payloadFormat.str, message.payloadFormat.length);
+                    else
+                        return false;
+
+                    return true;
+                });
+            }
+            else if ( (key == fnv1a("parameter")) && reader.isMap() )
+            {
+                readCborMap(reader, [&](const uint32_t &key) -> bool
+                {
+                    uint64_t index;
+                    bool     flag;
+
+                    if ( (key == fnv1a("name")) && reader.isText() )
+                        reader.readText(message.paramName.str, message.paramName.length);
+                    else if ( ( (key == fnv1a("currentValue")) || (key == fnv1a("value")) ) && reader.isText() )
+                        message.hasParamValue = reader.readText(message.paramValue.str, message.paramValue.length);
+                    else if ( ( (key == fnv1a("currentValue")) || (key == fnv1a("value")) ) && reader.isUint() && reader.readUint(index) )
+                    {
+                        message.hasParamValueIndex = true;
+                        message.paramValueIndex    = static_cast<unsigned long>(index);
+                    }
+                    else if ( ( (key == fnv1a("currentValue")) || (key == fnv1a("value")) ) && reader.isBool() && reader.readBool(flag) )
+                    {
+                        message.paramValue    = flag ? JsonStringRef{"true", 4} : JsonStringRef{"false", 5};
+                        message.hasParamValue = true;
+                    }
+                    else
+                        return false;
+
+                    return true;
+                });
+            }
+            else
+                return false;
+
+            return true;
+        });
+    }
+}
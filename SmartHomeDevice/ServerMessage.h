@@ -0,0 +1,48 @@
+#pragma once
+
+#include "Fnv1a.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace SmartHomeDevice_n
+{
+    // points into the parsed buffer, valid as long as the buffer is
+    struct JsonStringRef
+    {
+        const char *str;
+        size_t      length;
+
+        bool empty() const { return length == 0; }
+        bool equals(const char*) const;
+        std::string toString() const { return std::string(str, length); }
+    };
+
+    // fields of a server message, which the device understands. Everything else is skipped while parsing.
+    //  { "eventName": "...", "responseData": "{...}" | {...}, "parameter": { "name": "...", "currentValue": "..." | number | bool | index } }
+    struct ServerMessage
+    {
+        JsonStringRef eventName;
+        uint32_t      eventNameHash;
+
+        // responseData
+        bool          hasDeviceId;
+        unsigned long deviceId;
+        JsonStringRef payloadFormat;
+
+        // parameter
+        JsonStringRef paramName;
+        JsonStringRef paramValue;
+        bool          hasParamValue;        // false, if currentValue is missing or not a scalar
+        bool          hasParamValueIndex;   // CBOR: COMBOBOX value given as its index instead of the text
+        unsigned long paramValueIndex;
+        char          paramValueText[32];   // JSON number, which paramValue points to. Not to be copied along with paramValue
+    };
+
+    // single pass SAX parse. The buffer is modified in place (strings are unescaped and terminated there),
+    // and the message refers to it, so it must outlive the message. Returns false on malformed JSON
+    bool parseServerMessage(char *buffer, ServerMessage&);
+
+    // same message encoded as CBOR (Content-Type: application/cbor, or a binary WebSocket frame). Strings refer to the buffer
+    bool parseServerMessageCbor(const std::string &buffer, ServerMessage&);
+}
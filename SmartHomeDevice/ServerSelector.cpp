@@ -0,0 +1,113 @@
+#include "ServerSelector.h"
+#include <algorithm>
+
+namespace SmartHomeDevice_n
+{
+    ServerSelector::ServerSelector(const std::map<std::string, unsigned short> &knownHosts) : position(0)
+    {
+        for (const auto &knownHost : knownHosts)
+        {
+            ServerStats server;
+
+            server.host                = knownHost.first;
+            server.port                = knownHost.second;
+            server.measured            = false;
+            server.connectTime         = 0;
+            server.responseTime        = 0;
+            server.consecutiveFailures = 0;
+
+            servers.push_back(server);
+            order.push_back(static_cast<unsigned char>(order.size()));
+        }
+    }
+
+    unsigned int ServerSelector::average(const unsigned int &current, const unsigned int &sample)
+    {
+        // EWMA with 1/4 weight of the new sample: one slow connect doesn't move a host to the end of the list
+        return current - current / 4 + sample / 4;
+    }
+
+    unsigned int ServerSelector::cost(const ServerStats &server) const
+    {
+        return server.connectTime + server.responseTime;
+    }
+
+    ServerStats *ServerSelector::currentServer()
+    {
+        return order.empty() ? nullptr : &servers[order[position]];
+    }
+
+    bool ServerSelector::empty() const
+    {
+        return servers.empty();
+    }
+
+    void ServerSelector::startRound()
+    {
+        // healthy hosts first; among them the measured ones by latency, then the ones never tried yet.
+        // Failing hosts go last, the ones which have failed least often first
+        std::stable_sort(order.begin(), order.end(), [this](const unsigned char &first, const unsigned char &second) -> bool
+        {
+            const auto &a = servers[first];
+            const auto &b = servers[second];
+
+            if (a.consecutiveFailures != b.consecutiveFailures)
+                return a.consecutiveFailures < b.consecutiveFailures;
+
+            if (a.measured != b.measured)
+                return a.measured;
+
+            return cost(a) < cost(b);
+        });
+
+        position = 0;
+    }
+
+    void ServerSelector::next()
+    {
+        if (!order.empty())
+            position = static_cast<unsigned char>((position + 1) % order.size());
+    }
+
+    const ServerStats &ServerSelector::current() const
+    {
+        return servers[order[position]];
+    }
+
+    void ServerSelector::reportConnected(const unsigned int &connectTime)
+    {
+        auto server = currentServer();
+
+        if (server == nullptr)
+            return;
+
+        server->connectTime = server->measured ? average(server->connectTime, connectTime) : connectTime;
+        server->measured    = true;
+    }
+
+    void ServerSelector::reportResponseTime(const unsigned int &responseTime)
+    {
+        auto server = currentServer();
+
+        if (server == nullptr)
+            return;
+
+        server->responseTime = (server->responseTime > 0) ? average(server->responseTime, responseTime) : responseTime;
+    }
+
+    void ServerSelector::reportSuccess()
+    {
+        auto server = currentServer();
+
+        if (server != nullptr)
+            server->consecutiveFailures = 0;
+    }
+
+    void ServerSelector::reportFailure()
+    {
+        auto server = currentServer();
+
+        if ( (server != nullptr) && (server->consecutiveFailures < 255) )
+            server->consecutiveFailures++;
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace SmartHomeDevice_n
+{
+    struct ServerStats
+    {
+        std::string    host;
+        unsigned short port;
+        bool           measured;              // connected at least once
+        unsigned int   connectTime;           // ms, moving average
+        unsigned int   responseTime;          // ms, moving average of request round trips
+        unsigned char  consecutiveFailures;   // failed connects and 5xx since the last answered request
+    };
+
+    // orders knownHosts by health and measured latency. Statistics are kept across reconnects,
+    // so after the first rounds the device goes straight to the fastest host, which works
+    class ServerSelector
+    {
+    private:
+        std::vector<ServerStats>   servers;
+        std::vector<unsigned char> order;     // indexes into 'servers' for the current round, best first
+        unsigned char              position;  // in 'order'
+
+        static unsigned int average(const unsigned int &current, const unsigned int &sample);
+        unsigned int cost(const ServerStats&) const;
+        ServerStats *currentServer();
+
+    public:
+        explicit ServerSelector(const std::map<std::string, unsigned short>&);
+
+        bool empty() const;
+
+        // starts a new round of connection attempts with the best host
+        void startRound();
+        // moves on to the next host. After the last one the round starts over with the first
+        void next();
+        const ServerStats &current() const;
+
+        // statistics of the current host
+        void reportConnected(const unsigned int &connectTime);
+        void reportResponseTime(const unsigned int &responseTime);
+        // a connect alone doesn't make a host healthy, a backend answering 5xx accepts connections just fine
+        void reportSuccess();
+        void reportFailure();
+    };
+}
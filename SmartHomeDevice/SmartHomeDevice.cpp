@@ -1,21 +1,122 @@
 #include "SmartHomeDevice.h"
-#include "rapidjson/document.h"
-#include "rapidjson/stringbuffer.h"
 #include "rapidjson/writer.h"
+#include <cctype>
 
 namespace SmartHomeDevice_n
 {
-    #define FSM_CALLBACK_CLOSURE(func) [this](const EventData &eventData) { this->func(eventData); }
+    using ArenaJsonWriter = rapidjson::Writer<StringOutputStream, rapidjson::UTF8<>, rapidjson::UTF8<>, ArenaStackAllocator>;
+
+    struct SmartHomeDeviceTransitions
+    {
+        static constexpr FsmTransition list[] =
+        {
+            {State::INITIAL,                   Events::START,                               State::NETWORK_SCANNING,          &SmartHomeDevice::fsm_startNetworksScan},
+            {State::INITIAL,                   Events::FATAL_ERROR,                         State::DISCONNECTING_FROM_SERVER, &SmartHomeDevice::fsm_handleFatalError},
+
+            {State::NETWORK_SCANNING,          Events::NETWORK_SCAN_RESULTS_READY,          State::NETWORK_SCANNING,          &SmartHomeDevice::fsm_tryToPickANetwork},
+            {State::NETWORK_SCANNING,          Events::NETWORK_SCAN_FAILED,                 State::NETWORK_SCANNING,          &SmartHomeDevice::fsm_startNetworksScan},
+            {State::NETWORK_SCANNING,          Events::NETWORK_SCAN_TIMEOUT,                State::NETWORK_SCANNING,          &SmartHomeDevice::fsm_startNetworksScan},
+            {State::NETWORK_SCANNING,          Events::RECONNECT_BACKOFF_EXPIRED,           State::NETWORK_SCANNING,          &SmartHomeDevice::fsm_startNetworksScan},
+            {State::NETWORK_SCANNING,          Events::NETWORK_PICKED,                      State::CONNECTING_TO_WIFI,        &SmartHomeDevice::fsm_connectToNetwork},
+            {State::NETWORK_SCANNING,          Events::WIFI_CONNECTED,                      State::CONNECTING_TO_SERVER,      &SmartHomeDevice::fsm_startServerConnection},
+            {State::NETWORK_SCANNING,          Events::FATAL_ERROR,                         State::DISCONNECTING_FROM_SERVER, &SmartHomeDevice::fsm_handleFatalError},
+
+            {State::CONNECTING_TO_WIFI,        Events::WIFI_CONNECTED,                      State::CONNECTING_TO_SERVER,      &SmartHomeDevice::fsm_startServerConnection},
+            {State::CONNECTING_TO_WIFI,        Events::NETWORK_SCAN_RESULTS_READY,          State::CONNECTING_TO_WIFI,        &SmartHomeDevice::fsm_tryToPickANetwork},
+            {State::CONNECTING_TO_WIFI,        Events::NETWORK_PICKED,                      State::CONNECTING_TO_WIFI,        &SmartHomeDevice::fsm_connectToNetwork},
+            {State::CONNECTING_TO_WIFI,        Events::WIFI_CONNECTION_FAILED,              State::CONNECTING_TO_WIFI,        &SmartHomeDevice::fsm_connectToNetwork},
+            {State::CONNECTING_TO_WIFI,        Events::WIFI_CONNECTION_TIMEOUT,             State::NETWORK_SCANNING,          &SmartHomeDevice::fsm_scheduleReconnect},
+            {State::CONNECTING_TO_WIFI,        Events::WIFI_CONNECTION_RETRIES_EXHAUSTED,   State::NETWORK_SCANNING,          &SmartHomeDevice::fsm_scheduleReconnect},
+            {State::CONNECTING_TO_WIFI,        Events::DISCONNECTED,                        State::NETWORK_SCANNING,          &SmartHomeDevice::fsm_scheduleReconnect},
+            {State::CONNECTING_TO_WIFI,        Events::FATAL_ERROR,                         State::DISCONNECTING_FROM_SERVER, &SmartHomeDevice::fsm_handleFatalError},
+
+            {State::CONNECTING_TO_SERVER,      Events::SERVER_PICKED,                       State::CONNECTING_TO_SERVER,      &SmartHomeDevice::fsm_connectToServer},
+            {State::CONNECTING_TO_SERVER,      Events::SERVER_CONNECTED,                    State::CONNECTED,                 &SmartHomeDevice::fsm_handleConnectionToServer},
+            {State::CONNECTING_TO_SERVER,      Events::SERVER_CONNECTION_FAILED,            State::CONNECTING_TO_SERVER,      &SmartHomeDevice::fsm_connectToServer},
+            {State::CONNECTING_TO_SERVER,      Events::SERVER_CONNECTION_RETRIES_EXHAUSTED, State::NETWORK_SCANNING,          &SmartHomeDevice::fsm_scheduleReconnect},
+            {State::CONNECTING_TO_SERVER,      Events::SERVER_CONNECTION_TIMEOUT,           State::NETWORK_SCANNING,          &SmartHomeDevice::fsm_scheduleReconnect},
+            {State::CONNECTING_TO_SERVER,      Events::DISCONNECTED,                        State::NETWORK_SCANNING,          &SmartHomeDevice::fsm_scheduleReconnect},
+            {State::CONNECTING_TO_SERVER,      Events::FATAL_ERROR,                         State::DISCONNECTING_FROM_SERVER, &SmartHomeDevice::fsm_handleFatalError},
+
+            {State::CONNECTED,                 Events::DEVICE_STATUS_REQUEST_TIMEOUT,       State::CONNECTED,                 &SmartHomeDevice::fsm_requestDeviceStatus},
+            {State::CONNECTED,                 Events::PARAMS_FLUSH_TIMEOUT,                State::CONNECTED,                 &SmartHomeDevice::fsm_flushParamChanges},
+            {State::CONNECTED,                 Events::DATA_AVAILABLE,                      State::CONNECTED,                 &SmartHomeDevice::fsm_readData},
+            {State::CONNECTED,                 Events::DEVICE_ID_RECEIVED,                  State::CONNECTED,                 &SmartHomeDevice::fsm_saveDeviceId},
+            {State::CONNECTED,                 Events::DEVICE_ID_ERROR,                     State::CONNECTED,                 &SmartHomeDevice::fsm_handleDeviceIdError},
+            {State::CONNECTED,                 Events::DISCONNECTED,                        State::NETWORK_SCANNING,          &SmartHomeDevice::fsm_scheduleReconnect},
+            {State::CONNECTED,                 Events::FATAL_ERROR,                         State::DISCONNECTING_FROM_SERVER, &SmartHomeDevice::fsm_handleFatalError},
+
+            {State::DISCONNECTING_FROM_SERVER, Events::SERVER_DISCONNECTED,                 State::FLUSHING_OUTPUT,           &SmartHomeDevice::fsm_flushOutput},
+            {State::FLUSHING_OUTPUT,           Events::OUTPUT_FLUSHED,                      State::DISCONNECTING_FROM_WIFI,   &SmartHomeDevice::fsm_disconnectFromWiFi},
+            {State::FLUSHING_OUTPUT,           Events::OUTPUT_FLUSH_TIMEOUT,                State::DISCONNECTING_FROM_WIFI,   &SmartHomeDevice::fsm_disconnectFromWiFi},
+            {State::DISCONNECTING_FROM_WIFI,   Events::WIFI_DISCONNECTED,                   State::INITIAL,                   &SmartHomeDevice::fsm_resetDevice}
+        };
+
+        static constexpr FsmTransitionTable table = makeTransitionTable(list);
+
+        static_assert(!hasDuplicateTransitions(list), "SmartHomeDevice FSM: state/event pair registered twice");
+    };
+
+    constexpr FsmTransition      SmartHomeDeviceTransitions::list[];
+    constexpr FsmTransitionTable SmartHomeDeviceTransitions::table;
+
+    // messages the server may send, either as responses or on its own (WebSocket)
+    struct SmartHomeDeviceCommands
+    {
+        static constexpr ServerCommand list[] =
+        {
+            {"deviceOnlineResponse", fnv1a("deviceOnlineResponse"), &SmartHomeDevice::cmd_deviceOnlineResponse},
+            {"setDeviceParameter",   fnv1a("setDeviceParameter"),   &SmartHomeDevice::cmd_setDeviceParameter}
+        };
+
+        static_assert(!hasDuplicateCommands(list), "SmartHomeDevice server commands: eventName registered twice, or hashes collide");
+    };
+
+    constexpr ServerCommand SmartHomeDeviceCommands::list[];
 
     SmartHomeDevice::SmartHomeDevice(const std::string &deviceName, const WifiConfiguration &configuration)
-    : deviceId(-1),
+    : deviceId(INVALID_DEVICE_ID),
       deviceName(deviceName),
-      stateMachine(State::INITIAL),
-      configuration(configuration),
+      stateMachine(State::INITIAL, this, SmartHomeDeviceTransitions::table, events, eventPayloads),
       timerManager(nullptr),
+      debugDevice(nullptr),
+      configuration(configuration),
       currentWifiStatus(WifiStatus::DISCONNECTED),
       currentServerConnStatus(false),
-      debugDevice(nullptr)
+      payloadFormat(PayloadFormat::LEGACY),
+      wireFormat(WireFormat::JSON),
+      paramsWindowOpen(false),
+      networkCandidatesCount(0),
+      nextNetworkCandidate(0),
+      droppedScanResults(0),
+      lastGoodNetworkValid(false),
+      lastGoodNetwork(),
+      fastReconnectInProgress(false),
+      fastReconnectFailed(false),
+      pendingHttpRequests(0),
+      cborOffers(0),
+      httpRequestSentAt(0),
+      serverSelector(configuration.knownHosts),
+      truncatedHostNames(0),
+      retryScheduler(configuration.retryBackoffBase, configuration.retryBackoffCap, configuration.retryBackoffTick, [this]() -> unsigned int { return this->getCurrentTime(); }),
+      retryEvent(Events::RECONNECT_BACKOFF_EXPIRED),
+      retryPayload(NO_PAYLOAD),
+      webSocketState(WebSocketState::NONE),
+      webSocketMaskState(0),
+      shuttingDown(false),
+      shutdownStartedAt(0),
+      outputFlushReported(false),
+      asyncConnect(false),
+      wifiConnectInFlight(false),
+      serverConnectInFlight(false),
+      connectPayload(NO_PAYLOAD),
+      connectStartedAt(0),
+      wifiConnectResult(ConnectResult::NONE),
+      serverConnectResult(ConnectResult::NONE),
+      readinessNotifications(false),
+      wifiStatusChangedFlag(false),
+      serverDisconnectedFlag(false),
+      dataReadyFlag(false)
     {
         debugDevice = new DebugDevice([this](const std::string &debugMessage)
         {
@@ -58,59 +159,28 @@ namespace SmartHomeDevice_n
         auto deviceStatusParam = DeviceParameter("Device_Status",      DeviceParamType::TEXTBOX, true);
 
         deviceIdParam.addValue("-1"); 
-        deviceMacAddress.addValue(getMacAddress());
+        // MAC address is added in init(), as platform interface is not available during construction
         deviceNameParam.addValue(deviceName.empty() ? "SmartHomeDevice" : deviceName);
         deviceStatusParam.addValue("Online");
 
-        paramsList.push_back(deviceIdParam);
-        paramsList.push_back(deviceMacAddress);
-        paramsList.push_back(deviceNameParam);
-        paramsList.push_back(deviceStatusParam);
+        params.add(deviceIdParam);
+        params.add(deviceMacAddress);
+        params.add(deviceNameParam);
+        params.add(deviceStatusParam);
     }
 
     void SmartHomeDevice::initEventSystem()
     {
-        events[Events::START]                               = eventSystem.createEvent();
-        events[Events::NETWORK_SCAN_RESULTS_READY]          = eventSystem.createEvent();
-        events[Events::NETWORK_SCAN_TIMEOUT]                = eventSystem.createEvent();
-        events[Events::NETWORK_SCAN_FAILED]                 = eventSystem.createEvent();
-        events[Events::NETWORK_PICKED]                      = eventSystem.createEvent();
-        events[Events::WIFI_CONNECTED]                      = eventSystem.createEvent();
-        events[Events::WIFI_CONNECTION_FAILED]              = eventSystem.createEvent();
-        events[Events::WIFI_CONNECTION_RETRIES_EXHAUSTED]   = eventSystem.createEvent();
-        events[Events::WIFI_CONNECTION_TIMEOUT]             = eventSystem.createEvent();
-        events[Events::SERVER_PICKED]                       = eventSystem.createEvent();
-        events[Events::SERVER_CONNECTED]                    = eventSystem.createEvent();
-        events[Events::SERVER_CONNECTION_FAILED]            = eventSystem.createEvent();
-        events[Events::SERVER_CONNECTION_RETRIES_EXHAUSTED] = eventSystem.createEvent();
-        events[Events::SERVER_CONNECTION_TIMEOUT]           = eventSystem.createEvent();
-        events[Events::DEVICE_STATUS_REQUEST_TIMEOUT]       = eventSystem.createEvent();
-        events[Events::DATA_AVAILABLE]                      = eventSystem.createEvent();
-        events[Events::DEVICE_ID_RECEIVED]                  = eventSystem.createEvent();
-        events[Events::DEVICE_ID_ERROR]                     = eventSystem.createEvent();
-        events[Events::DISCONNECTED]                        = eventSystem.createEvent();
-        events[Events::TIMER_EXPIRED]                       = eventSystem.createEvent();
-        events[Events::FATAL_ERROR]                         = eventSystem.createEvent();
+        // IDs are created in Events order, which lets the FSM map them back by offset
+        for (byte event = 0; event < Events::COUNT; event++)
+            events[event] = eventSystem.createEvent();
 
         // state machine subscriptions to events
-        eventSystem.subscribe(events[Events::START],                         &stateMachine);
-        eventSystem.subscribe(events[Events::NETWORK_SCAN_RESULTS_READY],    &stateMachine);
-        eventSystem.subscribe(events[Events::NETWORK_SCAN_TIMEOUT],          &stateMachine);
-        eventSystem.subscribe(events[Events::NETWORK_SCAN_FAILED],           &stateMachine);
-        eventSystem.subscribe(events[Events::NETWORK_PICKED],                &stateMachine);
-        eventSystem.subscribe(events[Events::WIFI_CONNECTED],                &stateMachine);
-        eventSystem.subscribe(events[Events::WIFI_CONNECTION_FAILED],        &stateMachine);
-        eventSystem.subscribe(events[Events::WIFI_CONNECTION_TIMEOUT],       &stateMachine);
-        eventSystem.subscribe(events[Events::SERVER_PICKED],                 &stateMachine);
-        eventSystem.subscribe(events[Events::SERVER_CONNECTED],              &stateMachine);
-        eventSystem.subscribe(events[Events::SERVER_CONNECTION_FAILED],      &stateMachine);
-        eventSystem.subscribe(events[Events::SERVER_CONNECTION_TIMEOUT],     &stateMachine);
-        eventSystem.subscribe(events[Events::DEVICE_STATUS_REQUEST_TIMEOUT], &stateMachine);
-        eventSystem.subscribe(events[Events::DATA_AVAILABLE],                &stateMachine);
-        eventSystem.subscribe(events[Events::DEVICE_ID_RECEIVED],            &stateMachine);
-        eventSystem.subscribe(events[Events::DEVICE_ID_ERROR],               &stateMachine);
-        eventSystem.subscribe(events[Events::DISCONNECTED],                  &stateMachine);
-        eventSystem.subscribe(events[Events::FATAL_ERROR],                   &stateMachine);
+        for (byte event = 0; event < Events::COUNT; event++)
+        {
+            if (event != Events::TIMER_EXPIRED)
+                eventSystem.subscribe(events[event], &stateMachine);
+        }
 
         // this class subscriptions to events
         eventSystem.subscribe(events[Events::TIMER_EXPIRED], this);
@@ -118,41 +188,9 @@ namespace SmartHomeDevice_n
 
     void SmartHomeDevice::initStateMachine()
     {
+        // transitions are in SmartHomeDeviceTransitions
         stateMachine.setDebugDevice(debugDevice);
-
-        stateMachine.addTransition(State::INITIAL,              events[Events::START],                               State::NETWORK_SCANNING,     FSM_CALLBACK_CLOSURE(fsm_startNetworksScan));
-        stateMachine.addTransition(State::INITIAL,              events[Events::FATAL_ERROR],                         State::INITIAL,              FSM_CALLBACK_CLOSURE(fsm_handleFatalError));
-
-        stateMachine.addTransition(State::NETWORK_SCANNING,     events[Events::NETWORK_SCAN_RESULTS_READY],          State::NETWORK_SCANNING,     FSM_CALLBACK_CLOSURE(fsm_tryToPickANetwork));
-        stateMachine.addTransition(State::NETWORK_SCANNING,     events[Events::NETWORK_SCAN_FAILED],                 State::NETWORK_SCANNING,     FSM_CALLBACK_CLOSURE(fsm_startNetworksScan));
-        stateMachine.addTransition(State::NETWORK_SCANNING,     events[Events::NETWORK_SCAN_TIMEOUT],                State::NETWORK_SCANNING,     FSM_CALLBACK_CLOSURE(fsm_startNetworksScan));
-        stateMachine.addTransition(State::NETWORK_SCANNING,     events[Events::NETWORK_PICKED],                      State::CONNECTING_TO_WIFI,   FSM_CALLBACK_CLOSURE(fsm_connectToNetwork));
-        stateMachine.addTransition(State::NETWORK_SCANNING,     events[Events::WIFI_CONNECTED],                      State::CONNECTING_TO_SERVER, FSM_CALLBACK_CLOSURE(fsm_startServerConnection));
-        stateMachine.addTransition(State::NETWORK_SCANNING,     events[Events::FATAL_ERROR],                         State::INITIAL,              FSM_CALLBACK_CLOSURE(fsm_handleFatalError));
-         
-        stateMachine.addTransition(State::CONNECTING_TO_WIFI,   events[Events::WIFI_CONNECTED],                      State::CONNECTING_TO_SERVER, FSM_CALLBACK_CLOSURE(fsm_startServerConnection));
-        stateMachine.addTransition(State::CONNECTING_TO_WIFI,   events[Events::NETWORK_SCAN_RESULTS_READY],          State::CONNECTING_TO_WIFI,   FSM_CALLBACK_CLOSURE(fsm_tryToPickANetwork));
-        stateMachine.addTransition(State::CONNECTING_TO_WIFI,   events[Events::NETWORK_PICKED],                      State::CONNECTING_TO_WIFI,   FSM_CALLBACK_CLOSURE(fsm_connectToNetwork));
-        stateMachine.addTransition(State::CONNECTING_TO_WIFI,   events[Events::WIFI_CONNECTION_FAILED],              State::CONNECTING_TO_WIFI,   FSM_CALLBACK_CLOSURE(fsm_connectToNetwork));
-        stateMachine.addTransition(State::CONNECTING_TO_WIFI,   events[Events::WIFI_CONNECTION_TIMEOUT],             State::NETWORK_SCANNING,     FSM_CALLBACK_CLOSURE(fsm_startNetworksScan));
-        stateMachine.addTransition(State::CONNECTING_TO_WIFI,   events[Events::WIFI_CONNECTION_RETRIES_EXHAUSTED],   State::NETWORK_SCANNING,     FSM_CALLBACK_CLOSURE(fsm_startNetworksScan));
-        stateMachine.addTransition(State::CONNECTING_TO_WIFI,   events[Events::DISCONNECTED],                        State::NETWORK_SCANNING,     FSM_CALLBACK_CLOSURE(fsm_startNetworksScan));
-        stateMachine.addTransition(State::CONNECTING_TO_WIFI,   events[Events::FATAL_ERROR],                         State::INITIAL,              FSM_CALLBACK_CLOSURE(fsm_handleFatalError));
-
-        stateMachine.addTransition(State::CONNECTING_TO_SERVER, events[Events::SERVER_PICKED],                       State::CONNECTING_TO_SERVER, FSM_CALLBACK_CLOSURE(fsm_connectToServer));
-        stateMachine.addTransition(State::CONNECTING_TO_SERVER, events[Events::SERVER_CONNECTED],                    State::CONNECTED,            FSM_CALLBACK_CLOSURE(fsm_handleConnectionToServer));
-        stateMachine.addTransition(State::CONNECTING_TO_SERVER, events[Events::SERVER_CONNECTION_FAILED],            State::CONNECTING_TO_SERVER, FSM_CALLBACK_CLOSURE(fsm_connectToServer));
-        stateMachine.addTransition(State::CONNECTING_TO_SERVER, events[Events::SERVER_CONNECTION_RETRIES_EXHAUSTED], State::NETWORK_SCANNING,     FSM_CALLBACK_CLOSURE(fsm_startNetworksScan));
-        stateMachine.addTransition(State::CONNECTING_TO_SERVER, events[Events::SERVER_CONNECTION_TIMEOUT],           State::NETWORK_SCANNING,     FSM_CALLBACK_CLOSURE(fsm_startNetworksScan));
-        stateMachine.addTransition(State::CONNECTING_TO_SERVER, events[Events::DISCONNECTED],                        State::NETWORK_SCANNING,     FSM_CALLBACK_CLOSURE(fsm_startNetworksScan));
-        stateMachine.addTransition(State::CONNECTING_TO_SERVER, events[Events::FATAL_ERROR],                         State::INITIAL,              FSM_CALLBACK_CLOSURE(fsm_handleFatalError));
-
-        stateMachine.addTransition(State::CONNECTED,            events[Events::DEVICE_STATUS_REQUEST_TIMEOUT],       State::CONNECTED,            FSM_CALLBACK_CLOSURE(fsm_requestDeviceStatus));
-        stateMachine.addTransition(State::CONNECTED,            events[Events::DATA_AVAILABLE],                      State::CONNECTED,            FSM_CALLBACK_CLOSURE(fsm_readData));
-        stateMachine.addTransition(State::CONNECTED,            events[Events::DEVICE_ID_RECEIVED],                  State::CONNECTED,            FSM_CALLBACK_CLOSURE(fsm_saveDeviceId));
-        stateMachine.addTransition(State::CONNECTED,            events[Events::DEVICE_ID_ERROR],                     State::CONNECTED,            FSM_CALLBACK_CLOSURE(fsm_handleDeviceIdError));
-        stateMachine.addTransition(State::CONNECTED,            events[Events::DISCONNECTED],                        State::NETWORK_SCANNING,     FSM_CALLBACK_CLOSURE(fsm_startNetworksScan));
-        stateMachine.addTransition(State::CONNECTED,            events[Events::FATAL_ERROR],                         State::INITIAL,              FSM_CALLBACK_CLOSURE(fsm_handleFatalError));
+        eventPayloads.setDebugDevice(debugDevice);
     }
 
     void SmartHomeDevice::initTimers()
@@ -165,6 +203,11 @@ namespace SmartHomeDevice_n
             wifiConnectionTimer      = timerManager->createTimer(configuration.wifiConnectionTimeout);
             serverConnectionTimer    = timerManager->createTimer(configuration.serverConnectionTimeout);
             deviceStatusRequestTimer = timerManager->createTimer(configuration.deviceStatusRequestTimeout);
+            paramsFlushTimer         = configuration.paramsFlushWindow > 0 ? timerManager->createTimer(configuration.paramsFlushWindow) : INVALID_TIMER_HANDLE;
+            outputFlushTimer         = timerManager->createTimer(configuration.outputFlushTimeout);
+
+            // devices, which start together, have to pick different delays
+            retryScheduler.init(timerManager, fnv1a(deviceName.data(), deviceName.size()) ^ getCurrentTime());
         }
     }
 
@@ -173,386 +216,1081 @@ namespace SmartHomeDevice_n
         (void)taskManager.scheduleTask(this);
         (void)taskManager.scheduleTask(&eventSystem, Priority::HIGH);
         (void)taskManager.scheduleTask(timerManager, Priority::HIGH);
+        (void)taskManager.scheduleTask(debugDevice, Priority::LOW);
     }
 
-    void SmartHomeDevice::init()
+    void SmartHomeDevice::sendEvent(const Events::Values &event, const PayloadHandle &payload)
     {
-        eventSystem.sendEvent(Event(events[Events::START]));
+        auto handle = payload;
+
+        eventSystem.sendEvent(Event(events[event], &handle, sizeof(handle)));
     }
 
-    void SmartHomeDevice::go()
+    void SmartHomeDevice::sendFatalError(const char *reason)
     {
-        if (stateMachine.state() == State::CONNECTED)
-        {
-            // check connection to WiFi
-            auto wifiStatus = getWifiStatus();
-            if (wifiStatus != currentWifiStatus)
-            {
-                currentWifiStatus = wifiStatus;
-
-                if (wifiStatus != WifiStatus::CONNECTED)
-                {
-                    eventSystem.sendEvent(Event(events[Events::DISCONNECTED]));
-
-                    return;
-                }
-            }
-
-            // check connection to the server
-            auto serverConnectionStatus = connectedToServer();
-            if (serverConnectionStatus != currentServerConnStatus)
-            {
-                currentServerConnStatus = serverConnectionStatus;
-
-                if (!serverConnectionStatus)
-                {
-                    eventSystem.sendEvent(Event(events[Events::DISCONNECTED]));
+        PayloadHandle payload;
 
-                    return;
-                }
-            }
+        auto errorInfo = eventPayloads.newErrorInfo(payload);
 
-            // check if data is available to read
-            if (dataAvailable())
-                eventSystem.sendEvent(Event(events[Events::DATA_AVAILABLE]));
+        if (errorInfo != nullptr)
+        {
+            memset(errorInfo->errorStr, 0, sizeof(errorInfo->errorStr));
+            strncpy(errorInfo->errorStr, reason, sizeof(errorInfo->errorStr) - 1);
         }
-    }
+        else
+            LOG_CRITICAL(debugDevice) << "Fatal error: " << reason << "\n";   // the handler won't have it
 
-    void SmartHomeDevice::terminate()
-    {
-        disconnectFromServer();
-        for (int i = 0; i < 10000; i++); // add some delay
-        disconnectFromWiFi();
+        sendEvent(Events::FATAL_ERROR, payload);
     }
 
-    void SmartHomeDevice::run()
+    void SmartHomeDevice::retryLater(const RetryKind::Values &kind, const Events::Values &event, const PayloadHandle &payload)
     {
-        taskManager.go();
-    }
+        cancelRetry();
 
-    void SmartHomeDevice::onEvent(EventSystem *sender, const Event &event)
-    {
-        auto tmrToEventsMap = std::map<TimerHandle, EventId>
-        {
-            {networkScanTimer,         events[Events::NETWORK_SCAN_TIMEOUT]},
-            {wifiConnectionTimer,      events[Events::WIFI_CONNECTION_TIMEOUT]},
-            {serverConnectionTimer,    events[Events::SERVER_CONNECTION_TIMEOUT]},
-            {deviceStatusRequestTimer, events[Events::DEVICE_STATUS_REQUEST_TIMEOUT]}
-        };
+        auto delay = retryScheduler.schedule(kind);
 
-        if (event.getId() == events[Events::TIMER_EXPIRED])
+        if (delay == 0)
         {
-            TimerHandle tmrId = INVALID_TIMER_HANDLE;
+            sendEvent(event, payload);
+            return;
+        }
 
-            event.getData(&tmrId, sizeof(tmrId));
+        LOG_INFO(debugDevice) << "Retrying in " << delay << " ms\n";
 
-            if (tmrToEventsMap.find(tmrId) != tmrToEventsMap.end())
-                eventSystem.sendEvent(Event(tmrToEventsMap.at(tmrId)));
-        }
+        retryEvent   = event;
+        retryPayload = payload;
     }
 
-    void SmartHomeDevice::sendHttpMessage(const HttpMessage &msg)
+    void SmartHomeDevice::cancelRetry()
     {
-        if (msg.isValid() && connectedToServer())
-            sendData(msg.rawText());
+        retryScheduler.cancel();
+
+        eventPayloads.release(retryPayload);
+        retryPayload = NO_PAYLOAD;
     }
 
-    bool SmartHomeDevice::addParam(const DeviceParameter &deviceParam)
+    void SmartHomeDevice::forwardEvent(const Events::Values &event, const EventData &eventData)
     {
-        if (deviceId != -1)
-        {
-            if (std::find_if(paramsList.begin(), paramsList.end(), [&deviceParam](const auto &param) -> bool {return deviceParam.getName() == param.getName(); }) == paramsList.end())
-            {
-                paramsList.push_back(deviceParam);
+        eventPayloads.addRef(eventData.payload);
+
+        sendEvent(event, eventData.payload);
+    }
 
-                auto paramJson = deviceParam.toJson();
+    void SmartHomeDevice::init()
+    {
+        readinessNotifications = readinessNotificationsSupported();
+        asyncConnect           = asyncConnectSupported();
 
-                rapidjson::Document jsonDoc;
+        auto macAddressParam = params.get(params.find("Device_MAC_Address"));
 
-                jsonDoc.SetObject();
+        if ( (macAddressParam != nullptr) && macAddressParam->getValues().empty() )
+            macAddressParam->addValue(getMacAddress());
 
-                rapidjson::Document::AllocatorType& allocator = jsonDoc.GetAllocator();
+        if (configuration.messageArenaSize > 0)
+        {
+            messageArena.init(configuration.messageArenaSize);
+            paramsBatch.reserve(configuration.maxParamsBatchSize);
+        }
 
-                rapidjson::Value paramValue;
-                paramValue.SetString(paramJson.c_str(), paramJson.length(), allocator);
+        eventSystem.sendEvent(Event(events[Events::START]));
+    }
 
-                jsonDoc.AddMember("eventName", "deviceParameterAdded", allocator);
-                jsonDoc.AddMember("parameter", paramValue, allocator);
+    void SmartHomeDevice::go()
+    {
+        if (asyncConnect)
+            checkConnectCompletions();
 
-                rapidjson::StringBuffer buffer;
+        if (stateMachine.state() == State::FLUSHING_OUTPUT)
+            checkOutputFlushed();
 
-                buffer.Clear();
+        if (stateMachine.state() == State::CONNECTED)
+        {
+            if (readinessNotifications)
+                checkReadinessNotifications();
+            else
+                pollConnectionStatus();
+        }
+    }
 
-                rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
-                jsonDoc.Accept(writer);
+    void SmartHomeDevice::pollConnectionStatus()
+    {
+        // check connection to WiFi
+        auto wifiStatus = getWifiStatus();
+        if (wifiStatus != currentWifiStatus)
+        {
+            currentWifiStatus = wifiStatus;
 
-                auto deviceStatusJson = std::string(buffer.GetString());
+            if (wifiStatus != WifiStatus::CONNECTED)
+            {
+                eventSystem.sendEvent(Event(events[Events::DISCONNECTED]));
 
-                HttpMessage deviceStatusMsg;
+                return;
+            }
+        }
 
-                deviceStatusMsg.setRequestLine(HttpMethod::POST, "deviceStatus?id=" + std::to_string(deviceId), HttpVersion::HTTP_1_1)
-                    .appendHeader(HttpHeader::HOST, connectedHost)
-                    .appendHeader(HttpHeader::ACCEPT, "application/json")
-                    .appendHeader(HttpHeader::CONTENT_TYPE, "application/json")
-                    .appendHeader(HttpHeader::CONTENT_LENGTH, std::to_string(deviceStatusJson.length()))
-                    .appendBody(deviceStatusJson);
+        // check connection to the server
+        auto serverConnectionStatus = connectedToServer();
+        if (serverConnectionStatus != currentServerConnStatus)
+        {
+            currentServerConnStatus = serverConnectionStatus;
 
-                sendHttpMessage(deviceStatusMsg);
+            if (!serverConnectionStatus)
+            {
+                eventSystem.sendEvent(Event(events[Events::DISCONNECTED]));
 
-                return true;
+                return;
             }
-            else
-                return false;
         }
-        else
-            return false;
+
+        // check if data is available to read
+        if (dataAvailable())
+            eventSystem.sendEvent(Event(events[Events::DATA_AVAILABLE]));
     }
 
-    bool SmartHomeDevice::setParamValue(const std::string &paramName, const std::string &paramValue)
+    void SmartHomeDevice::checkReadinessNotifications()
     {
-        if (deviceId != -1)
+        // WiFi status is queried only when the platform has reported a change
+        if (wifiStatusChangedFlag.exchange(false))
         {
-            auto param = std::find_if(paramsList.begin(), paramsList.end(), [&paramName](const auto &param) -> bool {return paramName == param.getName(); });
+            currentWifiStatus = getWifiStatus();
 
-            if (param != paramsList.end())
+            if (currentWifiStatus != WifiStatus::CONNECTED)
             {
-                param->setCurrentValue(paramValue);
+                eventSystem.sendEvent(Event(events[Events::DISCONNECTED]));
 
-                auto paramJson = param->toJson();
+                return;
+            }
+        }
+
+        if (serverDisconnectedFlag.exchange(false))
+        {
+            currentServerConnStatus = false;
 
-                rapidjson::Document jsonDoc;
+            eventSystem.sendEvent(Event(events[Events::DISCONNECTED]));
+
+            return;
+        }
 
-                jsonDoc.SetObject();
+        if (dataReadyFlag.exchange(false))
+            eventSystem.sendEvent(Event(events[Events::DATA_AVAILABLE]));
+    }
 
-                rapidjson::Document::AllocatorType& allocator = jsonDoc.GetAllocator();
+    void SmartHomeDevice::notifyWifiStatusChanged()
+    {
+        wifiStatusChangedFlag = true;
+    }
 
-                rapidjson::Value paramValue;
-                paramValue.SetString(paramJson.c_str(), paramJson.length(), allocator);
+    void SmartHomeDevice::notifyServerDisconnected()
+    {
+        serverDisconnectedFlag = true;
+    }
 
-                jsonDoc.AddMember("eventName", "deviceParameterChanged", allocator);
-                jsonDoc.AddMember("parameter", paramValue, allocator);
+    void SmartHomeDevice::notifyDataReady()
+    {
+        dataReadyFlag = true;
+    }
 
-                rapidjson::StringBuffer buffer;
+    void SmartHomeDevice::notifyWifiConnectCompleted(const bool &success)
+    {
+        wifiConnectResult = success ? ConnectResult::SUCCEEDED : ConnectResult::FAILED;
+    }
 
-                buffer.Clear();
+    void SmartHomeDevice::notifyServerConnectCompleted(const bool &success)
+    {
+        serverConnectResult = success ? ConnectResult::SUCCEEDED : ConnectResult::FAILED;
+    }
 
-                rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
-                jsonDoc.Accept(writer);
+    void SmartHomeDevice::checkConnectCompletions()
+    {
+        ConnectResult::Values result = ConnectResult::NONE;
 
-                auto deviceStatusJson = std::string(buffer.GetString());
+        if (wifiConnectInFlight)
+            result = static_cast<ConnectResult::Values>(wifiConnectResult.exchange(ConnectResult::NONE));
+        else if (serverConnectInFlight)
+            result = static_cast<ConnectResult::Values>(serverConnectResult.exchange(ConnectResult::NONE));
 
-                HttpMessage deviceStatusMsg;
+        if (result == ConnectResult::NONE)
+            return;
 
-                deviceStatusMsg.setRequestLine(HttpMethod::POST, "deviceStatus?id=" + std::to_string(deviceId), HttpVersion::HTTP_1_1)
-                    .appendHeader(HttpHeader::HOST, connectedHost)
-                    .appendHeader(HttpHeader::ACCEPT, "application/json")
-                    .appendHeader(HttpHeader::CONTENT_TYPE, "application/json")
-                    .appendHeader(HttpHeader::CONTENT_LENGTH, std::to_string(deviceStatusJson.length()))
-                    .appendBody(deviceStatusJson);
+        // the attempt is handled as if the FSM callback, which has started it, had blocked until now
+        EventData eventData = {&eventSystem, connectPayload, eventPayloads.get(connectPayload)};
 
-                sendHttpMessage(deviceStatusMsg);
+        if (wifiConnectInFlight)
+        {
+            wifiConnectInFlight = false;
 
-                return true;
-            }
-            else
-                return false;
+            handleWifiConnectResult(eventData, (result == ConnectResult::SUCCEEDED) && (getWifiStatus() == WifiStatus::CONNECTED));
         }
         else
-            return false;
+        {
+            serverConnectInFlight = false;
+
+            handleServerConnectResult(eventData, (result == ConnectResult::SUCCEEDED) && connectedToServer());
+        }
+
+        eventPayloads.release(connectPayload);
+        connectPayload = NO_PAYLOAD;
     }
 
-    const std::string &SmartHomeDevice::getParamValue(const std::string &paramName)
+    void SmartHomeDevice::abandonConnectAttempts()
     {
-        static const std::string dummy;
+        if (wifiConnectInFlight)
+            disconnectFromWiFi();
+        else if (serverConnectInFlight)
+            disconnectFromServer();
 
-        auto param = std::find_if(paramsList.begin(), paramsList.end(), [&paramName](const auto &param) -> bool {return paramName == param.getName(); });
+        wifiConnectInFlight   = false;
+        serverConnectInFlight = false;
 
-        if (param != paramsList.end())
-            return param->getCurrentValue();
-        else
-            return dummy;
+        eventPayloads.release(connectPayload);
+        connectPayload = NO_PAYLOAD;
     }
 
-    // FSM callbacks
-
-    void SmartHomeDevice::fsm_startNetworksScan(const EventData &eventData)
+    void SmartHomeDevice::terminate()
     {
-        fsm_goIdle(eventData);
+        // after a fatal error both links are already down, see fsm_handleFatalError
+        if (shuttingDown)
+            return;
 
-        timerManager->startTimer(networkScanTimer);
+        disconnectFromServer();
+        disconnectFromWiFi();
+    }
 
-        scanForNetworks( [this, &eventData](int networksFound)
-        {
-            if (networksFound > 0)
-            {
-                auto netInfos = std::list<NetworkInfo>();
+    void SmartHomeDevice::run()
+    {
+        taskManager.go();
+    }
 
-                for (int i = 0; i < networksFound; i++)
-                    netInfos.push_back(getInfoForNetwork(i));
+    State::Values SmartHomeDevice::getState()
+    {
+        return stateMachine.state();
+    }
 
-                netInfos.sort([](const NetworkInfo &first, const NetworkInfo &second) -> bool { return first.rssi > second.rssi; });
+    const unsigned long &SmartHomeDevice::getProcessedEventsCount() const
+    {
+        return stateMachine.getProcessedEventsCount();
+    }
 
-                for (auto netInfo : netInfos)
-                {
-                    EventData evData;
-                    memset(&evData, 0, sizeof(evData));
-                    evData.sender = eventData.sender;
+    const RetryStatistics &SmartHomeDevice::getRetryStatistics() const
+    {
+        return retryScheduler.getStatistics();
+    }
 
-                    memcpy(evData.data.networkInfo.ssid, netInfo.ssid, sizeof(MAX_SSID_LENGTH));
-                    evData.data.networkInfo.isOpen  = netInfo.isOpen;
-                    evData.data.networkInfo.rssi    = netInfo.rssi;
-                    evData.data.networkInfo.channel = netInfo.channel;
+    unsigned long SmartHomeDevice::getMessageArenaOverflows() const
+    {
+        return messageArena.getOverflows();
+    }
 
-                    this->eventSystem.sendEvent(Event(events[Events::NETWORK_SCAN_RESULTS_READY], &evData, sizeof(evData)));
-                }
-            }
-            else
-                this->eventSystem.sendEvent(Event(events[Events::NETWORK_SCAN_FAILED]));
-        });
+    const OutboundQueueStatistics &SmartHomeDevice::getOutboundQueueStatistics() const
+    {
+        return outboundQueue.getStatistics();
     }
 
-    void SmartHomeDevice::fsm_tryToPickANetwork(const EventData &eventData)
+    const unsigned long &SmartHomeDevice::getEventPayloadsExhausted() const
     {
-        if ( (configuration.knownNetworks.find(eventData.data.networkInfo.ssid) != configuration.knownNetworks.end()) || eventData.data.networkInfo.isOpen)
-        {
-            EventData evData = eventData;
-            eventSystem.sendEvent(Event(events[Events::NETWORK_PICKED], &evData, sizeof(evData)));
-        }
+        return eventPayloads.getExhaustedCount();
     }
 
-    void SmartHomeDevice::fsm_connectToNetwork(const EventData &eventData)
+    const unsigned long &SmartHomeDevice::getDroppedScanResults() const
     {
-        if (getWifiStatus() == WifiStatus::CONNECTED)
-        {
-            wifiConnectionRetries = 0;
+        return droppedScanResults;
+    }
 
-            timerManager->stopTimer(networkScanTimer);
-            timerManager->stopTimer(wifiConnectionTimer);
+    const unsigned long &SmartHomeDevice::getTruncatedHostNames() const
+    {
+        return truncatedHostNames;
+    }
 
-            eventSystem.sendEvent(Event(events[Events::WIFI_CONNECTED]));
-        }
-        else
+    void SmartHomeDevice::onEvent(EventSystem *sender, const Event &event)
+    {
+        (void)sender;
+
+        if (event.getId() == events[Events::TIMER_EXPIRED])
         {
-            if (wifiConnectionRetries < configuration.maxWifiConnectionRetries)
+            const struct
             {
-                timerManager->restartTimer(wifiConnectionTimer);
-
-                std::string ssid = "";
-                std::string pw   = "";
+                TimerHandle    timer;
+                Events::Values event;
+            }
+            timerEvents[] =
+            {
+                {networkScanTimer,         Events::NETWORK_SCAN_TIMEOUT},
+                {wifiConnectionTimer,      Events::WIFI_CONNECTION_TIMEOUT},
+                {serverConnectionTimer,    Events::SERVER_CONNECTION_TIMEOUT},
+                {deviceStatusRequestTimer, Events::DEVICE_STATUS_REQUEST_TIMEOUT},
+                {paramsFlushTimer,         Events::PARAMS_FLUSH_TIMEOUT},
+                {outputFlushTimer,         Events::OUTPUT_FLUSH_TIMEOUT}
+            };
 
-                if (!eventData.data.networkInfo.isOpen)
-                {
-                    auto networkCfg = configuration.knownNetworks.find(eventData.data.networkInfo.ssid);
+            TimerHandle tmrId = INVALID_TIMER_HANDLE;
 
-                    if (networkCfg != configuration.knownNetworks.end())
-                    {
-                        ssid = networkCfg->first;
-                        pw   = networkCfg->second;
-                    }
-                }
-                else
-                {
-                    ssid = eventData.data.networkInfo.ssid;
-                }
+            event.getData(&tmrId, sizeof(tmrId));
 
-                connectToWiFi(ssid, pw);
+            if (tmrId == INVALID_TIMER_HANDLE)
+                return;
 
-                if (getWifiStatus() == WifiStatus::CONNECTED)
+            if (retryScheduler.isTimer(tmrId))
+            {
+                if (retryScheduler.onTimer())
                 {
-                    wifiConnectionRetries = 0;
+                    auto payload = retryPayload;
 
-                    timerManager->stopTimer(networkScanTimer);
-                    timerManager->stopTimer(wifiConnectionTimer);
+                    retryPayload = NO_PAYLOAD;
 
-                    eventSystem.sendEvent(Event(events[Events::WIFI_CONNECTED]));
+                    sendEvent(retryEvent, payload);
                 }
-                else
-                {
-                    wifiConnectionRetries++;
 
-                    EventData evData = eventData;
-                    eventSystem.sendEvent(Event(events[Events::WIFI_CONNECTION_FAILED], &evData, sizeof(evData)));
-                }
+                return;
             }
-            else
-            {
-                wifiConnectionRetries = 0;
 
-                timerManager->stopAllTimers();
+            for (const auto &timerEvent : timerEvents)
+            {
+                if (timerEvent.timer == tmrId)
+                {
+                    eventSystem.sendEvent(Event(events[timerEvent.event]));
 
-                eventSystem.sendEvent(Event(events[Events::WIFI_CONNECTION_RETRIES_EXHAUSTED]));
+                    return;
+                }
             }
         }
     }
 
-    void SmartHomeDevice::fsm_startServerConnection(const EventData &eventData)
+    void SmartHomeDevice::sendHttpMessage(const HttpMessage &msg)
     {
-        (void)eventData;
+        if (msg.isValid())
+            sendHttpRequest(msg.rawText(), false);
+    }
 
-        if (getWifiStatus() == WifiStatus::CONNECTED)
-        {
-            if (connectedToServer())
-                eventSystem.sendEvent(Event(events[Events::SERVER_CONNECTED]));
-            else
-            {
+    bool SmartHomeDevice::sendHttpRequest(const std::string &request, const bool &offersCbor)
+    {
+        // anything sent behind the upgrade request would be taken for WebSocket frames by the server
+        if ( !connectedToServer() || (webSocketState == WebSocketState::UPGRADING) )
+            return false;
 
-                if (!configuration.knownHosts.empty())
-                {
-                    fsm_goIdle(eventData);
+        sendData(request);
 
-                    timerManager->startTimer(serverConnectionTimer);
+        // a failed write closes the connection, that's all the platform interface tells
+        if (!connectedToServer())
+            return false;
 
-                    for (auto server : configuration.knownHosts)
-                    {
-                        EventData evData;
-                        memset(&evData, 0, sizeof(evData));
+        countPendingRequest(offersCbor);
 
-                        evData.sender = eventData.sender;
+        return true;
+    }
 
-                        memcpy(evData.data.hostInfo.host, server.first.c_str(), server.first.size());
+    void SmartHomeDevice::countPendingRequest(const bool &offersCbor)
+    {
+        // beyond 32 requests in flight the offer isn't tracked: their responses don't change the wire format
+        if (offersCbor && (pendingHttpRequests < 32))
+            cborOffers |= static_cast<uint32_t>(1) << pendingHttpRequests;
 
-                        evData.data.hostInfo.port = server.second;
+        if (pendingHttpRequests++ == 0)
+            httpRequestSentAt = getCurrentTime();
+    }
 
-                        eventSystem.sendEvent(Event(events[Events::SERVER_PICKED], &evData, sizeof(evData)));
-                    }
-                }
-                else
-                {
-                    EventData evData;
-                    memset(&evData, 0, sizeof(evData));
+    bool SmartHomeDevice::addParam(const DeviceParameter &deviceParam)
+    {
+        if (deviceId != INVALID_DEVICE_ID)
+        {
+            // a full queue pushes back: the parameter isn't added, the caller can try again later
+            if (!outboundQueue.canPush(OutboundKind::PARAMETER_ADDED))
+                return false;
+
+            auto paramHandle = params.add(deviceParam);
 
-                    evData.sender = eventData.sender;
+            if (paramHandle != INVALID_PARAM_HANDLE)
+            {
+                (void)outboundQueue.push(OutboundKind::PARAMETER_ADDED, paramHandle);
 
-                    const char *errMsg = "Server connection is not possible: no known hosts in configuration!";
-                    memcpy(evData.data.errorStr, errMsg, sizeof(errMsg));
+                drainOutboundQueue();
 
-                    eventSystem.sendEvent(Event(events[Events::FATAL_ERROR], &evData, sizeof(evData)));
-                }
+                return true;
             }
+            else
+                return false;
         }
         else
-            eventSystem.sendEvent(Event(events[Events::DISCONNECTED]));
+            return false;
     }
 
-    void SmartHomeDevice::fsm_connectToServer(const EventData &eventData)
+    bool SmartHomeDevice::setParamValue(const std::string &paramName, const std::string &paramValue)
     {
-        if (serverConnectionRetries < configuration.maxServerConnectionRetries)
-        {
-            connectToServer(eventData.data.hostInfo.host, eventData.data.hostInfo.port);
+        return setParamValue(params.find(paramName), paramValue);
+    }
 
-            if (connectedToServer())
-            {
-                connectedHost = eventData.data.hostInfo.host + ':' + std::to_string(eventData.data.hostInfo.port);
-                eventSystem.sendEvent(Event(events[Events::SERVER_CONNECTED]));
+    const std::string &SmartHomeDevice::getParamValue(const std::string &paramName)
+    {
+        return getParamValue(params.find(paramName));
+    }
+
+    ParamHandle SmartHomeDevice::getParamHandle(const std::string &paramName) const
+    {
+        return params.find(paramName);
+    }
+
+    bool SmartHomeDevice::setParamValue(const ParamHandle &paramHandle, const std::string &paramValue)
+    {
+        if (deviceId != INVALID_DEVICE_ID)
+        {
+            auto param = params.get(paramHandle);
+
+            if (param != nullptr)
+            {
+                // same as in addParam: on a full queue the value stays as it is
+                if (!outboundQueue.canPush(OutboundKind::PARAMETER_CHANGED, paramHandle))
+                    return false;
+
+                param->setCurrentValue(paramValue);
+
+                // the latest value is what gets reported, so a parameter is queued only once
+                (void)outboundQueue.push(OutboundKind::PARAMETER_CHANGED, paramHandle);
+
+                // batching: changes are held until the window ends, or there are enough of them
+                if (paramsFlushTimer != INVALID_TIMER_HANDLE)
+                {
+                    if (outboundQueue.count(OutboundKind::PARAMETER_CHANGED) >= configuration.maxParamsBatchSize)
+                    {
+                        timerManager->stopTimer(paramsFlushTimer);
+
+                        paramsWindowOpen = false;
+                    }
+                    else if (!paramsWindowOpen)
+                    {
+                        timerManager->startTimer(paramsFlushTimer);
+
+                        paramsWindowOpen = true;
+                    }
+                }
+
+                drainOutboundQueue();
+
+                return true;
             }
             else
+                return false;
+        }
+        else
+            return false;
+    }
+
+    const std::string &SmartHomeDevice::getParamValue(const ParamHandle &paramHandle)
+    {
+        static const std::string dummy;
+
+        auto param = params.get(paramHandle);
+
+        if (param != nullptr)
+            return param->getCurrentValue();
+        else
+            return dummy;
+    }
+
+    template <typename JsonWriter>
+    void SmartHomeDevice::writeParameter(JsonWriter &writer, const DeviceParameter &param) const
+    {
+        if (payloadFormat == PayloadFormat::NESTED)
+        {
+            param.writeJson(writer);
+            return;
+        }
+
+        // LEGACY: the parameter is rendered on its own, and embedded as a string
+        auto &embedded = messageArena.startEmbedded();
+
+        StringOutputStream stream(embedded);
+        ArenaJsonWriter    paramWriter(stream, messageArena.embeddedWriterStack());
+
+        param.writeJson(paramWriter);
+
+        writeJsonString(writer, embedded);
+    }
+
+    void SmartHomeDevice::writeParameter(CborWriter &writer, const DeviceParameter &param) const
+    {
+        // a CBOR server understands nested parameters by definition
+        param.writeCbor(writer);
+    }
+
+    template <typename WriteFunc>
+    const std::string &SmartHomeDevice::encodeMessage(WriteFunc write) const
+    {
+        auto &message = messageArena.startMessage();
+
+        if (wireFormat == WireFormat::CBOR)
+        {
+            CborWriter writer(message);
+
+            write(writer);
+
+            return message;
+        }
+
+        StringOutputStream stream(message);
+        ArenaJsonWriter    writer(stream, messageArena.messageWriterStack());
+
+        write(writer);
+
+        return message;
+    }
+
+    const char *SmartHomeDevice::contentType() const
+    {
+        return wireFormat == WireFormat::CBOR ? "application/cbor" : "application/json";
+    }
+
+    const char *SmartHomeDevice::acceptedContentTypes() const
+    {
+        return configuration.preferredWireFormat == WireFormat::CBOR ? "application/cbor, application/json;q=0.5" : "application/json";
+    }
+
+    const std::string &SmartHomeDevice::makeParameterEvent(const char *eventName, const DeviceParameter &param) const
+    {
+        return encodeMessage([&](auto &writer)
+        {
+            writer.StartObject();
+
+            writeJsonKey(writer, "eventName");
+            writer.String(eventName);
+
+            writeJsonKey(writer, "parameter");
+            this->writeParameter(writer, param);
+
+            writer.EndObject();
+        });
+    }
+
+    const std::string &SmartHomeDevice::makeParametersEvent(const char *eventName, const std::vector<ParamHandle> &paramHandles) const
+    {
+        return encodeMessage([&](auto &writer)
+        {
+            writer.StartObject();
+
+            writeJsonKey(writer, "eventName");
+            writer.String(eventName);
+
+            writeJsonKey(writer, "parameters");
+            writer.StartArray();
+
+            for (const auto &paramHandle : paramHandles)
+            {
+                auto param = params.get(paramHandle);
+
+                if (param != nullptr)
+                    this->writeParameter(writer, *param);
+            }
+
+            writer.EndArray();
+
+            writer.EndObject();
+        });
+    }
+
+    const std::string &SmartHomeDevice::makeDeviceOnline() const
+    {
+        return encodeMessage([&](auto &writer)
+        {
+            writer.StartObject();
+
+            writeJsonKey(writer, "eventName");
+            writer.String("deviceOnline");
+
+            // advertise NESTED support. Server acknowledges it in deviceOnlineResponse
+            if ( (configuration.preferredPayloadFormat == PayloadFormat::NESTED) && (wireFormat == WireFormat::JSON) )
+            {
+                writeJsonKey(writer, "supportedPayloadFormat");
+                writer.String("nested");
+            }
+
+            writeJsonKey(writer, "parameters");
+            writer.StartArray();
+
+            for (const auto &param : params)
+                this->writeParameter(writer, param);
+
+            writer.EndArray();
+
+            writer.EndObject();
+        });
+    }
+
+    bool SmartHomeDevice::sendDeviceStatusMessage(const std::string &deviceStatus)
+    {
+        if (webSocketState == WebSocketState::OPEN)
+            return sendWebSocketMessage(wireFormat == WireFormat::CBOR ? WebSocketOpcode::BINARY : WebSocketOpcode::TEXT, deviceStatus);
+
+        return sendDeviceStatusRequest(HttpMethod::POST, &deviceStatus);
+    }
+
+    void SmartHomeDevice::renderRequestTemplates()
+    {
+        deviceStatusRequests.render(connectedHost, deviceId, acceptedContentTypes(), contentType());
+    }
+
+    bool SmartHomeDevice::sendDeviceStatusRequest(const HttpMethod::Values &method, const std::string *body)
+    {
+        // the only request without a body is the poll
+        if (body == nullptr)
+            return sendHttpRequest(deviceStatusRequests.getPoll(), configuration.preferredWireFormat == WireFormat::CBOR);
+
+        return sendHttpRequest(deviceStatusRequests.write(messageArena.startFrame(), method, *body), configuration.preferredWireFormat == WireFormat::CBOR);
+    }
+
+    void SmartHomeDevice::drainOutboundQueue()
+    {
+        // anything sent behind the upgrade request would be taken for WebSocket frames by the server. The queue is drained
+        // again once the upgrade is resolved, and after SERVER_CONNECTED
+        if ( (stateMachine.state() != State::CONNECTED) || (webSocketState == WebSocketState::UPGRADING) || !connectedToServer() )
+            return;
+
+        OutboundKind::Values kind;
+        ParamHandle          paramHandle;
+
+        // an entry, which hasn't gone out, stays at the front for the next connection
+        while (outboundQueue.front(kind, paramHandle))
+        {
+            switch (kind)
+            {
+                case OutboundKind::DEVICE_ONLINE:
+                    if (!sendDeviceStatusRequest(HttpMethod::PUT, &makeDeviceOnline()))
+                        return;
+
+                    outboundQueue.pop();
+                    break;
+
+                case OutboundKind::WEBSOCKET_UPGRADE:
+                    if ( (webSocketState == WebSocketState::NONE) && !requestWebSocketUpgrade() )
+                        return;
+
+                    outboundQueue.pop();
+
+                    // the rest waits for the upgrade to be resolved
+                    if (webSocketState == WebSocketState::UPGRADING)
+                        return;
+                    break;
+
+                case OutboundKind::PARAMETER_ADDED:
+                {
+                    auto param = params.get(paramHandle);
+
+                    if ( (param != nullptr) && !sendDeviceStatusMessage(makeParameterEvent("deviceParameterAdded", *param)) )
+                        return;
+
+                    outboundQueue.pop();
+                    break;
+                }
+
+                case OutboundKind::PARAMETER_CHANGED:
+                    // the batching window holds up status polls queued behind the changes as well
+                    if (paramsWindowOpen || !sendParameterChanges())
+                        return;
+                    break;
+
+                default:
+                    // server pushes its state through the WebSocket
+                    if ( (deviceId != INVALID_DEVICE_ID) && (webSocketState != WebSocketState::OPEN) && !sendDeviceStatusRequest(HttpMethod::GET, nullptr) )
+                        return;
+
+                    outboundQueue.pop();
+                    break;
+            }
+        }
+    }
+
+    bool SmartHomeDevice::sendParameterChanges()
+    {
+        // without batching every change is reported on its own, as before
+        size_t maxBatchSize = (paramsFlushTimer != INVALID_TIMER_HANDLE) && (configuration.maxParamsBatchSize > 1) ? configuration.maxParamsBatchSize : 1;
+
+        OutboundKind::Values kind;
+        ParamHandle          paramHandle;
+
+        size_t batched = 0;   // queue entries, removed parameters included
+
+        paramsBatch.clear();
+
+        while ( (paramsBatch.size() < maxBatchSize) && outboundQueue.peek(batched, kind, paramHandle) && (kind == OutboundKind::PARAMETER_CHANGED) )
+        {
+            batched++;
+
+            if (params.get(paramHandle) != nullptr)
+                paramsBatch.push_back(paramHandle);
+        }
+
+        auto sent = true;
+
+        if (paramsBatch.size() == 1)
+            sent = sendDeviceStatusMessage(makeParameterEvent("deviceParameterChanged", *params.get(paramsBatch.front())));
+        else if (paramsBatch.size() > 1)
+            sent = sendDeviceStatusMessage(makeParametersEvent("deviceParametersChanged", paramsBatch));
+
+        if (sent)
+            outboundQueue.pop(batched);
+
+        return sent;
+    }
+
+    // FSM callbacks
+
+    void SmartHomeDevice::connectToWiFiOnChannel(const std::string &ssid, const std::string &password, const int &channel)
+    {
+        (void)channel;
+
+        connectToWiFi(ssid, password);
+    }
+
+    void SmartHomeDevice::startConnectToWiFi(const std::string &ssid, const std::string &password, const int &channel)
+    {
+        connectToWiFiOnChannel(ssid, password, channel);
+
+        notifyWifiConnectCompleted(getWifiStatus() == WifiStatus::CONNECTED);
+    }
+
+    void SmartHomeDevice::startConnectToServer(const std::string &host, const unsigned short &port)
+    {
+        connectToServer(host, port);
+
+        notifyServerConnectCompleted(connectedToServer());
+    }
+
+    void SmartHomeDevice::fsm_startNetworksScan(const EventData &eventData)
+    {
+        fsm_goIdle(eventData);
+
+        // direct attempt has been interrupted (e.g. by the connection timeout) - that's a failure as well
+        if (fastReconnectInProgress)
+        {
+            fastReconnectInProgress = false;
+            fastReconnectFailed     = true;
+        }
+
+        networkCandidatesCount = 0;
+        nextNetworkCandidate   = 0;
+
+        // after a brief outage the previous network is most likely still there: try it directly, and scan only if that fails
+        if (lastGoodNetworkValid && !fastReconnectFailed)
+        {
+            PayloadHandle payload;
+
+            auto networkInfo = eventPayloads.newNetworkInfo(payload);
+
+            if (networkInfo != nullptr)
+            {
+                *networkInfo = lastGoodNetwork;
+
+                fastReconnectInProgress = true;
+
+                sendEvent(Events::NETWORK_PICKED, payload);
+
+                return;
+            }
+        }
+
+        fastReconnectFailed = false;
+
+        timerManager->startTimer(networkScanTimer);
+
+        scanForNetworks( [this](int networksFound)
+        {
+            if (networksFound > 0)
+            {
+                unsigned int acceptable = 0;
+
+                // candidates are ranked as the results are read, only the best ones are kept
+                for (int i = 0; i < networksFound; i++)
+                {
+                    if (this->addNetworkCandidate(this->getInfoForNetwork(i)))
+                        acceptable++;
+                }
+
+                if (acceptable > this->networkCandidatesCount)
+                {
+                    unsigned int dropped = acceptable - this->networkCandidatesCount;
+
+                    this->droppedScanResults += dropped;
+
+                    LOG_INFO(this->debugDevice) << "Scan: " << acceptable << " acceptable networks, the weakest " << dropped << " dropped\n";
+                }
+
+                // nothing acceptable: the scan is repeated once networkScanTimer expires
+                if (this->networkCandidatesCount > 0)
+                    this->eventSystem.sendEvent(Event(events[Events::NETWORK_SCAN_RESULTS_READY]));
+            }
+            else
+                this->eventSystem.sendEvent(Event(events[Events::NETWORK_SCAN_FAILED]));
+        });
+    }
+
+    bool SmartHomeDevice::scoreNetwork(const NetworkInfo &networkInfo, int &score) const
+    {
+        auto known = configuration.knownNetworks.find(networkInfo.ssid) != configuration.knownNetworks.end();
+
+        // unknown secured networks can't be joined
+        if (!known && !networkInfo.isOpen)
+            return false;
+
+        // known networks go first, then the stronger signal. Secured ones win over open ones with about the same signal
+        score = networkInfo.rssi;
+
+        if (known)
+            score += 1000;
+
+        if (!networkInfo.isOpen)
+            score += 5;
+
+        return true;
+    }
+
+    bool SmartHomeDevice::addNetworkCandidate(const NetworkInfo &networkInfo)
+    {
+        int score = 0;
+
+        if (!scoreNetwork(networkInfo, score))
+            return false;
+
+        // insertion into the sorted array; the weakest candidate falls off when it's full
+        byte position = networkCandidatesCount;
+
+        while ( (position > 0) && (networkCandidates[position - 1].score < score) )
+            position--;
+
+        if (position >= MAX_NETWORK_CANDIDATES)
+            return true;
+
+        byte last = networkCandidatesCount < MAX_NETWORK_CANDIDATES ? networkCandidatesCount : MAX_NETWORK_CANDIDATES - 1;
+
+        for (byte i = last; i > position; i--)
+            networkCandidates[i] = networkCandidates[i - 1];
+
+        networkCandidates[position].networkInfo = networkInfo;
+        networkCandidates[position].score       = score;
+
+        if (networkCandidatesCount < MAX_NETWORK_CANDIDATES)
+            networkCandidatesCount++;
+
+        return true;
+    }
+
+    void SmartHomeDevice::fsm_tryToPickANetwork(const EventData &eventData)
+    {
+        (void)eventData;
+
+        // one candidate at a time: the next one is picked only after this one has failed
+        if (nextNetworkCandidate >= networkCandidatesCount)
+            return;
+
+        PayloadHandle payload;
+
+        auto networkInfo = eventPayloads.newNetworkInfo(payload);
+
+        if (networkInfo == nullptr)
+            return;
+
+        *networkInfo = networkCandidates[nextNetworkCandidate++].networkInfo;
+
+        wifiConnectionRetries = 0;
+
+        sendEvent(Events::NETWORK_PICKED, payload);
+    }
+
+    void SmartHomeDevice::fsm_connectToNetwork(const EventData &eventData)
+    {
+        if (getWifiStatus() == WifiStatus::CONNECTED)
+        {
+            fastReconnectInProgress = false;
+            wifiConnectionRetries = 0;
+
+            timerManager->stopTimer(networkScanTimer);
+            timerManager->stopTimer(wifiConnectionTimer);
+
+            eventSystem.sendEvent(Event(events[Events::WIFI_CONNECTED]));
+        }
+        else
+        {
+            if (wifiConnectionRetries < configuration.maxWifiConnectionRetries)
+            {
+                timerManager->restartTimer(wifiConnectionTimer);
+
+                const auto &networkInfo = eventData.networkInfo();
+
+                std::string ssid = "";
+                std::string pw   = "";
+
+                if (!networkInfo.isOpen)
+                {
+                    auto networkCfg = configuration.knownNetworks.find(networkInfo.ssid);
+
+                    if (networkCfg != configuration.knownNetworks.end())
+                    {
+                        ssid = networkCfg->first;
+                        pw   = networkCfg->second;
+                    }
+                }
+                else
+                {
+                    ssid = networkInfo.ssid;
+                }
+
+                if (asyncConnect)
+                {
+                    // the loop keeps running while associating, wifiConnectionTimer bounds the attempt
+                    abandonConnectAttempts();
+
+                    eventPayloads.addRef(eventData.payload);
+
+                    connectPayload      = eventData.payload;
+                    wifiConnectResult   = ConnectResult::NONE;
+                    wifiConnectInFlight = true;
+
+                    startConnectToWiFi(ssid, pw, networkInfo.channel);
+
+                    return;
+                }
+
+                connectToWiFiOnChannel(ssid, pw, networkInfo.channel);
+
+                handleWifiConnectResult(eventData, getWifiStatus() == WifiStatus::CONNECTED);
+            }
+            else if (nextNetworkCandidate < networkCandidatesCount)
+            {
+                // this candidate is out of retries, move on to the next one from the same scan
+                wifiConnectionRetries = 0;
+
+                eventSystem.sendEvent(Event(events[Events::NETWORK_SCAN_RESULTS_READY]));
+            }
+            else
+            {
+                wifiConnectionRetries = 0;
+
+                timerManager->stopAllTimers();
+
+                eventSystem.sendEvent(Event(events[Events::WIFI_CONNECTION_RETRIES_EXHAUSTED]));
+            }
+        }
+    }
+
+    void SmartHomeDevice::handleWifiConnectResult(const EventData &eventData, const bool &connected)
+    {
+        if (connected)
+        {
+            lastGoodNetwork         = eventData.networkInfo();
+            lastGoodNetworkValid    = true;
+            fastReconnectInProgress = false;
+
+            wifiConnectionRetries = 0;
+
+            timerManager->stopTimer(networkScanTimer);
+            timerManager->stopTimer(wifiConnectionTimer);
+
+            eventSystem.sendEvent(Event(events[Events::WIFI_CONNECTED]));
+        }
+        else if (fastReconnectInProgress)
+        {
+            // one attempt only, then back to the full scan. fsm_scheduleReconnect starts it without the backoff
+            wifiConnectionRetries = 0;
+
+            timerManager->stopAllTimers();
+
+            eventSystem.sendEvent(Event(events[Events::WIFI_CONNECTION_RETRIES_EXHAUSTED]));
+        }
+        else
+        {
+            wifiConnectionRetries++;
+
+            // the attempt is repeated after the backoff, the connection timeout applies to the attempt itself only
+            timerManager->stopTimer(wifiConnectionTimer);
+
+            eventPayloads.addRef(eventData.payload);
+
+            retryLater(RetryKind::WIFI_CONNECTION, Events::WIFI_CONNECTION_FAILED, eventData.payload);
+        }
+    }
+
+    void SmartHomeDevice::fsm_startServerConnection(const EventData &eventData)
+    {
+        (void)eventData;
+
+        if (getWifiStatus() == WifiStatus::CONNECTED)
+        {
+            if (connectedToServer())
+                eventSystem.sendEvent(Event(events[Events::SERVER_CONNECTED]));
+            else
+            {
+
+                if (!serverSelector.empty())
+                {
+                    fsm_goIdle(eventData);
+
+                    timerManager->startTimer(serverConnectionTimer);
+
+                    // one host at a time, the next one is picked only if this one fails
+                    serverSelector.startRound();
+
+                    PayloadHandle payload;
+
+                    if (pickServer(payload))
+                        sendEvent(Events::SERVER_PICKED, payload);
+                    else
+                        sendFatalError("Server connection is not possible: no free HostInfo payload");
+                }
+                else
+                    sendFatalError("Server connection is not possible: no known hosts in configuration!");
+            }
+        }
+        else
+            eventSystem.sendEvent(Event(events[Events::DISCONNECTED]));
+    }
+
+    bool SmartHomeDevice::pickServer(PayloadHandle &payload)
+    {
+        auto hostInfo = eventPayloads.newHostInfo(payload);
+
+        if (hostInfo == nullptr)
+            return false;
+
+        const auto &server = serverSelector.current();
+
+        if (server.host.size() >= sizeof(hostInfo->host))
+        {
+            truncatedHostNames++;
+
+            LOG_WARNING(debugDevice) << "Host name " << server.host << " is longer than " << static_cast<unsigned int>(sizeof(hostInfo->host) - 1) << " characters, truncated\n";
+        }
+
+        memset(hostInfo->host, 0, sizeof(hostInfo->host));
+        strncpy(hostInfo->host, server.host.c_str(), sizeof(hostInfo->host) - 1);
+
+        hostInfo->port = server.port;
+
+        return true;
+    }
+
+    void SmartHomeDevice::fsm_connectToServer(const EventData &eventData)
+    {
+        if (serverConnectionRetries < configuration.maxServerConnectionRetries)
+        {
+            const auto &hostInfo = eventData.hostInfo();
+
+            connectStartedAt = getCurrentTime();
+
+            if (asyncConnect)
             {
-                serverConnectionRetries++;
+                // the loop keeps running during the handshake, serverConnectionTimer bounds the attempt
+                abandonConnectAttempts();
 
-                EventData evData = eventData;
+                eventPayloads.addRef(eventData.payload);
 
-                eventSystem.sendEvent(Event(events[Events::SERVER_CONNECTION_FAILED], &evData, sizeof(evData)));
+                connectPayload        = eventData.payload;
+                serverConnectResult   = ConnectResult::NONE;
+                serverConnectInFlight = true;
+
+                startConnectToServer(hostInfo.host, hostInfo.port);
+
+                return;
             }
+
+            connectToServer(hostInfo.host, hostInfo.port);
+
+            handleServerConnectResult(eventData, connectedToServer());
         }
         else
         {
@@ -564,85 +1302,179 @@ namespace SmartHomeDevice_n
         }
     }
 
+    void SmartHomeDevice::handleServerConnectResult(const EventData &eventData, const bool &connected)
+    {
+        if (connected)
+        {
+            const auto &hostInfo = eventData.hostInfo();
+
+            serverSelector.reportConnected(getCurrentTime() - connectStartedAt);
+
+            connectedHost = std::string(hostInfo.host) + ':' + std::to_string(hostInfo.port);
+            eventSystem.sendEvent(Event(events[Events::SERVER_CONNECTED]));
+        }
+        else
+        {
+            serverConnectionRetries++;
+
+            serverSelector.reportFailure();
+            serverSelector.next();
+
+            // a retry still pending holds a HostInfo of its own, which this one replaces anyway
+            cancelRetry();
+
+            PayloadHandle payload;
+
+            // otherwise nothing would follow until serverConnectionTimer fires
+            if (pickServer(payload))
+                retryLater(RetryKind::SERVER_CONNECTION, Events::SERVER_CONNECTION_FAILED, payload);
+            else
+                sendFatalError("Server connection is not possible: no free HostInfo payload");
+        }
+    }
+
     void SmartHomeDevice::fsm_handleFatalError(const EventData &eventData)
     {
-        auto error = eventData.data.errorStr;
+        auto error = eventData.errorStr();
         
-        *debugDevice << "Fatal error: " << error << "\n";
+        LOG_CRITICAL(debugDevice) << "Fatal error: " << error << "\n";
 
-        // add some delay so the debug message can get to serial port
-        for (int i = 0; i < 10000; i++);
+        shuttingDown      = true;
+        shutdownStartedAt = getCurrentTime();
 
-        // stop all timers
+        // nothing started before the error is to complete anymore
         timerManager->stopAllTimers();
+        cancelRetry();
+        abandonConnectAttempts();
 
-        // terminate all tasks
-        taskManager.terminate();
+        // every step is reported as an event, the next one runs when the FSM takes it. The loop keeps running meanwhile
+        disconnectFromServer();
 
-        // reset the device
-        reset();
+        LOG_INFO(debugDevice) << "Shutdown: disconnected from server after " << shutdownElapsed() << " ms\n";
+
+        eventSystem.sendEvent(Event(events[Events::SERVER_DISCONNECTED]));
     }
 
-    void SmartHomeDevice::fsm_handleConnectionToServer(const EventData &eventData)
+    void SmartHomeDevice::fsm_flushOutput(const EventData &eventData)
     {
-        fsm_goIdle(eventData);
+        (void)eventData;
 
-        rapidjson::Document jsonDoc;
+        // the debug output is drained by its own task; checkOutputFlushed() reports when it's done, the timer bounds the wait
+        outputFlushReported = false;
 
-        jsonDoc.SetObject();
+        timerManager->startTimer(outputFlushTimer);
+    }
 
-        rapidjson::Document::AllocatorType& allocator = jsonDoc.GetAllocator();
+    void SmartHomeDevice::checkOutputFlushed()
+    {
+        if ( outputFlushReported || ((debugDevice != nullptr) && !debugDevice->isEmpty()) )
+            return;
 
-        rapidjson::Value parametersValue;
-        parametersValue.SetArray();
+        outputFlushReported = true;
 
-        for (auto param : paramsList)
-        {
-            rapidjson::Value val;
+        eventSystem.sendEvent(Event(events[Events::OUTPUT_FLUSHED]));
+    }
 
-            auto paramJson = param.toJson();
+    void SmartHomeDevice::fsm_disconnectFromWiFi(const EventData &eventData)
+    {
+        (void)eventData;
 
-            val.SetString(paramJson.c_str(), paramJson.length(), allocator);
+        timerManager->stopTimer(outputFlushTimer);
 
-            parametersValue.PushBack(val, allocator);
-        }
+        outputFlushReported = true;
 
-        jsonDoc.AddMember("eventName", "deviceOnline", allocator);
-        jsonDoc.AddMember("parameters", parametersValue, allocator);
+        disconnectFromWiFi();
 
-        rapidjson::StringBuffer buffer;
+        LOG_INFO(debugDevice) << "Shutdown: disconnected from WiFi after " << shutdownElapsed() << " ms\n";
 
-        buffer.Clear();
+        eventSystem.sendEvent(Event(events[Events::WIFI_DISCONNECTED]));
+    }
 
-        rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
-        jsonDoc.Accept(writer);
+    void SmartHomeDevice::fsm_resetDevice(const EventData &eventData)
+    {
+        (void)eventData;
 
-        auto deviceStatusJson = std::string(buffer.GetString());
+        LOG_INFO(debugDevice) << "Shutdown: resetting after " << shutdownElapsed() << " ms\n";
 
-        HttpMessage deviceStatusMsg;
-        
-        deviceStatusMsg.setRequestLine(HttpMethod::PUT, "deviceStatus", HttpVersion::HTTP_1_1)
-        .appendHeader(HttpHeader::HOST, connectedHost)
-        .appendHeader(HttpHeader::ACCEPT, "application/json")
-        .appendHeader(HttpHeader::CONTENT_TYPE, "application/json")
-        .appendHeader(HttpHeader::CONTENT_LENGTH, std::to_string(deviceStatusJson.length()))
-        .appendBody(deviceStatusJson);
+        // only the last few records are left; this is bounded by the ring size
+        debugDevice->flush();
+
+        timerManager->stopAllTimers();
+
+        // terminate all tasks
+        taskManager.terminate();
+
+        // reset the device
+        reset();
+    }
+
+    unsigned int SmartHomeDevice::shutdownElapsed()
+    {
+        return getCurrentTime() - shutdownStartedAt;
+    }
+
+    void SmartHomeDevice::fsm_handleConnectionToServer(const EventData &eventData)
+    {
+        fsm_goIdle(eventData);
 
-        sendHttpMessage(deviceStatusMsg);
+        // NESTED is used right away only with the host, which has already acknowledged it. Otherwise it's negotiated via deviceOnlineResponse
+        if ( (configuration.preferredPayloadFormat == PayloadFormat::NESTED) && (connectedHost == nestedPayloadsHost) )
+            payloadFormat = PayloadFormat::NESTED;
+        else
+            payloadFormat = PayloadFormat::LEGACY;
+
+        // same for CBOR: the first message to a new host is JSON, offering CBOR in Accept
+        if ( (configuration.preferredWireFormat == WireFormat::CBOR) && (connectedHost == cborHost) )
+            wireFormat = WireFormat::CBOR;
+        else
+            wireFormat = WireFormat::JSON;
+
+        renderRequestTemplates();
+
+        // deviceOnline carries current values of all parameters, so whatever was queued for them while the connection
+        // was down is reported with it. Polls wait for the device ID it brings back
+        outboundQueue.supersede(OutboundKind::DEVICE_ONLINE);
+        outboundQueue.supersede(OutboundKind::WEBSOCKET_UPGRADE);
+        outboundQueue.supersede(OutboundKind::PARAMETER_ADDED);
+        outboundQueue.supersede(OutboundKind::PARAMETER_CHANGED);
+        outboundQueue.supersede(OutboundKind::STATUS_POLL);
+        paramsWindowOpen = false;
+
+        // notifications left over from the previous connection don't apply to this one
+        currentServerConnStatus = true;
+        serverDisconnectedFlag  = false;
+        dataReadyFlag           = false;
+
+        // every new connection starts as plain HTTP
+        webSocketState = WebSocketState::NONE;
+        webSocketDecoder.reset();
+
+        // nothing from the previous connection is going to be answered
+        httpResponseParser.reset();
+        pendingHttpRequests = 0;
+        cborOffers          = 0;
+
+        (void)outboundQueue.push(OutboundKind::DEVICE_ONLINE);
+
+        drainOutboundQueue();
 
         timerManager->startTimer(deviceStatusRequestTimer);
     }
 
     void SmartHomeDevice::fsm_requestDeviceStatus(const EventData &eventData)
     {
-        if (deviceId != -1)
-        {
-            HttpMessage deviceRequestMsg;
+        (void)eventData;
 
-            deviceRequestMsg.setRequestLine(HttpMethod::GET, "deviceStatus?id=" + std::to_string(deviceId), HttpVersion::HTTP_1_1)
-                .appendHeader(HttpHeader::HOST, connectedHost);
+        // server pushes its state through the WebSocket. While the upgrade is in flight, polls are just postponed
+        if (webSocketState == WebSocketState::OPEN)
+            return;
 
-            sendHttpMessage(deviceRequestMsg);
+        // a poll, which doesn't fit into the queue, is just skipped; the next one comes with the timer
+        if (deviceId != INVALID_DEVICE_ID)
+        {
+            (void)outboundQueue.push(OutboundKind::STATUS_POLL);
+
+            drainOutboundQueue();
         }
 
         timerManager->restartTimer(deviceStatusRequestTimer);
@@ -650,97 +1482,396 @@ namespace SmartHomeDevice_n
 
     void SmartHomeDevice::fsm_goIdle(const EventData &eventData)
     {
+        (void)eventData;
+
         timerManager->stopAllTimers();
 
+        // e.g. the connection timer has expired: whatever is still in flight is of no use anymore
+        abandonConnectAttempts();
+        cancelRetry();
+
         wifiConnectionRetries = 0;
         serverConnectionRetries = 0;
     }
 
+    void SmartHomeDevice::fsm_scheduleReconnect(const EventData &eventData)
+    {
+        // the direct attempt on the last good network has failed or timed out: that's not a failed round, the scan follows right away
+        if (fastReconnectInProgress)
+        {
+            fsm_startNetworksScan(eventData);
+
+            return;
+        }
+
+        fsm_goIdle(eventData);
+
+        // with the backoff disabled the scan starts right away, otherwise RECONNECT_BACKOFF_EXPIRED starts it
+        retryLater(RetryKind::RECONNECT, Events::RECONNECT_BACKOFF_EXPIRED, NO_PAYLOAD);
+    }
+
     void SmartHomeDevice::fsm_readData(const EventData &eventData)
     {
         (void)eventData;
 
-        if (dataAvailable())
+        // with readiness notifications the event itself means that data is there
+        if (readinessNotifications || dataAvailable())
         {
-            HttpMessage httpMessage(readData());
+            auto data = readData();
+
+            if (data.empty())
+                return;
 
-            if (httpMessage.isValid())
+            if (webSocketState == WebSocketState::OPEN)
             {
-                const auto &status = httpMessage.status();
-                const auto &body   = httpMessage.body();
+                webSocketDecoder.feed(data);
 
-                if (!body.empty())
-                {
-                    rapidjson::Document doc;
+                handleWebSocketMessages();
+            }
+            else
+            {
+                // a read may end in the middle of a response, or contain several of them
+                httpResponseParser.feed(data);
 
-                    doc.Parse(body.c_str());
+                handleHttpResponses();
+            }
+        }
+    }
 
-                    if (!doc.IsNull() && !doc.HasParseError())
-                    {
-                        const std::map<std::string, Events::Values> jsonOkResponseEventsMap =
-                        {
-                            {"deviceOnlineResponse", Events::DEVICE_ID_RECEIVED}
-                        };
+    void SmartHomeDevice::handleHttpResponses()
+    {
+        auto &response = httpResponse;
 
-                        const std::map<std::string, Events::Values> jsonFailResponseEventsMap =
-                        {
-                            {"deviceOnlineResponse", Events::DEVICE_ID_ERROR}
-                        };
+        while (httpResponseParser.next(response))
+        {
+            auto cborOffered = (cborOffers & 1) != 0;
 
-                        EventData evData;
-                        memset(&evData, 0, sizeof(evData));
+            cborOffers >>= 1;
 
-                        evData.sender = eventData.sender;
+            if (pendingHttpRequests > 0)
+            {
+                // with more than one request in flight the wait for the others is included, so only lone ones are measured
+                if (pendingHttpRequests == 1)
+                    serverSelector.reportResponseTime(getCurrentTime() - httpRequestSentAt);
 
-                        auto responseData = doc["responseData"].GetString();
+                if (--pendingHttpRequests > 0)
+                    httpRequestSentAt = getCurrentTime();
+            }
 
-                        memcpy(evData.data.serverResponseStr, responseData, strlen(responseData));
+            // the upgrade request is the last one sent, so once nothing else is outstanding, this is its answer
+            if ( (webSocketState == WebSocketState::UPGRADING) && (pendingHttpRequests == 0) && handleWebSocketUpgrade(response) )
+            {
+                // whatever follows 101 is already framed
+                webSocketDecoder.feed(httpResponseParser.takeRemainder());
 
-                        std::string responseEvent = doc["eventName"].GetString();
+                handleWebSocketMessages();
 
-                        if ((status >= HttpStatus::_200_OK) && (status <= HttpStatus::_226_IM_USED))
-                        {
-                            if (jsonOkResponseEventsMap.find(responseEvent) != jsonOkResponseEventsMap.end())
-                                eventSystem.sendEvent(Event(events[jsonOkResponseEventsMap.at(responseEvent)], &evData, sizeof(evData)));
-                        }
-                        else if ((status >= HttpStatus::_400_BAD_REQUEST) && (status <= HttpStatus::_451_UNAVAILABLE_FOR_LEGAL_REASONS))
-                        {
-                            if (jsonFailResponseEventsMap.find(responseEvent) != jsonFailResponseEventsMap.end())
-                                eventSystem.sendEvent(Event(events[jsonFailResponseEventsMap.at(responseEvent)], &evData, sizeof(evData)));
-                        }
-                    }
-                }
-                else
-                {
-                    if ((status >= HttpStatus::_500_INTERNAL_SERVER_ERROR) && (status <= HttpStatus::_511_NETWORK_AUTHENTICATION_REQUIRED))
-                    {
-                        // 5xx codes mean that some issues are on server side. We'll treat this as disconnection, and try to establish a new one, starting from scratch
+                return;
+            }
 
-                        eventSystem.sendEvent(Event(events[Events::DISCONNECTED]));
-                    }
-                    else
-                    {
-                        *debugDevice << "Unhandled http status received: " << HttpMessage::getHttpStatusStr(status) << "\n";
-                    }
-                }
+            handleHttpResponse(response, cborOffered);
+        }
+
+        if (httpResponseParser.hasProtocolError())
+        {
+            LOG_WARNING(debugDevice) << "Malformed http response received\n";
+
+            httpResponseParser.reset();
+
+            eventSystem.sendEvent(Event(events[Events::DISCONNECTED]));
+        }
+    }
+
+    void SmartHomeDevice::handleHttpResponse(HttpResponse &response, const bool &cborOffered)
+    {
+        const auto &status = response.status;
+        auto       &body   = response.body;
+
+        if (status == 415)
+        {
+            // CBOR host has stopped accepting it. Start over with JSON, which any server speaks
+            if (wireFormat == WireFormat::CBOR)
+            {
+                wireFormat = WireFormat::JSON;
+                cborHost.clear();
+
+                eventSystem.sendEvent(Event(events[Events::DISCONNECTED]));
+                return;
+            }
+        }
+
+        if (!body.empty())
+        {
+            auto bodyFormat = response.header("content-type").compare(0, 16, "application/cbor") == 0 ? WireFormat::CBOR : WireFormat::JSON;
+
+            // the server answers in the format it prefers out of the offered ones. Requests follow it from now on.
+            // A request, which hasn't offered CBOR, is answered in JSON by any server: that's no reason to switch
+            if (cborOffered && (bodyFormat != wireFormat))
+            {
+                wireFormat = bodyFormat;
+                cborHost   = bodyFormat == WireFormat::CBOR ? connectedHost : std::string();
+
+                renderRequestTemplates();
+            }
+
+            if ((status >= 200) && (status <= 299))
+            {
+                serverSelector.reportSuccess();
+
+                handleServerEvent(body, true, bodyFormat);
+            }
+            else if ((status >= 400) && (status <= 499))
+                handleServerEvent(body, false, bodyFormat);
+        }
+        else
+        {
+            if ((status >= 500) && (status <= 599))
+            {
+                // 5xx codes mean that some issues are on server side. We'll treat this as disconnection, and try to establish a new one, starting from scratch
+
+                serverSelector.reportFailure();
+
+                eventSystem.sendEvent(Event(events[Events::DISCONNECTED]));
+            }
+            else
+            {
+                LOG_WARNING(debugDevice) << "Unhandled http status received: " << status << " " << response.reason << "\n";
+            }
+        }
+    }
+
+    void SmartHomeDevice::handleServerEvent(std::string &body, const bool &success, const WireFormat::Values &format)
+    {
+        ServerMessage message;
+
+        // parsed in place, the message refers to the body
+        auto parsed = format == WireFormat::CBOR ? parseServerMessageCbor(body, message) : parseServerMessage(&body[0], message);
+
+        if (!parsed || message.eventName.empty())
+            return;
+
+        for (const auto &command : SmartHomeDeviceCommands::list)
+        {
+            if ( (command.eventNameHash == message.eventNameHash) && message.eventName.equals(command.eventName) )
+            {
+                (this->*command.handler)(message, success);
+
+                return;
+            }
+        }
+    }
+
+    void SmartHomeDevice::cmd_deviceOnlineResponse(const ServerMessage &message, const bool &success)
+    {
+        if (!success)
+        {
+            eventSystem.sendEvent(Event(events[Events::DEVICE_ID_ERROR]));
+
+            return;
+        }
+
+        PayloadHandle payload;
+
+        auto serverResponse = eventPayloads.newServerResponse(payload);
+
+        if (serverResponse != nullptr)
+        {
+            serverResponse->hasDeviceId    = message.hasDeviceId;
+            serverResponse->deviceId       = message.deviceId;
+            serverResponse->nestedPayloads = message.payloadFormat.equals("nested");
+        }
+
+        sendEvent(Events::DEVICE_ID_RECEIVED, payload);
+    }
+
+    void SmartHomeDevice::cmd_setDeviceParameter(const ServerMessage &message, const bool &success)
+    {
+        if (!success || message.paramName.empty())
+            return;
+
+        auto paramHandle = params.find(message.paramName.str, message.paramName.length);
+
+        // CBOR sends COMBOBOX values as their index
+        if (message.hasParamValueIndex)
+        {
+            auto param      = params.get(paramHandle);
+            auto indexValue = param != nullptr ? param->getValueAt(message.paramValueIndex) : nullptr;
+
+            if (indexValue == nullptr)
+            {
+                LOG_WARNING(debugDevice) << "setDeviceParameter: no value " << message.paramValueIndex << " for " << message.paramName.toString() << "\n";
+                return;
+            }
+
+            commandValue = *indexValue;
+        }
+        else if (message.hasParamValue)
+            commandValue.assign(message.paramValue.str, message.paramValue.length);
+        else
+        {
+            LOG_WARNING(debugDevice) << "setDeviceParameter: no value for " << message.paramName.toString() << "\n";
+            return;
+        }
+
+        // the change is reported back like any other one, which lets the server know it's applied
+        if (!setParamValue(paramHandle, commandValue))
+            LOG_WARNING(debugDevice) << "setDeviceParameter: can't set " << message.paramName.toString() << "\n";
+    }
+
+    bool SmartHomeDevice::requestWebSocketUpgrade()
+    {
+        webSocketMaskState = getCurrentTime() ^ static_cast<uint32_t>(deviceId * 2654435761u);
+
+        auto key = WebSocket::makeKey(nextWebSocketMaskKey());
+
+        if (!sendHttpRequest(deviceStatusRequests.writeUpgrade(messageArena.startFrame(), key), false))
+            return false;
+
+        webSocketAcceptKey = WebSocket::makeAcceptKey(key);
+        webSocketState     = WebSocketState::UPGRADING;
+        webSocketDecoder.reset();
+
+        return true;
+    }
+
+    bool SmartHomeDevice::handleWebSocketUpgrade(const HttpResponse &response)
+    {
+        if ( (response.status == 101) && (response.header("sec-websocket-accept") == webSocketAcceptKey) )
+        {
+            webSocketState = WebSocketState::OPEN;
+
+            timerManager->stopTimer(deviceStatusRequestTimer);
+        }
+        else
+        {
+            // upgrade refused: the response is an ordinary HTTP one. Keep polling
+            webSocketState = WebSocketState::UNAVAILABLE;
+        }
+
+        // messages queued while the upgrade was in flight
+        drainOutboundQueue();
+
+        return webSocketState == WebSocketState::OPEN;
+    }
+
+    void SmartHomeDevice::handleWebSocketMessages()
+    {
+        auto &message = webSocketMessage;
+
+        while (webSocketDecoder.next(message))
+        {
+            switch (message.opcode)
+            {
+                case WebSocketOpcode::TEXT:
+                    serverSelector.reportSuccess();
+                    handleServerEvent(message.payload, true, WireFormat::JSON);
+                    break;
+
+                case WebSocketOpcode::BINARY:
+                    serverSelector.reportSuccess();
+                    handleServerEvent(message.payload, true, WireFormat::CBOR);
+                    break;
+
+                case WebSocketOpcode::PING:
+                    sendWebSocketMessage(WebSocketOpcode::PONG, message.payload);
+                    break;
+
+                case WebSocketOpcode::CLOSE:
+                    // the closing handshake is over with the reply, the transport is not going to be used again
+                    sendWebSocketMessage(WebSocketOpcode::CLOSE, std::string());
+                    disconnectFromServer();
+                    currentServerConnStatus = false;
+                    eventSystem.sendEvent(Event(events[Events::DISCONNECTED]));
+                    return;
+
+                default:
+                    break;
             }
         }
+
+        if (webSocketDecoder.hasProtocolError())
+        {
+            LOG_WARNING(debugDevice) << "WebSocket protocol error\n";
+
+            disconnectFromServer();
+            currentServerConnStatus = false;
+            eventSystem.sendEvent(Event(events[Events::DISCONNECTED]));
+        }
+    }
+
+    bool SmartHomeDevice::sendWebSocketMessage(const WebSocketOpcode::Values &opcode, const std::string &payload)
+    {
+        if (!connectedToServer())
+            return false;
+
+        auto &frame = messageArena.startFrame();
+
+        WebSocket::encodeFrame(frame, opcode, payload, nextWebSocketMaskKey());
+
+        sendData(frame);
+
+        return connectedToServer();
+    }
+
+    uint32_t SmartHomeDevice::nextWebSocketMaskKey()
+    {
+        // xorshift32, never returns 0 (0 would mean an unmasked frame)
+        if (webSocketMaskState == 0)
+            webSocketMaskState = 0x9E3779B9;
+
+        webSocketMaskState ^= webSocketMaskState << 13;
+        webSocketMaskState ^= webSocketMaskState >> 17;
+        webSocketMaskState ^= webSocketMaskState << 5;
+
+        return webSocketMaskState;
     }
 
     void SmartHomeDevice::fsm_saveDeviceId(const EventData &eventData)
     {
-        rapidjson::Document doc;
+        const auto &serverResponse = eventData.serverResponse();
+
+        if (serverResponse.hasDeviceId)
+        {
+            deviceId = serverResponse.deviceId;
+
+            renderRequestTemplates();
 
-        doc.Parse(eventData.data.serverResponseStr);
+            // server has accepted the device: it's up, following failures start with short delays again
+            retryScheduler.succeeded();
 
-        if (!doc.IsNull() && !doc.HasParseError())
-            deviceId = doc["deviceId"].GetInt();
+            if ( (configuration.preferredPayloadFormat == PayloadFormat::NESTED) && serverResponse.nestedPayloads )
+            {
+                payloadFormat      = PayloadFormat::NESTED;
+                nestedPayloadsHost = connectedHost;
+            }
+
+            if (configuration.useWebSocket && (webSocketState == WebSocketState::NONE))
+            {
+                (void)outboundQueue.push(OutboundKind::WEBSOCKET_UPGRADE);
+
+                drainOutboundQueue();
+            }
+        }
         else
-            eventSystem.sendEvent(Event(events[Events::FATAL_ERROR]));
+            sendFatalError("Server has registered the device without a device ID");
+    }
+
+    void SmartHomeDevice::fsm_flushParamChanges(const EventData &eventData)
+    {
+        (void)eventData;
+
+        paramsWindowOpen = false;
+
+        drainOutboundQueue();
     }
 
     void SmartHomeDevice::fsm_handleDeviceIdError(const EventData &eventData)
     {
+        (void)eventData;
+
+        // server might not understand NESTED payloads anymore - negotiate it from scratch
+        nestedPayloadsHost.clear();
+
         // try to reconnect. Then we will try to get device ID once more
         eventSystem.sendEvent(Event(events[Events::DISCONNECTED]));
     }
@@ -7,6 +7,16 @@
 #include "TimerManager.h"
 #include "DebugDevice.h"
 #include "DeviceParameter.h"
+#include "DeviceParameterRegistry.h"
+#include "WebSocket.h"
+#include "HttpResponseParser.h"
+#include "ServerMessage.h"
+#include "ServerSelector.h"
+#include "RetryScheduler.h"
+#include "MessageArena.h"
+#include "OutboundQueue.h"
+#include "DeviceStatusRequests.h"
+#include <atomic>
 
 namespace SmartHomeDevice_n
 {
@@ -15,6 +25,8 @@ namespace SmartHomeDevice_n
     using namespace HttpMessage_n;
     using namespace DebugDevice_n;
 
+    const unsigned long INVALID_DEVICE_ID = static_cast<unsigned long>(-1);   // until the server has assigned one
+
     namespace WifiStatus
     {
         enum Values : byte
@@ -29,6 +41,45 @@ namespace SmartHomeDevice_n
         };
     };
 
+    namespace PayloadFormat
+    {
+        enum Values : byte
+        {
+            LEGACY,     // parameters are embedded as JSON strings
+            NESTED      // parameters are embedded as JSON objects. Used only after the server has acknowledged it in deviceOnlineResponse
+        };
+    };
+
+    namespace WireFormat
+    {
+        enum Values : byte
+        {
+            JSON,
+            CBOR        // RFC 8949. Used only with a host, which has answered in CBOR
+        };
+    };
+
+    namespace WebSocketState
+    {
+        enum Values : byte
+        {
+            NONE,           // plain HTTP, server state is polled
+            UPGRADING,      // upgrade request is sent, waiting for 101 Switching Protocols
+            OPEN,           // messages are exchanged as WebSocket frames, no polling
+            UNAVAILABLE     // server has refused the upgrade. Polling is used until the next connection
+        };
+    };
+
+    namespace ConnectResult
+    {
+        enum Values : byte
+        {
+            NONE,           // not reported yet
+            SUCCEEDED,
+            FAILED
+        };
+    };
+
     struct WifiConfiguration
     {
         using KnownNetworks = std::map<std::string, std::string>;
@@ -42,6 +93,47 @@ namespace SmartHomeDevice_n
         const unsigned short  deviceStatusRequestTimeout;
         const byte            maxWifiConnectionRetries;
         const byte            maxServerConnectionRetries;
+        const PayloadFormat::Values preferredPayloadFormat = PayloadFormat::LEGACY;
+        const unsigned short  paramsFlushWindow  = 0;    // ms, during which parameter changes are coalesced. 0 reports every change immediately
+        const byte            maxParamsBatchSize = 16;   // pending changes, which trigger a flush before the window ends
+        const bool            useWebSocket       = false;  // upgrade server connection to WebSocket once device ID is received
+        const unsigned short  retryBackoffBase   = 0;      // ms, window of the first retry after a failure; doubles with every further one. 0 retries right away
+        const unsigned short  retryBackoffCap    = 60000;  // ms, the window stops growing here
+        const unsigned short  retryBackoffTick   = 100;    // ms, resolution of the retry delays
+        const WireFormat::Values preferredWireFormat = WireFormat::JSON;  // CBOR is offered in Accept; JSON servers just keep answering JSON
+        const unsigned short  messageArenaSize   = 0;      // bytes reserved in init() for an outbound message. 0 lets the buffers grow with the first messages
+        const unsigned short  outputFlushTimeout = 500;    // ms, given to the debug output during shutdown. Whatever is left after it is dropped
+    };
+
+    // handles a server message with the given eventName. 'success' is false for messages which came with 4xx status
+    using ServerCommandHandler = void (SmartHomeDevice::*)(const ServerMessage&, const bool&);
+
+    struct ServerCommand
+    {
+        const char          *eventName;
+        uint32_t             eventNameHash;
+        ServerCommandHandler handler;
+    };
+
+    template <size_t N>
+    constexpr bool hasDuplicateCommands(const ServerCommand (&commands)[N])
+    {
+        for (size_t i = 0; i < N; i++)
+        {
+            for (size_t j = i + 1; j < N; j++)
+            {
+                if (commands[i].eventNameHash == commands[j].eventNameHash)
+                    return true;
+            }
+        }
+
+        return false;
+    }
+
+    struct NetworkCandidate
+    {
+        NetworkInfo networkInfo;
+        int         score;
     };
 
     class SmartHomeDevice : public EventSubscriber, public Task
@@ -51,6 +143,7 @@ namespace SmartHomeDevice_n
         std::string   deviceName;
 
         EventSystem         eventSystem;
+        EventPayloads       eventPayloads;
         SmartHomeDeviceFsm  stateMachine;
         TimerManager       *timerManager;
         TaskManager         taskManager;
@@ -58,15 +151,17 @@ namespace SmartHomeDevice_n
 
         WifiConfiguration   configuration;
 
-        std::map<Events::Values, EventId> events;
+        EventId events[Events::COUNT];
 
-        std::list<DeviceParameter> paramsList;
+        DeviceParameterRegistry params;
 
         // timers
         TimerHandle networkScanTimer;
         TimerHandle wifiConnectionTimer;
         TimerHandle serverConnectionTimer;
         TimerHandle deviceStatusRequestTimer;
+        TimerHandle paramsFlushTimer;
+        TimerHandle outputFlushTimer;
 
         // misc variables
         std::string          connectedHost;
@@ -74,6 +169,57 @@ namespace SmartHomeDevice_n
         byte                 serverConnectionRetries;
         WifiStatus::Values   currentWifiStatus;
         bool                 currentServerConnStatus;
+        PayloadFormat::Values payloadFormat;
+        std::string          nestedPayloadsHost;  // last host, which has acknowledged NESTED payload format
+        WireFormat::Values   wireFormat;
+        std::string          cborHost;            // last host, which has answered in CBOR
+        OutboundQueue        outboundQueue;        // messages wait here while they can't be sent, e.g. during a reconnect
+        bool                 paramsWindowOpen;     // parameter changes are held in outboundQueue until paramsFlushTimer expires
+        std::vector<ParamHandle> paramsBatch;      // parameter changes taken from outboundQueue for one message
+        NetworkCandidate     networkCandidates[MAX_NETWORK_CANDIDATES];  // best first
+        byte                 networkCandidatesCount;
+        byte                 nextNetworkCandidate;
+        unsigned long        droppedScanResults;   // acceptable networks, which haven't made it into networkCandidates
+        bool                 lastGoodNetworkValid;
+        NetworkInfo          lastGoodNetwork;       // network of the last successful WiFi connection, tried first on reconnect
+        bool                 fastReconnectInProgress;
+        bool                 fastReconnectFailed;   // next fsm_startNetworksScan does a full scan
+        HttpResponseParser   httpResponseParser;
+        HttpResponse         httpResponse;         // passed to the parser again and again, so its buffers are reused
+        unsigned short       pendingHttpRequests;  // sent and not answered yet. Responses come back in the same order
+        uint32_t             cborOffers;           // bit per pending request, oldest first: set, if it has offered CBOR in Accept
+        unsigned int         httpRequestSentAt;    // oldest pending request went out, or the one before it was answered
+        ServerSelector       serverSelector;       // knownHosts, fastest healthy first. Survives reconnects
+        unsigned long        truncatedHostNames;   // picked hosts, which didn't fit into HostInfo
+        RetryScheduler       retryScheduler;
+        Events::Values       retryEvent;           // sent once the pending retry is due
+        PayloadHandle        retryPayload;
+        WebSocketState::Values webSocketState;
+        WebSocketDecoder     webSocketDecoder;
+        WebSocketMessage     webSocketMessage;     // same as httpResponse
+        std::string          webSocketAcceptKey;
+        uint32_t             webSocketMaskState;
+        mutable MessageArena messageArena;         // outbound messages are written here, one at a time
+        DeviceStatusRequests deviceStatusRequests; // rendered by renderRequestTemplates() for the host, device ID and wire format
+        std::string          commandValue;         // setDeviceParameter value, reused
+        bool                 shuttingDown;         // a fatal error was handled, the device resets once the steps are through
+        unsigned int         shutdownStartedAt;    // steps are logged relative to it
+        bool                 outputFlushReported;
+
+        // asynchronous connect: one WiFi or server connection attempt in flight, completed by the platform layer
+        bool                 asyncConnect;
+        bool                 wifiConnectInFlight;
+        bool                 serverConnectInFlight;
+        PayloadHandle        connectPayload;       // NetworkInfo / HostInfo of the attempt in flight, held until it completes
+        unsigned int         connectStartedAt;
+        std::atomic<byte>    wifiConnectResult;
+        std::atomic<byte>    serverConnectResult;
+
+        // readiness notifications, raised by the platform layer (possibly from an interrupt or another thread)
+        bool                 readinessNotifications;
+        std::atomic<bool>    wifiStatusChangedFlag;
+        std::atomic<bool>    serverDisconnectedFlag;
+        std::atomic<bool>    dataReadyFlag;
 
         // init funcs
         void initParamsList();
@@ -82,6 +228,67 @@ namespace SmartHomeDevice_n
         void initTimers();
         void initTaskManager();
 
+        // network selection
+        bool scoreNetwork(const NetworkInfo&, int&) const;
+        bool addNetworkCandidate(const NetworkInfo&);   // false for networks, which can't be joined; true even if ranked out
+
+        // events with payloads
+        void sendEvent(const Events::Values&, const PayloadHandle&);
+        void sendFatalError(const char *reason);                      // FATAL_ERROR with the reason as ErrorInfo payload
+        void forwardEvent(const Events::Values&, const EventData&);  // same payload as the event being handled, no copy
+        bool pickServer(PayloadHandle&);                              // current host of serverSelector as HostInfo payload
+        void retryLater(const RetryKind::Values&, const Events::Values&, const PayloadHandle&);  // after the backoff; takes over the payload reference
+        void cancelRetry();
+
+        // payloads
+        template <typename JsonWriter>
+        void writeParameter(JsonWriter&, const DeviceParameter&) const;
+        void writeParameter(CborWriter&, const DeviceParameter&) const;
+
+        // runs the writer function with a JSON or CBOR writer, whichever 'wireFormat' is. The message is written into
+        // messageArena, and the returned reference is valid until the next one is encoded
+        template <typename WriteFunc>
+        const std::string &encodeMessage(WriteFunc) const;
+        const char *contentType() const;
+        const char *acceptedContentTypes() const;
+
+        const std::string &makeParameterEvent(const char*, const DeviceParameter&) const;
+        const std::string &makeParametersEvent(const char*, const std::vector<ParamHandle>&) const;
+        const std::string &makeDeviceOnline() const;
+        // senders return false, if the message hasn't gone out: no connection, or it has been lost while writing
+        bool sendDeviceStatusMessage(const std::string&);
+        bool sendDeviceStatusRequest(const HttpMethod::Values&, const std::string *body);  // PUT registers the device, GET and POST carry its ID
+        void renderRequestTemplates();             // whenever connectedHost, deviceId or wireFormat change
+        bool sendHttpRequest(const std::string&, const bool &offersCbor);
+        void countPendingRequest(const bool &offersCbor);
+        void drainOutboundQueue();                 // entries leave the queue only once they are sent
+        bool sendParameterChanges();
+
+        void pollConnectionStatus();
+        void checkReadinessNotifications();
+
+        // connection attempts, same handling for the blocking and the asynchronous platform interface
+        void handleWifiConnectResult(const EventData&, const bool&);
+        void handleServerConnectResult(const EventData&, const bool&);
+        void checkConnectCompletions();
+        void abandonConnectAttempts();
+
+        // shutdown
+        void checkOutputFlushed();
+        unsigned int shutdownElapsed();
+
+        // server messages
+        void handleHttpResponses();
+        void handleHttpResponse(HttpResponse&, const bool &cborOffered);
+        void handleServerEvent(std::string&, const bool&, const WireFormat::Values&);
+
+        // WebSocket
+        bool requestWebSocketUpgrade();
+        bool handleWebSocketUpgrade(const HttpResponse&);
+        void handleWebSocketMessages();
+        bool sendWebSocketMessage(const WebSocketOpcode::Values&, const std::string&);
+        uint32_t nextWebSocketMaskKey();
+
         // FSM callbacks
         void fsm_startNetworksScan(const EventData&);
         void fsm_tryToPickANetwork(const EventData&);
@@ -89,19 +296,32 @@ namespace SmartHomeDevice_n
         void fsm_startServerConnection(const EventData&);
         void fsm_connectToServer(const EventData&);
         void fsm_handleFatalError(const EventData&);
+        void fsm_flushOutput(const EventData&);
+        void fsm_disconnectFromWiFi(const EventData&);
+        void fsm_resetDevice(const EventData&);
         void fsm_handleConnectionToServer(const EventData&);
         void fsm_requestDeviceStatus(const EventData&);
         void fsm_goIdle(const EventData&);
+        void fsm_scheduleReconnect(const EventData&);
         void fsm_readData(const EventData&);
         void fsm_saveDeviceId(const EventData&);
         void fsm_handleDeviceIdError(const EventData&);
+        void fsm_flushParamChanges(const EventData&);
+
+        // server commands, see SmartHomeDeviceCommands
+        void cmd_deviceOnlineResponse(const ServerMessage&, const bool&);
+        void cmd_setDeviceParameter(const ServerMessage&, const bool&);
 
         SmartHomeDevice() = delete;
 
+        friend struct SmartHomeDeviceTransitions;  // builds the FSM table out of the private callbacks
+        friend struct SmartHomeDeviceCommands;     // same for server commands
+
     protected:
         // WiFi interface
         virtual std::string         getMacAddress() = 0;
         virtual void                connectToWiFi(const std::string &ssid, const std::string &password) = 0;
+        virtual void                connectToWiFiOnChannel(const std::string &ssid, const std::string &password, const int &channel); // skips the channel sweep, where the radio supports it
         virtual void                disconnectFromWiFi() = 0;
         virtual void                scanForNetworks(std::function<void(int)> scanCallback) = 0;
         virtual NetworkInfo         getInfoForNetwork(const byte &networkNumber) = 0;
@@ -116,11 +336,40 @@ namespace SmartHomeDevice_n
         virtual void                reset() = 0;
         virtual void                debugPrint(const std::string &debugMessage) = 0;
 
+        // Readiness interface. A platform, which knows when the link changes (interrupts, epoll, radio stack callbacks),
+        // returns true here and calls the notify methods below; getWifiStatus(), connectedToServer() and dataAvailable()
+        // are then no longer polled on every tick. readData() is expected to return everything received so far,
+        // notifyDataReady() has to be called again for data arriving later. Otherwise the status is polled as before
+        virtual bool                readinessNotificationsSupported() { return false; }
+
+        // safe to call from an interrupt or another thread
+        void notifyWifiStatusChanged();
+        void notifyServerDisconnected();
+        void notifyDataReady();
+
+        // Asynchronous connect interface. A platform, which can associate and open the TCP connection in the background,
+        // returns true here and implements the start methods: they return right away, and the outcome is reported later
+        // through the notify methods below. The device loop keeps running meanwhile, and the attempt is bounded by the
+        // connection timers; an attempt, which is given up on, is cancelled with disconnectFromWiFi() / disconnectFromServer().
+        // Otherwise the blocking connectToWiFiOnChannel() / connectToServer() are used
+        virtual bool                asyncConnectSupported() { return false; }
+        virtual void                startConnectToWiFi(const std::string &ssid, const std::string &password, const int &channel);
+        virtual void                startConnectToServer(const std::string &host, const unsigned short &port);
+
+        // safe to call from an interrupt or another thread
+        void notifyWifiConnectCompleted(const bool &success);
+        void notifyServerConnectCompleted(const bool &success);
+
         void sendHttpMessage(const HttpMessage&);
 
         bool addParam(const DeviceParameter&);
         bool setParamValue(const std::string&, const std::string&);
         const std::string &getParamValue(const std::string&);
+
+        // handle based access, for callers which update the same parameters often
+        ParamHandle getParamHandle(const std::string&) const;
+        bool setParamValue(const ParamHandle&, const std::string&);
+        const std::string &getParamValue(const ParamHandle&);
     public:
         SmartHomeDevice(const std::string&, const WifiConfiguration&);
         virtual ~SmartHomeDevice();
@@ -131,6 +380,15 @@ namespace SmartHomeDevice_n
 
         void run(); // use this method in a loop for the system to be in working state.
 
+        State::Values getState();
+        const unsigned long &getProcessedEventsCount() const;
+        const RetryStatistics &getRetryStatistics() const;
+        unsigned long getMessageArenaOverflows() const;
+        const OutboundQueueStatistics &getOutboundQueueStatistics() const;
+        const unsigned long &getEventPayloadsExhausted() const;
+        const unsigned long &getDroppedScanResults() const;
+        const unsigned long &getTruncatedHostNames() const;
+
         void onEvent(EventSystem*, const Event&) override;
     };
 }
\ No newline at end of file
@@ -1,24 +1,170 @@
 #include "SmartHomeDeviceFsm.h"
+#include "SmartHomeDevice.h"
 
 namespace SmartHomeDevice_n
 {
-    SmartHomeDeviceFsm::SmartHomeDeviceFsm(const State::Values &initialState) : StateMachine(initialState), debugDevice(nullptr) { }
+    static const char *payloadTypeToString(const PayloadType::Values &type)
+    {
+        switch (type)
+        {
+            case PayloadType::NETWORK_INFO:    return "NetworkInfo";
+            case PayloadType::HOST_INFO:       return "HostInfo";
+            case PayloadType::ERROR_INFO:      return "ErrorInfo";
+            case PayloadType::SERVER_RESPONSE: return "ServerResponse";
+
+            default: return "NONE";
+        }
+    }
+
+    EventPayloads::EventPayloads() : debugDevice(nullptr), exhausted(0) { }
+
+    template <typename Payload, typename Pool>
+    Payload *EventPayloads::acquire(Pool &pool, const PayloadType::Values &type, PayloadHandle &handle)
+    {
+        auto slot = pool.acquire();
+
+        if (slot == INVALID_PAYLOAD_SLOT)
+        {
+            exhausted++;
+
+            LOG_WARNING(debugDevice) << "Event payloads: " << payloadTypeToString(type) << " pool exhausted\n";
+
+            handle = NO_PAYLOAD;
+
+            return nullptr;
+        }
+
+        handle.type = type;
+        handle.slot = slot;
+
+        return pool.get(slot);
+    }
+
+    NetworkInfo *EventPayloads::newNetworkInfo(PayloadHandle &handle)
+    {
+        return acquire<NetworkInfo>(networkInfos, PayloadType::NETWORK_INFO, handle);
+    }
+
+    HostInfo *EventPayloads::newHostInfo(PayloadHandle &handle)
+    {
+        return acquire<HostInfo>(hostInfos, PayloadType::HOST_INFO, handle);
+    }
+
+    ErrorInfo *EventPayloads::newErrorInfo(PayloadHandle &handle)
+    {
+        return acquire<ErrorInfo>(errors, PayloadType::ERROR_INFO, handle);
+    }
 
-    std::string SmartHomeDeviceFsm::stateToString(const State::Values &state) const
+    ServerResponse *EventPayloads::newServerResponse(PayloadHandle &handle)
+    {
+        return acquire<ServerResponse>(serverResponses, PayloadType::SERVER_RESPONSE, handle);
+    }
+
+    const void *EventPayloads::get(const PayloadHandle &handle)
+    {
+        switch (handle.type)
+        {
+            case PayloadType::NETWORK_INFO:    return networkInfos.get(handle.slot);
+            case PayloadType::HOST_INFO:       return hostInfos.get(handle.slot);
+            case PayloadType::ERROR_INFO:      return errors.get(handle.slot);
+            case PayloadType::SERVER_RESPONSE: return serverResponses.get(handle.slot);
+
+            default: return nullptr;
+        }
+    }
+
+    void EventPayloads::addRef(const PayloadHandle &handle)
+    {
+        switch (handle.type)
+        {
+            case PayloadType::NETWORK_INFO:    networkInfos.addRef(handle.slot);    break;
+            case PayloadType::HOST_INFO:       hostInfos.addRef(handle.slot);       break;
+            case PayloadType::ERROR_INFO:      errors.addRef(handle.slot);          break;
+            case PayloadType::SERVER_RESPONSE: serverResponses.addRef(handle.slot); break;
+
+            default: break;
+        }
+    }
+
+    void EventPayloads::release(const PayloadHandle &handle)
+    {
+        switch (handle.type)
+        {
+            case PayloadType::NETWORK_INFO:    networkInfos.release(handle.slot);    break;
+            case PayloadType::HOST_INFO:       hostInfos.release(handle.slot);       break;
+            case PayloadType::ERROR_INFO:      errors.release(handle.slot);          break;
+            case PayloadType::SERVER_RESPONSE: serverResponses.release(handle.slot); break;
+
+            default: break;
+        }
+    }
+
+    void EventPayloads::setDebugDevice(DebugDevice *debugDevice)
+    {
+        this->debugDevice = debugDevice;
+    }
+
+    const unsigned long &EventPayloads::getExhaustedCount() const
+    {
+        return exhausted;
+    }
+
+    const NetworkInfo &EventData::networkInfo() const
+    {
+        static const NetworkInfo empty = {};
+
+        return ( (payload.type == PayloadType::NETWORK_INFO) && (payloadData != nullptr) ) ? *static_cast<const NetworkInfo*>(payloadData) : empty;
+    }
+
+    const HostInfo &EventData::hostInfo() const
+    {
+        static const HostInfo empty = {};
+
+        return ( (payload.type == PayloadType::HOST_INFO) && (payloadData != nullptr) ) ? *static_cast<const HostInfo*>(payloadData) : empty;
+    }
+
+    const char *EventData::errorStr() const
+    {
+        return ( (payload.type == PayloadType::ERROR_INFO) && (payloadData != nullptr) ) ? static_cast<const ErrorInfo*>(payloadData)->errorStr : "";
+    }
+
+    const ServerResponse &EventData::serverResponse() const
+    {
+        static const ServerResponse empty = {};
+
+        return ( (payload.type == PayloadType::SERVER_RESPONSE) && (payloadData != nullptr) ) ? *static_cast<const ServerResponse*>(payloadData) : empty;
+    }
+
+    SmartHomeDeviceFsm::SmartHomeDeviceFsm(const State::Values &initialState, SmartHomeDevice *owner, const FsmTransitionTable &transitions, const EventId *eventIds, EventPayloads &payloads)
+    : currentState(initialState),
+      owner(owner),
+      transitions(transitions),
+      eventIds(eventIds),
+      payloads(payloads),
+      debugDevice(nullptr),
+      processedEvents(0),
+      ignoredEventsLogged()
+    {
+    }
+
+    const char *SmartHomeDeviceFsm::stateToString(const State::Values &state) const
     {
         switch (state)
         {
-            case State::INITIAL:              return "INITIAL";
-            case State::NETWORK_SCANNING:     return "NETWORK_SCANNING";
-            case State::CONNECTING_TO_WIFI:   return "CONNECTING_TO_WIFI";
-            case State::CONNECTING_TO_SERVER: return "CONNECTING_TO_SERVER";
-            case State::CONNECTED:            return "CONNECTED";
+            case State::INITIAL:                    return "INITIAL";
+            case State::NETWORK_SCANNING:           return "NETWORK_SCANNING";
+            case State::CONNECTING_TO_WIFI:         return "CONNECTING_TO_WIFI";
+            case State::CONNECTING_TO_SERVER:       return "CONNECTING_TO_SERVER";
+            case State::CONNECTED:                  return "CONNECTED";
+            case State::DISCONNECTING_FROM_SERVER:  return "DISCONNECTING_FROM_SERVER";
+            case State::FLUSHING_OUTPUT:            return "FLUSHING_OUTPUT";
+            case State::DISCONNECTING_FROM_WIFI:    return "DISCONNECTING_FROM_WIFI";
             
         default: return "UNKNOWN_STATE";
         }
     }
 
-    std::string SmartHomeDeviceFsm::eventToString(const EventId &event) const
+    const char *SmartHomeDeviceFsm::eventToString(const Events::Values &event) const
     {
         switch (event)
         {
@@ -37,10 +183,16 @@ namespace SmartHomeDevice_n
             case Events::SERVER_CONNECTION_RETRIES_EXHAUSTED:   return "SERVER_CONNECTION_RETRIES_EXHAUSTED";
             case Events::SERVER_CONNECTION_TIMEOUT:             return "SERVER_CONNECTION_TIMEOUT";
             case Events::DEVICE_STATUS_REQUEST_TIMEOUT:         return "DEVICE_STATUS_REQUEST_TIMEOUT";
+            case Events::PARAMS_FLUSH_TIMEOUT:                  return "PARAMS_FLUSH_TIMEOUT";
             case Events::DATA_AVAILABLE:                        return "DATA_AVAILABLE";
             case Events::DEVICE_ID_RECEIVED:                    return "DEVICE_ID_RECEIVED";
             case Events::DEVICE_ID_ERROR:                       return "DEVICE_ID_ERROR";
             case Events::DISCONNECTED:                          return "DISCONNECTED";
+            case Events::RECONNECT_BACKOFF_EXPIRED:             return "RECONNECT_BACKOFF_EXPIRED";
+            case Events::SERVER_DISCONNECTED:                   return "SERVER_DISCONNECTED";
+            case Events::OUTPUT_FLUSHED:                        return "OUTPUT_FLUSHED";
+            case Events::OUTPUT_FLUSH_TIMEOUT:                  return "OUTPUT_FLUSH_TIMEOUT";
+            case Events::WIFI_DISCONNECTED:                     return "WIFI_DISCONNECTED";
             case Events::TIMER_EXPIRED:                         return "TIMER_EXPIRED";
             case Events::FATAL_ERROR:                           return "FATAL_ERROR";
             
@@ -48,19 +200,85 @@ namespace SmartHomeDevice_n
         }
     }
 
+    Events::Values SmartHomeDeviceFsm::toEvent(const EventId &eventId) const
+    {
+        // event IDs are created in one go, so normally they are contiguous and the offset is the index
+        auto offset = static_cast<size_t>(eventId - eventIds[0]);
+
+        if ( (offset < Events::COUNT) && (eventIds[offset] == eventId) )
+            return static_cast<Events::Values>(offset);
+
+        for (byte event = 0; event < Events::COUNT; event++)
+        {
+            if (eventIds[event] == eventId)
+                return static_cast<Events::Values>(event);
+        }
+
+        return Events::COUNT;
+    }
+
+    void SmartHomeDeviceFsm::execute(const Events::Values &event, const EventData &eventData)
+    {
+        if ( (currentState >= State::COUNT) || (event >= Events::COUNT) )
+            return;
+
+        const auto &transition = transitions.cells[currentState][event];
+
+        if (transition.callback == nullptr)
+        {
+            // ignored events tend to repeat with every poll; the first one in a state is enough to see that it is not handled
+            auto eventBit = static_cast<uint32_t>(1) << event;
+
+            if ((ignoredEventsLogged[currentState] & eventBit) != 0)
+                return;
+
+            ignoredEventsLogged[currentState] |= eventBit;
+
+            LOG_VERBOSE(debugDevice) << "FSM: " << eventToString(event) << " ignored in " << stateToString(currentState) << "\n";
+
+            return;
+        }
+
+        if (transition.to != currentState)
+            LOG_VERBOSE(debugDevice) << "FSM: " << stateToString(currentState) << " -> " << stateToString(transition.to) << " on " << eventToString(event) << "\n";
+
+        currentState = transition.to;
+
+        (owner->*transition.callback)(eventData);
+    }
+
+    const State::Values &SmartHomeDeviceFsm::state() const
+    {
+        return currentState;
+    }
+
     void SmartHomeDeviceFsm::onEvent(EventSystem* sender, const Event &event)
     {
         EventData eventData;
 
-        eventData.sender = sender;
+        eventData.sender  = sender;
+        eventData.payload = NO_PAYLOAD;
 
-        event.getData(&eventData.data, sizeof(eventData.data));
+        // only the handle is copied out of the event
+        event.getData(&eventData.payload, sizeof(eventData.payload));
 
-        execute(event.getId(), eventData, debugDevice);
+        eventData.payloadData = payloads.get(eventData.payload);
+
+        processedEvents++;
+
+        execute(toEvent(event.getId()), eventData);
+
+        // the reference of this event. Callbacks, which forward the payload, have taken their own
+        payloads.release(eventData.payload);
     }
 
     void SmartHomeDeviceFsm::setDebugDevice(DebugDevice *debugDevice)
     {
         this->debugDevice = debugDevice;
     }
+
+    const unsigned long &SmartHomeDeviceFsm::getProcessedEventsCount() const
+    {
+        return processedEvents;
+    }
 }
\ No newline at end of file
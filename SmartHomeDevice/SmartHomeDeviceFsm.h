@@ -1,17 +1,26 @@
 #pragma once
 
-#include "StateMachine.hpp"
 #include "EventSystem.h"
 #include "DebugDevice.h"
+#include "EventPayloadPool.h"
+#include <cstddef>
+#include <cstdint>
 
 namespace SmartHomeDevice_n
 {
     #define MAX_SSID_LENGTH 64
     #define MAX_ERROR_LENGTH 128
     #define MAX_HOSTNAME_LENGTH 64
-    #define MAX_SERVER_RESPONSE_LEN 256
+
+    // best scan results kept as connection candidates
+    #define MAX_NETWORK_CANDIDATES 8
+
+    // event payload pool sizes
+    #define MAX_NETWORK_INFO_PAYLOADS 4
+    #define MAX_HOST_INFO_PAYLOADS 8
+    #define MAX_ERROR_PAYLOADS 2
+    #define MAX_SERVER_RESPONSE_PAYLOADS 4
     
-    using namespace FSM;
     using namespace EventSystem_n;
     using namespace DebugDevice_n;
 
@@ -25,7 +34,14 @@ namespace SmartHomeDevice_n
             NETWORK_SCANNING,
             CONNECTING_TO_WIFI,
             CONNECTING_TO_SERVER,
-            CONNECTED
+            CONNECTED,
+
+            // staged shutdown after a fatal error, ends with reset()
+            DISCONNECTING_FROM_SERVER,
+            FLUSHING_OUTPUT,
+            DISCONNECTING_FROM_WIFI,
+
+            COUNT
         };
     }
 
@@ -48,12 +64,20 @@ namespace SmartHomeDevice_n
             SERVER_CONNECTION_RETRIES_EXHAUSTED,
             SERVER_CONNECTION_TIMEOUT,
             DEVICE_STATUS_REQUEST_TIMEOUT,
+            PARAMS_FLUSH_TIMEOUT,
             DATA_AVAILABLE,
             DEVICE_ID_RECEIVED,
             DEVICE_ID_ERROR,
             DISCONNECTED,
+            RECONNECT_BACKOFF_EXPIRED,
+            SERVER_DISCONNECTED,        // shutdown steps. DISCONNECTED above is a link lost on its own
+            OUTPUT_FLUSHED,
+            OUTPUT_FLUSH_TIMEOUT,
+            WIFI_DISCONNECTED,
             TIMER_EXPIRED,
-            FATAL_ERROR
+            FATAL_ERROR,
+
+            COUNT
         };
     };
 
@@ -71,33 +95,160 @@ namespace SmartHomeDevice_n
         unsigned short port;
     };
 
-    struct EventData
+    struct ErrorInfo
     {
-        EventSystem *sender;
+        char errorStr[MAX_ERROR_LENGTH];
+    };
 
-        union
+    // fields of deviceOnlineResponse
+    struct ServerResponse
+    {
+        bool          hasDeviceId;
+        unsigned long deviceId;
+        bool          nestedPayloads;
+    };
+
+    namespace PayloadType
+    {
+        enum Values : byte
         {
-            NetworkInfo networkInfo;
-            HostInfo hostInfo;
-            char errorStr[MAX_ERROR_LENGTH];
-            char serverResponseStr[MAX_SERVER_RESPONSE_LEN];
+            NONE,
+            NETWORK_INFO,
+            HOST_INFO,
+            ERROR_INFO,
+            SERVER_RESPONSE
+        };
+    };
 
-        } data;
+    // this is what travels inside Event. The payload itself stays in EventPayloads
+    struct PayloadHandle
+    {
+        PayloadType::Values type;
+        PayloadSlot         slot;
     };
 
-    class SmartHomeDeviceFsm : public StateMachine<State::Values, EventId, EventData, DebugDevice>, public EventSubscriber
+    const PayloadHandle NO_PAYLOAD = {PayloadType::NONE, INVALID_PAYLOAD_SLOT};
+
+    // per-device pools of event payloads, one per payload type
+    class EventPayloads
     {
     private:
-        DebugDevice *debugDevice;
+        EventPayloadPool<NetworkInfo,    MAX_NETWORK_INFO_PAYLOADS>    networkInfos;
+        EventPayloadPool<HostInfo,       MAX_HOST_INFO_PAYLOADS>       hostInfos;
+        EventPayloadPool<ErrorInfo,      MAX_ERROR_PAYLOADS>           errors;
+        EventPayloadPool<ServerResponse, MAX_SERVER_RESPONSE_PAYLOADS> serverResponses;
+
+        DebugDevice   *debugDevice;
+        unsigned long  exhausted;
+
+        template <typename Payload, typename Pool>
+        Payload *acquire(Pool&, const PayloadType::Values&, PayloadHandle&);
 
     public:
-        explicit SmartHomeDeviceFsm(const State::Values&);
+        EventPayloads();
+
+        // all of them return nullptr (and NO_PAYLOAD in the handle) when the pool is exhausted. That's logged and counted
+        NetworkInfo    *newNetworkInfo(PayloadHandle&);
+        HostInfo       *newHostInfo(PayloadHandle&);
+        ErrorInfo      *newErrorInfo(PayloadHandle&);
+        ServerResponse *newServerResponse(PayloadHandle&);
+
+        const void *get(const PayloadHandle&);
+
+        void addRef(const PayloadHandle&);
+        void release(const PayloadHandle&);
+
+        void setDebugDevice(DebugDevice*);
+
+        const unsigned long &getExhaustedCount() const;
+    };
 
-        std::string stateToString(const State::Values&) const override;
-        std::string eventToString(const EventId&) const override;
+    struct EventData
+    {
+        EventSystem   *sender;
+        PayloadHandle  payload;
+        const void    *payloadData;     // resolved 'payload', valid for the duration of the FSM callback
+
+        // empty values, if the event carries a different payload or none
+        const NetworkInfo &networkInfo() const;
+        const HostInfo    &hostInfo() const;
+        const char        *errorStr() const;
+        const ServerResponse &serverResponse() const;
+    };
+
+    class SmartHomeDevice;
+
+    using FsmCallback = void (SmartHomeDevice::*)(const EventData&);
+
+    struct FsmTransition
+    {
+        State::Values  from;
+        Events::Values event;
+        State::Values  to;
+        FsmCallback    callback;  // every transition has one, so an empty table cell has nullptr here
+    };
+
+    // dense state x event lookup, built at compile time from the list of transitions
+    struct FsmTransitionTable
+    {
+        FsmTransition cells[State::COUNT][Events::COUNT];
+    };
+
+    template <size_t N>
+    constexpr bool hasDuplicateTransitions(const FsmTransition (&transitions)[N])
+    {
+        for (size_t i = 0; i < N; i++)
+        {
+            for (size_t j = i + 1; j < N; j++)
+            {
+                if ( (transitions[i].from == transitions[j].from) && (transitions[i].event == transitions[j].event) )
+                    return true;
+            }
+        }
+
+        return false;
+    }
+
+    template <size_t N>
+    constexpr FsmTransitionTable makeTransitionTable(const FsmTransition (&transitions)[N])
+    {
+        FsmTransitionTable table {};
+
+        for (size_t i = 0; i < N; i++)
+            table.cells[transitions[i].from][transitions[i].event] = transitions[i];
+
+        return table;
+    }
+
+    class SmartHomeDeviceFsm : public EventSubscriber
+    {
+    private:
+        State::Values             currentState;
+        SmartHomeDevice          *owner;
+        const FsmTransitionTable &transitions;
+        const EventId            *eventIds;     // Events::Values -> EventId, Events::COUNT entries
+        EventPayloads            &payloads;
+        DebugDevice              *debugDevice;
+        unsigned long             processedEvents;
+        uint32_t                  ignoredEventsLogged[State::COUNT];   // bit per event; an ignored event is logged once in every state
+
+        static_assert(Events::COUNT <= 32, "ignoredEventsLogged has a bit per event");
+
+        Events::Values toEvent(const EventId&) const;
+
+    public:
+        SmartHomeDeviceFsm(const State::Values&, SmartHomeDevice*, const FsmTransitionTable&, const EventId*, EventPayloads&);
+
+        const char *stateToString(const State::Values&) const;
+        const char *eventToString(const Events::Values&) const;
+
+        void execute(const Events::Values&, const EventData&);
+        const State::Values &state() const;
 
         void onEvent(EventSystem*, const Event&) override;
 
         void setDebugDevice(DebugDevice*);
+
+        const unsigned long &getProcessedEventsCount() const;
     };
 }
\ No newline at end of file
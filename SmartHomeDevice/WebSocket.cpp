@@ -0,0 +1,313 @@
+#include "WebSocket.h"
+
+namespace SmartHomeDevice_n
+{
+    static const char *WEBSOCKET_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+    static const size_t MAX_WEBSOCKET_MESSAGE_LEN = 64 * 1024;
+
+    static inline uint32_t rotateLeft(const uint32_t &value, const unsigned int &bits)
+    {
+        return (value << bits) | (value >> (32 - bits));
+    }
+
+    std::string WebSocket::sha1(const std::string &data)
+    {
+        uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+
+        std::string message = data;
+
+        uint64_t bitLength = static_cast<uint64_t>(data.size()) * 8;
+
+        message += static_cast<char>(0x80);
+
+        while ((message.size() % 64) != 56)
+            message += static_cast<char>(0x00);
+
+        for (int i = 7; i >= 0; i--)
+            message += static_cast<char>((bitLength >> (i * 8)) & 0xFF);
+
+        for (size_t chunk = 0; chunk < message.size(); chunk += 64)
+        {
+            uint32_t w[80];
+
+            for (int i = 0; i < 16; i++)
+            {
+                w[i] = (static_cast<uint32_t>(static_cast<unsigned char>(message[chunk + i * 4]))     << 24) |
+                       (static_cast<uint32_t>(static_cast<unsigned char>(message[chunk + i * 4 + 1])) << 16) |
+                       (static_cast<uint32_t>(static_cast<unsigned char>(message[chunk + i * 4 + 2])) << 8)  |
+                       (static_cast<uint32_t>(static_cast<unsigned char>(message[chunk + i * 4 + 3])));
+            }
+
+            for (int i = 16; i < 80; i++)
+                w[i] = rotateLeft(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+            uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+
+            for (int i = 0; i < 80; i++)
+            {
+                uint32_t f, k;
+
+                if (i < 20)      { f = (b & c) | (~b & d);          k = 0x5A827999; }
+                else if (i < 40) { f = b ^ c ^ d;                   k = 0x6ED9EBA1; }
+                else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC; }
+                else             { f = b ^ c ^ d;                   k = 0xCA62C1D6; }
+
+                uint32_t temp = rotateLeft(a, 5) + f + e + k + w[i];
+
+                e = d;
+                d = c;
+                c = rotateLeft(b, 30);
+                b = a;
+                a = temp;
+            }
+
+            h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+        }
+
+        std::string digest;
+
+        for (auto word : h)
+        {
+            for (int i = 3; i >= 0; i--)
+                digest += static_cast<char>((word >> (i * 8)) & 0xFF);
+        }
+
+        return digest;
+    }
+
+    std::string WebSocket::base64Encode(const std::string &data)
+    {
+        static const char *alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+        std::string encoded;
+
+        encoded.reserve(((data.size() + 2) / 3) * 4);
+
+        for (size_t i = 0; i < data.size(); i += 3)
+        {
+            uint32_t triple = static_cast<uint32_t>(static_cast<unsigned char>(data[i])) << 16;
+
+            if (i + 1 < data.size()) triple |= static_cast<uint32_t>(static_cast<unsigned char>(data[i + 1])) << 8;
+            if (i + 2 < data.size()) triple |= static_cast<uint32_t>(static_cast<unsigned char>(data[i + 2]));
+
+            encoded += alphabet[(triple >> 18) & 0x3F];
+            encoded += alphabet[(triple >> 12) & 0x3F];
+            encoded += (i + 1 < data.size()) ? alphabet[(triple >> 6) & 0x3F] : '=';
+            encoded += (i + 2 < data.size()) ? alphabet[triple & 0x3F] : '=';
+        }
+
+        return encoded;
+    }
+
+    std::string WebSocket::makeKey(const uint32_t &seed)
+    {
+        // xorshift is good enough here: the key only has to differ between handshakes
+        uint32_t state = seed != 0 ? seed : 0x9E3779B9;
+
+        std::string nonce;
+
+        for (int i = 0; i < 16; i++)
+        {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+
+            nonce += static_cast<char>(state & 0xFF);
+        }
+
+        return base64Encode(nonce);
+    }
+
+    std::string WebSocket::makeAcceptKey(const std::string &key)
+    {
+        return base64Encode(sha1(key + WEBSOCKET_GUID));
+    }
+
+    void WebSocket::encodeFrame(std::string &frame, const WebSocketOpcode::Values &opcode, const std::string &payload, const uint32_t &maskKey)
+    {
+        auto length = payload.size();
+        auto masked = maskKey != 0;
+
+        frame += static_cast<char>(0x80 | opcode);   // FIN, never fragmented on our side
+
+        if (length < 126)
+            frame += static_cast<char>((masked ? 0x80 : 0x00) | length);
+        else if (length <= 0xFFFF)
+        {
+            frame += static_cast<char>((masked ? 0x80 : 0x00) | 126);
+            frame += static_cast<char>((length >> 8) & 0xFF);
+            frame += static_cast<char>(length & 0xFF);
+        }
+        else
+        {
+            frame += static_cast<char>((masked ? 0x80 : 0x00) | 127);
+
+            for (int i = 7; i >= 0; i--)
+                frame += static_cast<char>((static_cast<uint64_t>(length) >> (i * 8)) & 0xFF);
+        }
+
+        if (!masked)
+        {
+            frame += payload;
+            return;
+        }
+
+        char mask[4] =
+        {
+            static_cast<char>((maskKey >> 24) & 0xFF),
+            static_cast<char>((maskKey >> 16) & 0xFF),
+            static_cast<char>((maskKey >> 8)  & 0xFF),
+            static_cast<char>(maskKey & 0xFF)
+        };
+
+        frame.append(mask, 4);
+
+        auto payloadStart = frame.size();
+
+        frame += payload;
+
+        for (size_t i = 0; i < length; i++)
+            frame[payloadStart + i] ^= mask[i % 4];
+    }
+
+    std::string WebSocket::encodeFrame(const WebSocketOpcode::Values &opcode, const std::string &payload, const uint32_t &maskKey)
+    {
+        std::string frame;
+
+        encodeFrame(frame, opcode, payload, maskKey);
+
+        return frame;
+    }
+
+    WebSocketDecoder::WebSocketDecoder() : consumed(0), fragmentsOpcode(WebSocketOpcode::TEXT), protocolError(false) { }
+
+    void WebSocketDecoder::feed(const std::string &data)
+    {
+        feed(data.data(), data.size());
+    }
+
+    void WebSocketDecoder::feed(const char *data, const size_t &length)
+    {
+        // drop the consumed prefix only when new data arrives, so next() never moves memory
+        if (consumed > 0)
+        {
+            buffer.erase(0, consumed);
+            consumed = 0;
+        }
+
+        buffer.append(data, length);
+    }
+
+    bool WebSocketDecoder::next(WebSocketMessage &message)
+    {
+        while (!protocolError)
+        {
+            auto available = buffer.size() - consumed;
+
+            if (available < 2)
+                return false;
+
+            auto header  = reinterpret_cast<const unsigned char*>(buffer.data() + consumed);
+            auto fin     = (header[0] & 0x80) != 0;
+            auto opcode  = static_cast<WebSocketOpcode::Values>(header[0] & 0x0F);
+            auto masked  = (header[1] & 0x80) != 0;
+            uint64_t length = header[1] & 0x7F;
+
+            size_t headerLength = 2;
+
+            if (length == 126)
+            {
+                if (available < 4)
+                    return false;
+
+                length = (static_cast<uint64_t>(header[2]) << 8) | header[3];
+                headerLength = 4;
+            }
+            else if (length == 127)
+            {
+                if (available < 10)
+                    return false;
+
+                length = 0;
+
+                for (int i = 0; i < 8; i++)
+                    length = (length << 8) | header[2 + i];
+
+                headerLength = 10;
+            }
+
+            if (length > MAX_WEBSOCKET_MESSAGE_LEN)
+            {
+                protocolError = true;
+                return false;
+            }
+
+            auto maskOffset = headerLength;
+
+            if (masked)
+                headerLength += 4;
+
+            if (available < headerLength + length)
+                return false;
+
+            payload.assign(buffer, consumed + headerLength, static_cast<size_t>(length));
+
+            if (masked)
+            {
+                for (size_t i = 0; i < payload.size(); i++)
+                    payload[i] ^= static_cast<char>(header[maskOffset + (i % 4)]);
+            }
+
+            consumed += headerLength + static_cast<size_t>(length);
+
+            if (opcode >= WebSocketOpcode::CLOSE)
+            {
+                message.opcode  = opcode;
+                message.payload = payload;
+
+                return true;
+            }
+
+            if (opcode != WebSocketOpcode::CONTINUATION)
+            {
+                fragmentsOpcode = opcode;
+                fragments.clear();
+            }
+
+            fragments += payload;
+
+            if (fragments.size() > MAX_WEBSOCKET_MESSAGE_LEN)
+            {
+                protocolError = true;
+                return false;
+            }
+
+            if (fin)
+            {
+                message.opcode  = fragmentsOpcode;
+                message.payload.swap(fragments);
+
+                fragments.clear();
+
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void WebSocketDecoder::reset()
+    {
+        buffer.clear();
+        fragments.clear();
+
+        consumed      = 0;
+        protocolError = false;
+    }
+
+    bool WebSocketDecoder::hasProtocolError() const
+    {
+        return protocolError;
+    }
+}
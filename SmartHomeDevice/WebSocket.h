@@ -0,0 +1,67 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+namespace SmartHomeDevice_n
+{
+    namespace WebSocketOpcode
+    {
+        enum Values : unsigned char
+        {
+            CONTINUATION = 0x0,
+            TEXT         = 0x1,
+            BINARY       = 0x2,
+            CLOSE        = 0x8,
+            PING         = 0x9,
+            PONG         = 0xA
+        };
+    };
+
+    struct WebSocketMessage
+    {
+        WebSocketOpcode::Values opcode;
+        std::string             payload;
+    };
+
+    // RFC 6455 helpers: handshake keys and frame encoding
+    class WebSocket
+    {
+    private:
+        WebSocket() = delete;
+
+    public:
+        static std::string makeKey(const uint32_t &seed);
+        static std::string makeAcceptKey(const std::string&);
+
+        // client frames must be masked (with a non-zero 'maskKey'), server frames must not
+        static void encodeFrame(std::string&, const WebSocketOpcode::Values&, const std::string&, const uint32_t &maskKey = 0);
+        static std::string encodeFrame(const WebSocketOpcode::Values&, const std::string&, const uint32_t &maskKey = 0);
+
+        static std::string sha1(const std::string&);
+        static std::string base64Encode(const std::string&);
+    };
+
+    // incremental frame decoder. Fragmented messages are reassembled; control frames are returned as soon as they arrive.
+    // Payload buffers are swapped with the message passed to next(), so reusing the same message doesn't allocate
+    class WebSocketDecoder
+    {
+    private:
+        std::string             buffer;
+        size_t                  consumed;
+        std::string             payload;        // of the current frame, unmasked
+        std::string             fragments;
+        WebSocketOpcode::Values fragmentsOpcode;
+        bool                    protocolError;
+
+    public:
+        WebSocketDecoder();
+
+        void feed(const std::string&);
+        void feed(const char*, const size_t&);
+        bool next(WebSocketMessage&);
+        void reset();
+
+        bool hasProtocolError() const;
+    };
+}